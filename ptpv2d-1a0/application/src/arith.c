@@ -60,18 +60,47 @@
 #include <limits.h>
 #include "ptpd.h"
 
-#define NSEC 1000000000
+/** CRC-32 polynomial (reflected) from annex C of the 1588 version 1 spec */
+#define CRC_POLYNOMIAL  0xedb88320
 
-#define	NSEC_TIME_TO_SECS(nsec_time)	\
-	( (Integer32) (nsec_time/NSEC) )
-	
-#define REMAINDER_NSECS(nsec_time, sec_time)\
-	( (Integer32) (nsec_time - (((Integer64)sec_time) * NSEC)) )
+/** Slice-by-8 CRC tables: crcTable[0] is the classic byte table,
+ *  crcTable[k][i] is the CRC of byte i followed by k zero bytes
+ */
+static UInteger32 crcTable[8][256];
+static Boolean    crcTableReady = FALSE;
+
+/** Function to build the slice-by-8 CRC tables on first use */
+static void crcInitTable(void)
+{
+  UInteger32 crc;
+  int        i, j;
+
+  for(i=0; i<256; i++)
+  {
+    crc = i;
+    for(j=0; j<8; j++)
+    {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC_POLYNOMIAL : (crc >> 1);
+    }
+    crcTable[0][i] = crc;
+  }
+  for(i=0; i<256; i++)
+  {
+    for(j=1; j<8; j++)
+    {
+      crcTable[j][i] = (crcTable[j-1][i] >> 8) ^ crcTable[0][crcTable[j-1][i] & 0xff];
+    }
+  }
+  crcTableReady = TRUE;
+}
 
 /** 
  * Function to calculate 32 bit CRC based on algorithm
  *  from annex C of the 1588 version 1 spec 
  *
+ * Uses slice-by-8 table lookups (8 bytes per step), giving the same
+ * result as the bit by bit algorithm in the spec.
+ *
  * @param[in] buf       Pointer to 8 bit data bytes to calculate CRC for
  * @param[in] length    Number of bytes to calculate CRC
  *
@@ -81,27 +110,37 @@
  */
 UInteger32 crc_algorithm(Octet *buf, Integer16 length)
 {
-  Integer16 i;
-  UInteger8 data;
-  UInteger32 polynomial = 0xedb88320, crc = 0xffffffff;
+  const UInteger8 *data = (const UInteger8 *)buf;
+  UInteger32 crc = 0xffffffff;
+  UInteger32 one, two;
   
+  if(!crcTableReady)
+    crcInitTable();
+
+  while(length >= 8)
+  {
+    /* Assemble words byte by byte: no alignment or byte order issues */
+    one = crc ^ (  (UInteger32)data[0]        | ((UInteger32)data[1] << 8)
+                 | ((UInteger32)data[2] << 16) | ((UInteger32)data[3] << 24));
+    two =          (UInteger32)data[4]        | ((UInteger32)data[5] << 8)
+                 | ((UInteger32)data[6] << 16) | ((UInteger32)data[7] << 24);
+
+    crc = crcTable[7][ one        & 0xff]
+        ^ crcTable[6][(one >>  8) & 0xff]
+        ^ crcTable[5][(one >> 16) & 0xff]
+        ^ crcTable[4][ one >> 24        ]
+        ^ crcTable[3][ two        & 0xff]
+        ^ crcTable[2][(two >>  8) & 0xff]
+        ^ crcTable[1][(two >> 16) & 0xff]
+        ^ crcTable[0][ two >> 24        ];
+
+    data   += 8;
+    length -= 8;
+  }
+
   while(length-- > 0)
   {
-    data = *(UInteger8 *)(buf++);
-    
-    for(i=0; i<8; i++)
-    {
-      if((crc^data)&1)
-      {
-        crc = (crc>>1);
-        crc ^= polynomial;
-      }
-      else
-      {
-        crc = (crc>>1);
-      }
-      data >>= 1;
-    }
+    crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xff];
   }
   
   return crc^0xffffffff;
@@ -111,6 +150,10 @@ UInteger32 crc_algorithm(Octet *buf, Integer16 length)
  * Function to calculate the unsigned 32 bit sum of a sequence of 
  * unsigned 32 bit bytes.
  *
+ * Adds 8 bytes at a time in four 16 bit lanes of a 64 bit word
+ * (SIMD within a register), folding the lanes into the sum before
+ * they can overflow.
+ *
  * @param[in] buf       Pointer to 8 bit data bytes to calculate the sum for
  * @param[in] length    Number of bytes to calculate sum
  *
@@ -122,7 +165,25 @@ UInteger32 crc_algorithm(Octet *buf, Integer16 length)
 UInteger32 sum(Octet *buf, Integer16 length)
 {
   UInteger32 sum = 0;
+  UInteger64 word, lanes;
+  int        n;
   
+  while(length >= 8)
+  {
+    /* Each word adds at most 2*255 to a lane, so 128 words fit in 16 bits */
+    lanes = 0;
+    for(n = 0; n < 128 && length >= 8; n++)
+    {
+      memcpy(&word, buf, 8);
+      lanes += ( word       & 0x00FF00FF00FF00FFULL)
+             + ((word >> 8) & 0x00FF00FF00FF00FFULL);
+      buf    += 8;
+      length -= 8;
+    }
+    lanes  = (lanes & 0x0000FFFF0000FFFFULL) + ((lanes >> 16) & 0x0000FFFF0000FFFFULL);
+    sum   += (UInteger32)(lanes & 0xFFFFFFFF) + (UInteger32)(lanes >> 32);
+  }
+
   while(length-- > 0)
     sum += *(UInteger8 *)(buf++);
   
@@ -304,17 +365,7 @@ void toInternalTime(TimeInternal *internal, TimeRepresentation *external, Boolea
  */ 
 void v2ToInternalTime(TimeInternal *internal, V2TimeRepresentation *external)
 {
-  
-  if(external->nanoseconds & ~INT_MAX)
-  {
-    internal->seconds     = -(external->seconds     % INT_MAX);
-    internal->nanoseconds = -(external->nanoseconds & INT_MAX);
-  }
-  else
-  {
-    internal->seconds     = external->seconds % INT_MAX;
-    internal->nanoseconds = external->nanoseconds;
-  }
+  nsToTime(internal, v2TimeToNs(external));
   
   DBGV("V2ToInternalTime: external:%10ds %11dns\n",
        external->seconds, external->nanoseconds
@@ -343,31 +394,7 @@ void v2ToInternalTime(TimeInternal *internal, V2TimeRepresentation *external)
  */ 
 void v2CorrectionToInternalTime(TimeInternal *internal, Integer64 external)
 {
-  /* This code is optimized for speed (avoid a divide if at all possible) */
-  if (abs(external) == 0)
-  {
-    internal->seconds     = 0;
-    internal->nanoseconds = 0;
-    return;
-  }
-  if (external > 0ULL)
-  {
-    external >>= 16;
-  }
-  else
-  {
-    external /= 65536;
-  }
-  if (abs(external) < 1000000000ULL)
-  {
-    internal->seconds     = 0;
-    internal->nanoseconds = (Integer32)external;
-  }
-  else
-  {
-    internal->seconds     = NSEC_TIME_TO_SECS(external);
-    internal->nanoseconds = REMAINDER_NSECS(external, internal->seconds);
-  }
+  nsToTime(internal, scaledToNs(external));
  
   DBGV("V2CorrectionToInternalTime: external: %16.16llx\n",
        external
@@ -378,42 +405,6 @@ void v2CorrectionToInternalTime(TimeInternal *internal, Integer64 external)
 }
 
 
-/**
- * Function to do fixup of time after based
- * on calling other routines here in arith.c
- * This function "noramlizes" the time by making
- * sure that after time additions, subtractions
- * etc. that the nanoseconds field if between
- * -999,999,999 and +999,999,999 and as
- * necessary, the seconds field is adjusted if
- * the nanosecond time is outside of those
- * boundaries.
- *
- *
- * @param[in,out] result       
- * Pointer to TimeInternal structure containing ptpv2d
- * code internal time representation of signed
- * seconds and signed nanoseconds for which the 
- * time values are "normalized".
- *
- */ 
-static void normalizeTime(TimeInternal *result)
-{
-  result->seconds     += result->nanoseconds/1000000000;
-  result->nanoseconds -= result->nanoseconds/1000000000*1000000000;
-  
-  if(     result->seconds > 0 && result->nanoseconds < 0)
-  {
-    result->seconds     -= 1;
-    result->nanoseconds += 1000000000;
-  }
-  else if(result->seconds < 0 && result->nanoseconds > 0)
-  {
-    result->seconds     += 1;
-    result->nanoseconds -= 1000000000;
-  }
-}
-
 /**
  * Function to add two ptpv2d time values
  * as represented by ptpv2d internal time
@@ -435,15 +426,15 @@ static void normalizeTime(TimeInternal *result)
  * code internal time representation of signed
  * seconds for "y".
  *
- * @see normalizeTime
- * @see subtractTime
+ * The sum is done in 64 bit nanoseconds, so the result is
+ * normalized (both fields have the same sign) without any
+ * carry handling.
+ *
+ * @see subTime
  */ 
 void addTime(TimeInternal *result, TimeInternal *x, TimeInternal *y)
 {
-  result->seconds     = x->seconds     + y->seconds;
-  result->nanoseconds = x->nanoseconds + y->nanoseconds;
-  
-  normalizeTime(result);
+  nsToTime(result, timeToNs(x) + timeToNs(y));
 }
 
 /**
@@ -467,15 +458,11 @@ void addTime(TimeInternal *result, TimeInternal *x, TimeInternal *y)
  * code internal time representation of signed
  * seconds for "y".
  *
- * @see normalizeTime
  * @see addTime
  */ 
 void subTime(TimeInternal *result, TimeInternal *x, TimeInternal *y)
 {
-  result->seconds     = x->seconds     - y->seconds;
-  result->nanoseconds = x->nanoseconds - y->nanoseconds;
-  
-  normalizeTime(result);
+  nsToTime(result, timeToNs(x) - timeToNs(y));
 }
 
 void clearTime(TimeInternal *time)
@@ -486,43 +473,7 @@ void clearTime(TimeInternal *time)
 
 void halveTime(TimeInternal *time)
 {
-  register Boolean seconds_positive;
-  register Boolean seconds_odd;
-
-  if (time->nanoseconds >= 0)
-  {
-    time->nanoseconds >>= 1;
-  }
-  else
-  {
-    time->nanoseconds /= 2;
-  }
-  if (time->seconds == 0)
-  {
-    return;
-  }
-
-  seconds_positive = (time->seconds > 0);
-  seconds_odd      = ((((UInteger32)time->seconds) & 1) == 1);
-
-  if (seconds_positive)
-  {
-    time->seconds >>= 1;
-    if (seconds_odd)
-    {
-      time->nanoseconds += 500000000;
-    }
-    return;
-  }
-  else
-  {
-    time->seconds /=  2;
-    if (seconds_odd)
-    {
-      time->nanoseconds -= 500000000;
-    }
-    return;
-  }
+  nsToTime(time, timeToNs(time) / 2);   // Rounds towards zero
 }
 
 void copyTime(TimeInternal *destination, TimeInternal *source)
@@ -538,10 +489,7 @@ Integer32 getSeconds(TimeInternal *time)
 
 Integer64 getNanoseconds(TimeInternal *time)
 {
-  return (
-            ((Integer64)time->seconds * 1000000000)
-          + time->nanoseconds
-         );
+  return timeToNs(time);
 }
 
 /** 
@@ -0,0 +1,169 @@
+/* src/bench/arith_bench.c */
+/* Benchmark and equivalence test of crc_algorithm() and sum() */
+
+/**
+ * @file arith_bench.c
+ *
+ * Compares crc_algorithm() and sum() from arith.c with the bit by bit
+ * CRC of annex C of the 1588 version 1 spec and the byte loop sum they
+ * replaced, over random buffers of every length up to 300 bytes and
+ * every start alignment, then times both versions.
+ *
+ * @par Usage
+ * arith_bench [-c]
+ *
+ * -c only runs the equivalence test (make check), otherwise the timing
+ * follows (make bench).  Exits with 1 if any result differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../ptpd.h"
+
+int debugLevel = 0;
+
+#define MAX_LENGTH   300     // Longest buffer compared at every length
+#define ROUNDS       200     // Random buffers per length and alignment
+#define BENCH_NS     200000000LL  // Time spent on each measurement (ns)
+
+/** The bit by bit CRC from annex C of the version 1 spec (old crc_algorithm) */
+static UInteger32 crcBitwise(Octet *buf, Integer16 length)
+{
+  Integer16 i;
+  UInteger8 data;
+  UInteger32 polynomial = 0xedb88320, crc = 0xffffffff;
+
+  while(length-- > 0)
+  {
+    data = *(UInteger8 *)(buf++);
+
+    for(i=0; i<8; i++)
+    {
+      if((crc^data)&1)
+      {
+        crc = (crc>>1);
+        crc ^= polynomial;
+      }
+      else
+      {
+        crc = (crc>>1);
+      }
+      data >>= 1;
+    }
+  }
+
+  return crc^0xffffffff;
+}
+
+/** The byte loop sum (old sum) */
+static UInteger32 sumBytewise(Octet *buf, Integer16 length)
+{
+  UInteger32 sum = 0;
+
+  while(length-- > 0)
+    sum += *(UInteger8 *)(buf++);
+
+  return sum;
+}
+
+static Integer64 nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Integer64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Function to compare old and new results, returns the number of mismatches */
+static int compare(Octet *buf)
+{
+  int length, align, round, i, bad = 0;
+
+  srand(1);
+  for (length = 0; length <= MAX_LENGTH + 1; length++)
+  {
+    if (length > MAX_LENGTH)
+      length = 32767;                      // and the longest Integer16 length
+    for (align = 0; align < 8; align++)
+    {
+      for (round = 0; round < ROUNDS; round++)
+      {
+        for (i = 0; i < length; i++)
+          buf[align + i] = rand();
+
+        if (   crc_algorithm(buf + align, length) != crcBitwise(buf + align, length)
+            || sum(buf + align, length)           != sumBytewise(buf + align, length)
+           )
+        {
+          fprintf(stderr, "mismatch: length %d, alignment %d\n", length, align);
+          bad++;
+        }
+        if (length == 32767)
+          break;                           // one round is enough at this length
+      }
+    }
+  }
+  return bad;
+}
+
+/** Function to time one function at one length, returns ns per call */
+static double timeCall(UInteger32 (*f)(Octet *, Integer16), Octet *buf, int length)
+{
+  volatile UInteger32 sink = 0;
+  Integer64 start, elapsed;
+  long      calls = 0, batch;
+
+  start = nowNs();
+  do
+  {
+    for (batch = 0; batch < 64; batch++)
+      sink += f(buf, length);
+    calls  += batch;
+    elapsed = nowNs() - start;
+  } while (elapsed < BENCH_NS);
+  (void)sink;
+  return (double)elapsed / calls;
+}
+
+int main(int argc, char **argv)
+{
+  static const int lengths[] = { 16, 128, 1024 };
+  Octet *buf;
+  int    bad, i;
+  double before, after;
+
+  buf = malloc(32767 + 8);
+  if (!buf)
+    return 1;
+
+  bad = compare(buf);
+  printf("arith_bench: crc_algorithm and sum %s the old versions\n",
+         bad ? "DIFFER from" : "match");
+  if (bad || (argc > 1 && strcmp(argv[1], "-c") == 0))
+  {
+    free(buf);
+    return bad ? 1 : 0;
+  }
+
+  for (i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++)
+  {
+    before = timeCall(crcBitwise,    buf, lengths[i]);
+    after  = timeCall(crc_algorithm, buf, lengths[i]);
+    printf("crc %5d bytes: %10.1f -> %8.1f ns (%.1fx)\n",
+           lengths[i], before, after, before / after);
+  }
+  for (i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++)
+  {
+    before = timeCall(sumBytewise, buf, lengths[i]);
+    after  = timeCall(sum,         buf, lengths[i]);
+    printf("sum %5d bytes: %10.1f -> %8.1f ns (%.1fx)\n",
+           lengths[i], before, after, before / after);
+  }
+
+  free(buf);
+  return 0;
+}
+
+// eof arith_bench.c
@@ -0,0 +1,79 @@
+#!/bin/sh
+# src/bench/sync_cpu.sh
+# CPU time per Sync of a master and a slave at Sync rates up to 128/s
+#
+# Runs a master and a slave ptpv2d over a veth pair between two network
+# namespaces, for each Sync interval (-y) in turn, and reads the CPU time
+# of all their threads from /proc/<pid>/task/*/schedstat over a fixed
+# window after a warm up.  The CPU time is divided by the Syncs the
+# master sends in the window at the nominal rate.  The slave runs with
+# -t so the benchmark leaves the system clock alone.  Needs root.
+#
+# Usage: sync_cpu.sh [ptpv2d binary] [window seconds]
+#
+# make bench-sync runs it on ./ptpv2d with the default 20 s window.
+
+PROG=${1:-./ptpv2d}
+WINDOW=${2:-20}
+WARMUP=4
+INTERVALS="0 -3 -5 -7"
+NS_M=ptpbench_m
+NS_S=ptpbench_s
+
+if [ "$(id -u)" != 0 ]; then
+  echo "sync_cpu: needs root for the network namespaces" >&2
+  exit 2
+fi
+if [ ! -x "$PROG" ]; then
+  echo "sync_cpu: no $PROG, build it first" >&2
+  exit 2
+fi
+
+cleanup() {
+  [ -n "$MASTER" ] && kill "$MASTER" 2>/dev/null
+  [ -n "$SLAVE" ]  && kill "$SLAVE"  2>/dev/null
+  wait 2>/dev/null
+  ip netns del $NS_M 2>/dev/null
+  ip netns del $NS_S 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+ip netns add $NS_M
+ip netns add $NS_S
+ip link add ptpbm netns $NS_M type veth peer name ptpbs netns $NS_S
+ip -n $NS_M addr add 10.199.0.1/24 dev ptpbm
+ip -n $NS_S addr add 10.199.0.2/24 dev ptpbs
+ip -n $NS_M link set ptpbm up
+ip -n $NS_S link set ptpbs up
+ip -n $NS_M route add 224.0.0.0/4 dev ptpbm
+ip -n $NS_S route add 224.0.0.0/4 dev ptpbs
+
+# CPU time (ns) of all threads of a process
+cpu() {
+  cat /proc/$1/task/*/schedstat 2>/dev/null | awk '{ t += $1 } END { print t }'
+}
+
+echo "sync_cpu: $PROG, ${WINDOW} s window"
+echo "  -y  Sync/s   master us/Sync   slave us/Sync"
+for y in $INTERVALS; do
+  # ip netns exec execs the program, so these are the ptpv2d pids
+  ip netns exec $NS_M "$PROG" -c -x -2 -b ptpbm -y $y -s 1 >/dev/null 2>&1 &
+  MASTER=$!
+  sleep 1
+  ip netns exec $NS_S "$PROG" -c -x -2 -g -t -b ptpbs -y $y >/dev/null 2>&1 &
+  SLAVE=$!
+  sleep $WARMUP
+
+  m0=$(cpu $MASTER); s0=$(cpu $SLAVE)
+  sleep $WINDOW
+  m1=$(cpu $MASTER); s1=$(cpu $SLAVE)
+
+  kill $MASTER $SLAVE
+  wait $MASTER $SLAVE 2>/dev/null
+  MASTER= ; SLAVE=
+
+  awk -v y=$y -v w=$WINDOW -v m=$((m1 - m0)) -v s=$((s1 - s0)) 'BEGIN {
+    rate = 2 ^ -y
+    printf("%4d %7g %16.1f %15.1f\n", y, rate, m / 1e3 / (w * rate), s / 1e3 / (w * rate))
+  }'
+done
@@ -124,12 +124,12 @@ int return_value;
   ptpClock->preferred              = rtOpts->clockPreferred;
   ptpClock->initializable          = INITIALIZABLE;
   ptpClock->external_timing        = EXTERNAL_TIMING;
-  ptpClock->is_boundary_clock      = BOUNDARY_CLOCK;
+  ptpClock->is_boundary_clock      = (rtOpts->numberPorts > 1);
   memcpy(ptpClock->subdomain_name,
          rtOpts->subdomainName,
          PTP_SUBDOMAIN_NAME_LENGTH
         );
-  ptpClock->number_ports           = NUMBER_PORTS;
+  ptpClock->number_ports           = rtOpts->numberPorts;
   ptpClock->number_foreign_records = 0;
   ptpClock->max_foreign_records    = rtOpts->max_foreign_records;
   
@@ -208,14 +208,15 @@ int return_value;
  * @par
  * AKB: Added V2 init of vars for m1 
  */
-void m1(PtpClock *ptpClock)
+void m1(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
   /* Default data set */
   ptpClock->steps_removed                  = 0;  /* v1 & v2 */
-  ptpClock->offset_from_master.seconds     = 0;  /* v1 & v2 */
-  ptpClock->offset_from_master.nanoseconds = 0;  /* v1 & v2 */
-  ptpClock->one_way_delay.seconds          = 0;  /* v1 & v2 (meanPathDelay) */
-  ptpClock->one_way_delay.nanoseconds      = 0;  
+
+  /* offset_from_master and one_way_delay (meanPathDelay) are the
+   * servo's, it clears them in turn with the port's measurements
+   */
+  servoClearCurrent(rtOpts, ptpClock);
   
   /* Parent data set */
   ptpClock->parent_communication_technology  = ptpClock->clock_communication_technology; /* v1 */
@@ -576,11 +577,15 @@ B:
     return -1;  /* B1 */
 }
 
-/** PTP version 1 Function to test for Best Master between two sync messages */
-UInteger8 bmcStateDecision(MsgHeader   *header,  /**< PTP header info */
-                           MsgSync     *sync,    /**< Sync message data */
-                           RunTimeOpts *rtOpts,  /**< Run time options */
-                           PtpClock    *ptpClock /**< Main PTP data structure */
+/** PTP version 1 Function to test for Best Master between two sync messages.
+ * header/sync is the best master seen on any port of the clock, only
+ * the port that received it (bestPort) becomes SLAVE.
+ */
+UInteger8 bmcStateDecision(MsgHeader   *header,   /**< PTP header info */
+                           MsgSync     *sync,     /**< Sync message data */
+                           PtpClock    *bestPort, /**< Port that received the best master */
+                           RunTimeOpts *rtOpts,   /**< Run time options */
+                           PtpClock    *ptpClock  /**< Main PTP data structure */
                           )
 {
   /* Test if run time option is set for Slave only, 
@@ -590,7 +595,7 @@ UInteger8 bmcStateDecision(MsgHeader   *header,  /**< PTP header info */
   if(rtOpts->slaveOnly)
   {
     s1(header, sync, ptpClock);
-    return PTP_SLAVE;
+    return bestPort == ptpClock ? PTP_SLAVE : PTP_PASSIVE;
   }
   
   copyD0(&ptpClock->msgTmpHeader, &ptpClock->msgTmp.sync, ptpClock);
@@ -607,7 +612,7 @@ UInteger8 bmcStateDecision(MsgHeader   *header,  /**< PTP header info */
       )
     {
       /* Stratum is less 3 and we are a better clock, run m1 and return MASTER state */
-      m1(ptpClock);
+      m1(rtOpts, ptpClock);
       return PTP_MASTER;
     }
     s1(header, sync, ptpClock);
@@ -624,28 +629,102 @@ UInteger8 bmcStateDecision(MsgHeader   *header,  /**< PTP header info */
   {
     /* Grandmaster stratum is 3 or more, but not equal to 255 and we are a better clock,
      * return MASTER */
-    m1(ptpClock);
+    m1(rtOpts, ptpClock);
     return PTP_MASTER;
   }
   else
   {
-    /* Grandmaster stratum is 255 or we are not a better clock, return SLAVE state */
+    /* Grandmaster stratum is 255 or we are not a better clock, the port
+     * that hears the best master is SLAVE, the other ports of a boundary
+     * clock pass its time on as MASTER
+     */
     s1(header, sync, ptpClock);
-    return PTP_SLAVE;
+    return bestPort == ptpClock ? PTP_SLAVE : PTP_MASTER;
   }
 }
 
+/** PTP version 1 Function to find the best foreign master record of a port
+ *
+ * @return Returns index of the best record, -1 if the port has none
+ */
+static Integer16 bmcPortBest(PtpClock *ptpClock)
+{
+  ForeignMasterRecord *foreign = ptpClock->foreign;
+  Integer16            i, best;
+
+  if(!ptpClock->number_foreign_records)
+    return -1;
+
+  for(i = 1, best = 0; i < ptpClock->number_foreign_records; ++i)
+  {
+    /* Check current loop indx record versus current "best" record */
+    if(bmcDataSetComparison(&foreign[i].header,
+                            &foreign[i].sync,
+                            &foreign[best].header,
+                            &foreign[best].sync,
+                            ptpClock
+                           ) > 0)
+    {
+      /* Current loop index is better than previous "best", set new "best" */
+      best = i;
+    }
+    DBGV("bmc: comparison loop i=%d, best=%d\n",i,best);
+  }
+
+  DBGV("bmc: port %d best record %d\n", ptpClock->port_id_field, best);
+  return best;
+}
+
 /** PTP version 1 Best Master Clock (bmc) function */
 UInteger8 bmc(ForeignMasterRecord *foreign, 
               RunTimeOpts         *rtOpts,
               PtpClock            *ptpClock
              )
 {
-  Integer16 i, best;
+  PtpClock  *port, *bestPort;
+  Integer16  i, portBest, bestIndex;
+
+  /* Find the best foreign master over all ports of the clock */
+
+  bestPort  = NULL;
+  bestIndex = -1;
+  port      = ptpClockFirstPort(ptpClock);
+  for(i = 0; i < ptpClock->number_ports; i++, port++)
+  {
+    if(   port != ptpClock
+       && (   port->port_state == PTP_INITIALIZING
+           || port->port_state == PTP_FAULTY
+           || port->port_state == PTP_DISABLED
+          )
+      )
+    {
+      continue;
+    }
+    portBest = bmcPortBest(port);
+    if(port == ptpClock && portBest >= 0)
+    {
+      /* Store index to best foreign master of this port */
+      ptpClock->foreign_record_best = portBest;
+    }
+    if(   portBest >= 0
+       && (   !bestPort
+           || bmcDataSetComparison(&port->foreign[portBest].header,
+                                   &port->foreign[portBest].sync,
+                                   &bestPort->foreign[bestIndex].header,
+                                   &bestPort->foreign[bestIndex].sync,
+                                   ptpClock
+                                  ) > 0
+          )
+      )
+    {
+      bestPort  = port;
+      bestIndex = portBest;
+    }
+  }
 
   /* Check if any foreign masters */
   
-  if(!ptpClock->number_foreign_records)
+  if(!bestPort)
   {
     DBGV("bmc: number_foreign_records is zero, state: %u\n",
          ptpClock->port_state
@@ -654,42 +733,22 @@ UInteger8 bmc(ForeignMasterRecord *foreign,
     if(ptpClock->port_state == PTP_MASTER)
     {
       DBGV("bmc: calling m1\n"); 
-      m1(ptpClock);
+      m1(rtOpts, ptpClock);
     }
     return ptpClock->port_state;  /* no change */
   }
   
-  DBGV("bmc: number_foreign_records is non zero, state: %u\n",
+  DBGV("bmc: best record %d of port %d, state: %u\n",
+       bestIndex,
+       bestPort->port_id_field,
        ptpClock->port_state
       );
-  /* There is at least one foreign master.  Scan through foreign master database and compare
-   * to look for best master to use 
-   */
-  for(i = 1, best = 0; i < ptpClock->number_foreign_records; ++i)
-  {
-    /* Check current loop indx record versus current "best" record */
-    if(bmcDataSetComparison(&foreign[i].header,
-                            &foreign[i].sync,
-                            &foreign[best].header,
-                            &foreign[best].sync,
-                            ptpClock
-                           ) > 0)
-    {
-      /* Current loop index is better than previous "best", set new "best" */
-      best = i;
-    }
-    DBGV("bmc: comparison loop i=%d, best=%d\n",i,best);
-  }
-
-  /* Best record found, store index to best foreign master */
-  
-  DBGV("bmc: best record %d\n", best);
-  ptpClock->foreign_record_best = best;
 
   /* Now that best is found, determine recommended state */
   
-  return bmcStateDecision(&foreign[best].header,
-                          &foreign[best].sync,
+  return bmcStateDecision(&bestPort->foreign[bestIndex].header,
+                          &bestPort->foreign[bestIndex].sync,
+                          bestPort,
                           rtOpts,
                           ptpClock
                          );
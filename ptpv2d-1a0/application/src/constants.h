@@ -92,13 +92,22 @@
 #define PTP_SUBDOMAIN_NAME_LENGTH           16
 #define PTP_MAX_MANAGEMENT_PAYLOAD_SIZE     90
 
-/* no support for intervals less than one */
-#define PTP_SYNC_INTERVAL_TIMEOUT(x) (1<<((x)<0?0:(x))) // AKB: changed from ?1:(x) to ?0
-#define PTP_SYNC_RECEIPT_TIMEOUT(x)  (10*(1<<((x)<0?0:(x))))
+/* protocol timers count ticks of 2^PTP_LOG_TICK seconds, so every
+ * message interval from 128 per second up is a whole number of ticks
+ */
+#define PTP_LOG_TICK                 (-7)
+#define PTP_LOG_INTERVAL_MAX         6
+#define PTP_TICKS(s)                 ((s) << -PTP_LOG_TICK)  // seconds to ticks
+#define PTP_LOG_TICKS(x)             (1 << (  (x) < PTP_LOG_TICK         ? 0                                  \
+                                            : (x) > PTP_LOG_INTERVAL_MAX ? PTP_LOG_INTERVAL_MAX - PTP_LOG_TICK \
+                                            : (x) - PTP_LOG_TICK))
+#define PTP_SYNC_INTERVAL_TIMEOUT(x) PTP_LOG_TICKS(x)
+/* ten Sync intervals, but at least a second at high Sync rates */
+#define PTP_SYNC_RECEIPT_TIMEOUT(x)  (10*PTP_LOG_TICKS(x) > PTP_TICKS(1) ? 10*PTP_LOG_TICKS(x) : PTP_TICKS(1))
 
 #define PTP_DELAY_REQ_INTERVAL              4  // AKB: Changed from 30 to 4 for MPC8313E testing
 #define PTP_FOREIGN_MASTER_THRESHOLD        2
-#define PTP_FOREIGN_MASTER_TIME_WINDOW(x)   (4*(1<<((x)<0?0:(x))))
+#define PTP_FOREIGN_MASTER_TIME_WINDOW(x)   (4*PTP_LOG_TICKS(x))
 #define PTP_RANDOMIZING_SLOTS               18
 #define PTP_LOG_VARIANCE_THRESHOLD          256
 #define PTP_LOG_VARIANCE_HYSTERESIS         128
@@ -206,6 +215,7 @@ enum {
   ANNOUNCE_INTERVAL_TIMER,      // AKB: Added for V2
   PDELAY_INTERVAL_TIMER,        // AKB: Added for V2
   QUALIFICATION_TIMER,
+  HOLDOVER_TIMER,               // Holdover frequency update, no master
   TIMER_ARRAY_SIZE               /* these two are non-spec */
 };
 
@@ -245,6 +255,15 @@ enum {
 #define V2_SIGNALING_LENGTH            44  /**< NOTE:Base length not including any TLVs */
 #define V2_MANAGEMENT_LENGTH           48  /**< NOTE:Base length not including any TLVs */
 
+/* Byte offsets of the V2 fields read through the message view accessors */
+#define V2_MESSAGE_TYPE_OFFSET          0
+#define V2_FLAGS_OFFSET                 6
+#define V2_CORRECTION_OFFSET            8
+#define V2_SOURCE_PORT_ID_OFFSET       20
+#define V2_SEQUENCE_ID_OFFSET          30
+#define V2_TIMESTAMP_OFFSET            34
+#define V2_REQUESTING_PORT_ID_OFFSET   44
+
 
 /* Version 2 control field values */
 
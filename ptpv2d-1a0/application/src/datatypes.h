@@ -82,10 +82,19 @@ typedef struct
   Integer32 nanoseconds;  
 } TimeInternal;
 
+/** Signed time in nanoseconds, used for time arithmetic (covers
+ *  +/- 292 years, so 48 bit PTP seconds are fine until year 2262) */
+typedef Integer64 TimeNs;
+
+/** Signed time in nanoseconds * 2^16 (V2 correctionField format), used
+ *  for corrections, delays and offsets (covers +/- 1.6 days) */
+typedef Integer64 TimeScaled;
+
 typedef struct 
 {
-  Integer32  interval;
-  Integer32  left;
+  Integer32  interval;   /**< Timer period in ticks (0 if stopped) */
+  Integer64  deadline;   /**< Absolute CLOCK_MONOTONIC expiry time in ns */
+  Integer32  heapSlot;   /**< Position in timer heap + 1 (0 if not running) */
   Boolean    expire;
 } IntervalTimer;
 
@@ -138,6 +147,16 @@ typedef struct
   UInteger8    logMeanMessageInterval;                // 33       1
 } V2MsgHeader;
 
+/**
+ * Zero-copy view of a received message. Fields are decoded in place
+ * from buf by the msgView accessors in ptpd_dep.h, only when read.
+ */
+typedef struct
+{
+  const UInteger8 *buf;     /**< Start of the PTP message */
+  Integer32        length;  /**< Number of bytes received */
+} MsgView;
+
 /** PTP Version 1 Sync or Delay_Req message structure */
 typedef struct 
 {
@@ -400,6 +419,191 @@ typedef struct
 
 } ForeignMasterRecord;
 
+/** One received message in the batched receive ring */
+typedef struct
+{
+  Octet         buffer[(PACKET_SIZE+16)]; /**< Same layout as inputBuffer, PTP message at &buffer[16] */
+  ssize_t       length;                   /**< Received message length, 0 if unusable */
+  TimeInternal  time;                     /**< Receive time stamp (event messages) */
+} NetRxSlot;
+
+/** Preallocated ring of receive buffers filled by one batched receive call */
+typedef struct
+{
+  NetRxSlot   slot[NET_RX_BATCH];
+  Integer16   count;                      /**< Number of slots filled by the last batched receive */
+  Integer16   next;                       /**< Next slot to dispatch */
+} NetRxRing;
+
+/** Linear regression servo (-S lr): least squares fit of phase and
+ * frequency over a sliding window of (Sync receive time, offset)
+ * samples.  Offsets are stored free running, i.e. with the servo's own
+ * frequency adjustments added back, so the slope is the frequency error
+ * of the unadjusted clock.  The sums are updated as samples enter and
+ * leave the window and rebuilt relative to the oldest sample each time
+ * the window wraps, so rounding errors do not build up.
+ */
+typedef struct
+{
+  TimeNs      t[LINREG_WINDOW_MAX];       /**< Sync receive time of each sample */
+  double      y[LINREG_WINDOW_MAX];       /**< Free running offset of each sample (ns) */
+  UInteger16  count;                      /**< Samples in the window */
+  UInteger16  next;                       /**< Slot of the next sample */
+  TimeNs      origin;                     /**< Time of x = 0 */
+  double      sx, sy, sxx, sxy, syy;      /**< Sums of x (s), y (ns) and their products */
+  double      phase;                      /**< Time the servo's adjustments moved the clock (ns) */
+  TimeNs      last_t;                     /**< Time of the previous sample */
+  Integer32   last_adj;                   /**< Adjustment applied since the previous sample (ppb) */
+  double      residue;                    /**< Fraction of a ppb not yet applied */
+  Integer32   jitter;                     /**< RMS residual of the fit (ns) */
+} linreg_servo;
+
+/** Kalman filter servo (-S kalman): estimates the phase (offset from
+ * master) and the frequency error of the free running clock.  The
+ * process noise models white frequency noise and oscillator frequency
+ * wander.  The measurement (network and time stamp) noise and the
+ * wander are both estimated from the measurements, so the gain follows
+ * the observed noise.
+ */
+typedef struct
+{
+  Boolean     valid;                      /**< State set from a first measurement */
+  double      phase;                      /**< Estimated offset from master (ns) */
+  double      freq;                       /**< Estimated frequency error (ppb) */
+  double      p[2][2];                    /**< Covariance of the estimate */
+  double      r;                          /**< Measurement noise variance (ns^2) */
+  double      q;                          /**< Frequency wander (ppb^2/s) */
+  double      last_z;                     /**< Previous measurement (ns) */
+  double      last_diff;                  /**< Previous free running offset difference (ns) */
+  UInteger32  samples;                    /**< Measurements since the state was set */
+  TimeNs      last_t;                     /**< Time of the previous measurement */
+  Integer32   last_adj;                   /**< Adjustment applied since the previous measurement (ppb) */
+  double      residue;                    /**< Fraction of a ppb not yet applied */
+  Integer32   jitter;                     /**< Measurement noise estimate, square root of r (ns) */
+} kalman_servo;
+
+/** Servo supervisor: the lock state of the servo, from the RMS offset
+ * from master over the last SERVO_RMS_WINDOW Syncs against thresholds
+ * raised by the measurement noise, selects the gains.
+ * A state must hold for a full window before the next change, and is
+ * left for a worse one only at SERVO_HYSTERESIS times its threshold.
+ */
+typedef struct
+{
+  UInteger8   state;                      /**< SERVO_UNLOCKED, _ACQUIRING, _LOCKED or _HOLDOVER */
+  double      offset[SERVO_RMS_WINDOW];   /**< Offsets from master of the window (ns) */
+  UInteger16  count;                      /**< Offsets in the window */
+  UInteger16  next;                       /**< Slot of the next offset */
+  Integer32   rms;                        /**< RMS offset over the window (ns) */
+  Integer32   noise;                      /**< Measurement noise over the window (ns) */
+  Integer32   ap, ai;                     /**< P and I attenuations in use */
+} servo_supervisor;
+
+/** Windowed one way delay filter (-W): the delay is the minimum of the
+ * last samples, the one least delayed by queueing.  The minimum is kept
+ * in a monotonic deque of ever larger samples with their numbers, so it
+ * costs O(1) amortized per sample.  Samples further than a number of
+ * median absolute deviations from the median of the window are rejected
+ * before they enter it.
+ */
+typedef struct
+{
+  TimeScaled  sample[DELAY_WINDOW_MAX];     /**< Accepted samples, for the median */
+  UInteger16  count;                        /**< Samples in the window */
+  UInteger16  next;                         /**< Slot of the next sample */
+  UInteger32  seq;                          /**< Number of the next sample */
+  UInteger32  minq_seq[DELAY_WINDOW_MAX];   /**< Deque of sample numbers, window minimum first */
+  TimeScaled  minq_delay[DELAY_WINDOW_MAX]; /**< Their samples, increasing from the front */
+  UInteger32  minq_head;                    /**< Deque front */
+  UInteger32  minq_tail;                    /**< Deque back */
+  UInteger32  rejected;                     /**< Samples rejected as outliers */
+  UInteger16  reject_run;                   /**< Consecutive samples rejected */
+} delay_window;
+
+/** Holdover: while the servo is locked the frequency it applies is
+ * averaged over each HOLDOVER_INTERVAL into a history.  When the master
+ * is lost a line is fitted to the history and its frequency, following
+ * the trend, is applied until a master is back.  The error of the fit
+ * gives an estimated bound of the time error built up, and the servo
+ * restarts from the predicted frequency.
+ */
+typedef struct
+{
+  TimeNs      t[HOLDOVER_HISTORY];        /**< Middle of each interval */
+  double      freq[HOLDOVER_HISTORY];     /**< Mean adjFreq() value of each interval (ppb) */
+  UInteger16  count;                      /**< Intervals in the history */
+  UInteger16  next;                       /**< Slot of the next interval */
+  TimeNs      start;                      /**< Start of the interval being averaged */
+  TimeNs      last;                       /**< Time of its last sample */
+  double      sum;                        /**< Sum of its adjFreq() values */
+  UInteger32  samples;                    /**< Values in the sum */
+  Boolean     active;                     /**< No master, holding over */
+  TimeNs      since;                      /**< Start of holdover */
+  double      freq0;                      /**< Predicted adjFreq() value at the start (ppb) */
+  double      trend;                      /**< Predicted frequency change (ppb/s) */
+  double      span;                       /**< Most seconds the trend is extrapolated */
+  double      sigma;                      /**< RMS residual of the fit (ppb) */
+  double      sigma_trend;                /**< Standard error of the trend (ppb/s) */
+  double      phase;                      /**< Offset from master at the start (ns) */
+  double      residue;                    /**< Fraction of a ppb not yet applied */
+  Integer32   adj;                        /**< Predicted adjFreq() value applied */
+  Integer32   bound;                      /**< Estimated time error bound (ns) */
+} holdover_servo;
+
+/** Servo state of the state file (-j), read for a warm start or
+ * waiting to be written
+ */
+typedef struct
+{
+  Boolean               checked;          /**< State file read (or found unusable) */
+  Integer64             saved;            /**< Time saved (s since the epoch) */
+  Octet                 parent_identity[8];
+  UInteger16            parent_port_id;
+  double                freq;             /**< adjFreq() value (ppb) */
+  one_way_delay_filter  owd_filt;
+  TimeScaled            one_way_delay_scaled;
+} servo_state;
+
+/** Time stamped measurement passed from the protocol engine to the
+ * servo and statistics, in the order the messages completed
+ */
+typedef struct
+{
+  UInteger8     type;                      /**< MEASURE_xxx */
+  UInteger8     port_state;                /**< Port state when taken */
+  UInteger16    port_id_field;             /**< Port that took the measurement */
+  UInteger16    sequence_id;               /**< Sequence id of the Sync or (P)Delay_Req */
+  Integer16     current_utc_offset;
+  TimeInternal  t1;                        /**< Sync sent (master) or PDelay_Req sent (self) */
+  TimeInternal  t2;                        /**< Sync received (self) or PDelay_Req received (peer) */
+  TimeInternal  t3;                        /**< Delay_Req sent (self) or PDelay_Resp sent (peer) */
+  TimeInternal  t4;                        /**< Delay_Req received (master) or PDelay_Resp received (self) */
+  TimeScaled    correction;                /**< Sync + Follow_Up, Delay_Resp or PDelay_Resp correction */
+  TimeScaled    followup_correction;       /**< PDelay_Resp_Follow_Up correction */
+  Octet         parent_identity[8];        /**< Sync: clock identity (V2) or UUID (V1) of the parent */
+  UInteger16    parent_port_id;            /**< Sync: port of the parent */
+} Measurement;
+
+/** Lock-free single producer, single consumer measurement ring of a
+ * port.  The producer (protocol engine) and consumer (servo) indices
+ * are each on a cache line of their own, with a cached copy of the
+ * other side's index, so the two only share a line when the cached
+ * copy runs out.  The alignment makes the queue, and so PtpClock,
+ * cache line aligned; allocatePtpdMemory() allocates the port array
+ * to match
+ */
+typedef struct
+{
+  UInteger32  head                         /**< Next slot to fill, written by the producer */
+                __attribute__((aligned(CACHE_LINE_SIZE)));
+  UInteger32  tail_cache;                  /**< Producer's copy of tail */
+  UInteger32  tail                         /**< Next slot to drain, written by the consumer */
+                __attribute__((aligned(CACHE_LINE_SIZE)));
+  UInteger32  head_cache;                  /**< Consumer's copy of head */
+  Measurement slot[MEASURE_QUEUE_SIZE]     /**< Ring, from the next cache line on */
+                __attribute__((aligned(CACHE_LINE_SIZE)));
+} MeasureQueue;
+
 /** Main program data structure for ptpv2d */
 typedef struct {
   /* Default data set */
@@ -418,6 +622,7 @@ typedef struct {
   Integer8     sync_interval;                             /* V2 & V1 */
   Octet        subdomain_name[PTP_SUBDOMAIN_NAME_LENGTH];
   UInteger16   number_ports;                              /* V2 & V1, static */
+  UInteger16   slave_port;                                /**< First port only: port in SLAVE state disciplining the clock, 0 if none (atomic) */
   UInteger16   number_foreign_records;
 
   /* AKB: added for V2 */
@@ -437,6 +642,9 @@ typedef struct {
   UInteger16    steps_removed;          /* V1 & V2 */
   TimeInternal  offset_from_master;     /* V1 & V2 */
   TimeInternal  one_way_delay;
+  TimeScaled    offset_from_master_scaled; /**< Filtered offset from master, servo input */
+  TimeScaled    one_way_delay_scaled;      /**< Filtered one way delay */
+  TimeScaled    master_to_slave_scaled;    /**< Last master to slave delay */
   TimeInternal  mean_path_delay;        /* V2 */
   
   /* Parent data set */
@@ -450,6 +658,8 @@ typedef struct {
   Boolean       parent_stats;                  /* V1 & V2 */
   Integer16     observed_v1_variance;
   Integer32     observed_drift;                /* V1 & V2 observedParentClockPhaseChangeRate */
+  Integer32     published_drift;               /**< observed_drift as published by the servo to the port (atomic) */
+  Integer64     observed_drift_scaled;         /**< Servo I accumulator in ppb * 2^16 (observed_drift is its integer part) */
   Boolean       utc_reasonable;
   UInteger8     grandmaster_communication_technology;
   Octet         grandmaster_uuid_field[PTP_UUID_LENGTH];
@@ -551,11 +761,15 @@ typedef struct {
 
   /** Input buffer pointer to payload area of buffers (to allow adding MAC header) */
   Octet * msgIbuf;
+  MsgView msgView;  /**< View of msgIbuf for the message being handled */
+  Boolean msgIsTxStamp;  /**< msgIbuf is a sent message from the error queue */
 
   /* Actual storage for characters */
   
   Octet outputBuffer[(PACKET_SIZE+16)];  /**< Output buffer array: Packet size plus size for MAC header */
   Octet inputBuffer[(PACKET_SIZE+16)];   /**< Output buffer array: Packet size plus size for MAC header */
+
+  NetRxRing rxRing;                      /**< Batched receive ring for event and general messages */
   
   TimeInternal  master_to_slave_delay;
   TimeInternal  slave_to_master_delay;
@@ -573,20 +787,20 @@ typedef struct {
   TimeInternal  t3_pdelay_resp_tx_time; /**< Time from responder, reported in PDELAY RESP FOLLOWUP */
   TimeInternal  t4_pdelay_resp_rx_time; /**< Time at requestor */
 
-  /** Receive Sync correction time in Internal time for V2 calculations */
-  TimeInternal  sync_correction;
+  /** Receive Sync correction field (nanoseconds * 2^16) for V2 calculations */
+  TimeScaled    sync_correction;
 
-  /** Receive Follow up correction time in Internal time for V2 calculations */
-  TimeInternal  followup_correction;
+  /** Receive Follow up correction field (nanoseconds * 2^16) for V2 calculations */
+  TimeScaled    followup_correction;
 
-  /** Receive Delay Response correction time in Internal time for V2 calculations */
-  TimeInternal  delay_resp_correction;
+  /** Receive Delay Response correction field (nanoseconds * 2^16) for V2 calculations */
+  TimeScaled    delay_resp_correction;
 
-  /** Receive PDelay Response correction time in Internal time for V2 calculations */
-  TimeInternal  pdelay_resp_correction;
+  /** Receive PDelay Response correction field (nanoseconds * 2^16) for V2 calculations */
+  TimeScaled    pdelay_resp_correction;
 
-  /** Receive PDelay Follow Up correction time in Internal time for V2 calculations */
-  TimeInternal  pdelay_followup_correction;
+  /** Receive PDelay Follow Up correction field (nanoseconds * 2^16) for V2 calculations */
+  TimeScaled    pdelay_followup_correction;
 
   // AKB: For new filter to set initial time based on delta time calculations
   TimeInternal  t1_sync_delta_time;  /**< time between transmitted sync messages */
@@ -612,6 +826,19 @@ typedef struct {
   
   offset_from_master_filter  ofm_filt;
   one_way_delay_filter       owd_filt;
+  delay_window               owd_window;  /**< Windowed one way delay filter (-W) */
+
+  TimeNs        pi_last_t;            /**< Sync receive time of the PI servo's previous Sync, 0 after a reset */
+  linreg_servo  linreg;               /**< Linear regression servo state */
+  kalman_servo  kalman;               /**< Kalman filter servo state */
+  holdover_servo holdover;            /**< Frequency history and holdover state */
+  servo_supervisor supervisor;        /**< Lock state and gains of the servo */
+  servo_state   warm_start;           /**< State file read at startup */
+  servo_state   state_save;           /**< State for servoWriteState() to save */
+  Boolean       state_save_pending;   /**< state_save is waiting to be written (atomic) */
+
+  MeasureQueue  measure_queue;        /**< Measurements waiting for the servo */
+  Measurement   last_sync;            /**< Last Sync measurement run through the servo */
   
   Boolean message_activity;
   
@@ -651,13 +878,22 @@ typedef struct
   Integer16     currentUtcOffset;
   UInteger16    epochNumber;
   Octet         ifaceName[IFACE_NAME_LENGTH];
+  UInteger16    numberPorts;          /**< Number of PTP ports, one per interface given with -b */
+  Octet       (*portIfaceName)[IFACE_NAME_LENGTH]; /**< Interface of each port, NULL if not bound */
+  Octet         clockName[CLOCK_NAME_LENGTH];  /**< Clock to discipline: system, realtime or /dev/ptpN */
   Boolean       noResetClock;
   Boolean       noAdjust;
   Boolean       displayStats;
   Boolean       csvStats;
   Octet         unicastAddress[NET_ADDRESS_LENGTH];
   Integer16     ap, ai;               /**< P/I Filter values */
+  Boolean       fixedGains;           /**< Keep ap, ai in every lock state */
   Integer16     s;                    /**< Filter "stiffness" */
+  UInteger8     servo;                /**< Clock servo, SERVO_PI, SERVO_LINREG or SERVO_KALMAN */
+  UInteger16    servoWindow;          /**< Samples in the linear regression window */
+  UInteger16    delayWindow;          /**< Exchanges in the one way delay window, 0 for the low pass filter */
+  UInteger16    delayRejectMads;      /**< Delay outlier threshold in median absolute deviations */
+  const char   *stateFile;            /**< Servo state file (-j), NULL for none */
   TimeInternal  inboundLatency, outboundLatency;
   Integer16     max_foreign_records;
   Boolean       slaveOnly;
@@ -672,6 +908,9 @@ typedef struct
   Integer32     baseAdjustValue;      /**< AKB: Added to support setting/calc of base value */
   Boolean       rememberAdjustValue;  /**< AKB: Added to support Slave remembering masters clock */
   Integer8      announceInterval;     /**< AKB: Added to support V2 announce message transmit timer */
+  Boolean       portThreads;          /**< Run each port and the servo in its own thread */
+  Integer16    *threadCpu;            /**< CPU of each port thread then the servo thread, -1 not pinned */
+  UInteger16    numberThreadCpus;     /**< Number of entries at threadCpu */
 
   Boolean       nonDaemon;            /**< AKB: Added to split parser from startup function */
                                       /**< nonDaemon (TRUE == command mode (non-daemon)
@@ -137,6 +137,11 @@
 // Disable warnings about reopen function:
 #define _CRT_SECURE_NO_WARNINGS
 
+// Visual C only knows inline functions as __inline
+#ifndef __cplusplus
+#define inline __inline
+#endif
+
 #endif /* __WINDOWS__*/
 
 #if defined(__NetBSD__) || defined(__FreeBSD__)
@@ -175,6 +180,16 @@
 #define ADJ_FREQ_MAX  512000
 #endif
 
+/* Clock backends, selected at run time (see clockInit in sys.c) */
+#define CLOCK_BACKEND_SYSTEM  0  // gettimeofday/settimeofday/adjtimex
+#define CLOCK_BACKEND_POSIX   1  // POSIX clock (CLOCK_REALTIME) via clock_adjtime
+#define CLOCK_BACKEND_PHC     2  // PTP hardware clock (/dev/ptpN) via clock_adjtime
+
+#define CLOCK_NAME_LENGTH     64
+
+/* Clock ID of a POSIX dynamic clock (e.g. /dev/ptpN) open on fd */
+#define FD_TO_CLOCKID(fd)     ((~(clockid_t)(fd) << 3) | 3)
+
 #define DEFAULT_UTC_OFFSET           33 /* V2: TAI = UTC plus 33 seconds as of 1/1/2006 */
 
 #ifdef __WINDOWS__
@@ -198,8 +213,6 @@
 #define INITIALIZABLE      TRUE
 #define BURST_ENABLED      FALSE
 #define EXTERNAL_TIMING    FALSE
-#define BOUNDARY_CLOCK     FALSE
-#define NUMBER_PORTS       1
 
 
 #elif defined CONFIG_MPC831X
@@ -226,8 +239,6 @@
 #define INITIALIZABLE      TRUE
 #define BURST_ENABLED      FALSE
 #define EXTERNAL_TIMING    FALSE
-#define BOUNDARY_CLOCK     FALSE
-#define NUMBER_PORTS       1
 
 #else
 
@@ -251,8 +262,6 @@
 #define INITIALIZABLE      TRUE
 #define BURST_ENABLED      FALSE
 #define EXTERNAL_TIMING    FALSE
-#define BOUNDARY_CLOCK     FALSE
-#define NUMBER_PORTS       1
 
 #endif
 
@@ -264,6 +273,94 @@
 
 #define PACKET_SIZE  384  // AKB: Big enough for all packets and nice round binary number
 
+/* Receive socket readiness flags, reported in NetPath readySockets by
+ * netSelect() and netSelectAll() so handle() only reads the socket that
+ * actually has a message waiting
+ */
+#define NET_EVENT_SOCK_READY    0x01
+#define NET_GENERAL_SOCK_READY  0x02
+#define NET_RAW_SOCK_READY      0x04
+#define NET_TX_STAMP_READY      0x08  // Event socket error queue holds transmit time stamps
+
+#define NET_EPOLL_MAX_EVENTS    16  // Max readiness events collected per epoll_wait() call
+#define NET_RX_BATCH            16  // Max datagrams drained per batched receive (recvmmsg) call
+
+/* Ancillary data space for one received message (receive time stamp,
+ * largest is SCM_TIMESTAMPING with software, legacy and hardware stamps)
+ */
+#define NET_RX_CONTROL_SIZE     CMSG_SPACE(3*sizeof(struct timespec))
+
+/* Transmit time stamps from the error queue also carry the extended
+ * error (plus offender address) identifying them as time stamps
+ */
+#define NET_TX_CONTROL_SIZE     (NET_RX_CONTROL_SIZE + CMSG_SPACE(64))
+
+/* Room for the link, IP and UDP headers the error queue returns in
+ * front of the looped back PTP message
+ */
+#define NET_TX_HEADER_SPACE     64
+
+/* Measurements queued from the protocol engine to the servo */
+#define CACHE_LINE_SIZE         64
+#define MEASURE_QUEUE_SIZE      64  // Measurements queued per port, must be a power of 2
+#define MEASURE_SYNC            1   // Sync (and Follow_Up) t1, t2: update offset and run the servo
+#define MEASURE_DELAY           2   // Delay_Req/Delay_Resp t3, t4: update one way delay
+#define MEASURE_PDELAY          3   // PDelay t1 to t4: update peer path delay
+#define MEASURE_RESET           4   // Servo (re)started, clear it and level the clock
+#define MEASURE_CLEAR           5   // Clear the port's filters only
+#define MEASURE_HOLDOVER        6   // No master, update the holdover frequency
+#define MEASURE_CURRENT         7   // m1: clear the port's offset and one way delay
+#define MEASURE_STATS           8   // Port changed state, display the statistics
+
+/* Clock servos (-S option) */
+#define SERVO_PI                0   // PI controller (default)
+#define SERVO_LINREG            1   // Least squares fit over a sliding window
+#define SERVO_KALMAN            2   // Two state (phase, frequency) Kalman filter
+#define LINREG_WINDOW_MAX       64  // Most samples in the linear regression window
+#define LINREG_WINDOW_DEFAULT   16
+#define LINREG_MIN_SAMPLES      4   // Samples needed before the fit is used
+#define KALMAN_Q_PHASE          1.0     // White frequency noise (ns^2/s)
+#define KALMAN_Q_FREQ           0.001   // Least frequency random walk (ppb^2/s)
+#define KALMAN_R_INITIAL        1.0e6   // Measurement noise until estimated (ns^2)
+#define KALMAN_R_MIN            1.0     // Lower bound of the measurement noise (ns^2)
+#define KALMAN_P_FREQ           1.0e6   // Initial frequency variance (ppb^2)
+#define KALMAN_R_WEIGHT         16      // Measurements averaged into the measurement noise
+#define KALMAN_Q_WEIGHT         64      // Measurements averaged into the frequency wander
+#define KALMAN_WARMUP           256     // Measurements before the wander is estimated
+
+/* Servo supervisor: lock states and their gains */
+#define SERVO_UNLOCKED          0   // Reset or stepped: widest loop
+#define SERVO_ACQUIRING         1   // Loop SERVO_GAIN_STEP times wider than locked
+#define SERVO_LOCKED            2   // -a attenuations
+#define SERVO_HOLDOVER          3   // No master
+#define SERVO_GAIN_STEP         2   // Loop bandwidth ratio between states, same damping
+#define SERVO_RMS_WINDOW        16  // Syncs in the offset RMS window, and least Syncs in a state
+#define SERVO_ACQUIRE_NS        20000   // RMS offset to leave unlocked (ns), plus the noise term
+#define SERVO_LOCK_NS           100     // RMS offset to lock (ns), plus the noise term
+#define SERVO_NOISE_RATIO       2       // Measurement noise times this is added to the thresholds
+#define SERVO_HYSTERESIS        4   // Times the threshold to fall back a state
+#define SERVO_INTERVAL_MAX      64  // Longest time between Syncs integrated by the PI servo (s)
+#define SERVO_AP_INTERVALS      2   // Least P attenuation, in Sync intervals
+
+/* Windowed one way delay filter (-W option) */
+#define DELAY_WINDOW_MAX        64  // Most exchanges in the delay window, must be a power of 2
+#define DELAY_WINDOW_MIN_SAMPLES 4  // Samples needed before outliers are rejected
+#define DELAY_REJECT_MADS       4   // Default rejection threshold, in median absolute deviations
+#define DELAY_MAD_MIN           (50LL << 16)  // Least MAD used for rejection (ns * 2^16)
+
+/* Holdover (no master available) */
+#define HOLDOVER_HISTORY        64      // Frequency intervals kept, about 17 minutes
+#define HOLDOVER_INTERVAL       16      // Seconds averaged per interval, and holdover update period
+#define HOLDOVER_MIN_SAMPLES    2       // Intervals needed to hold over
+#define HOLDOVER_MIN_TREND      8       // Intervals needed to extrapolate a frequency trend
+#define HOLDOVER_LOCK_NS        10000   // Largest offset from master sampled into the history
+
+/* Servo state file (-j option) */
+#define STATE_FILE_MAGIC        "ptpv2d-servo-state"
+#define STATE_FILE_VERSION      1
+#define STATE_SAVE_INTERVALS    4       // Holdover intervals between saves, about a minute
+#define STATE_MAX_AGE           3600    // Oldest state used for a warm start (s)
+
 #define PTP_EVENT_PORT    319  // 0x013F
 #define PTP_GENERAL_PORT  320  // 0x0140
 
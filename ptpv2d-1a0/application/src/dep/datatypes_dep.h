@@ -165,16 +165,20 @@ typedef unsigned short       Enumeration16;/**< Local definition of 16 bit enume
 typedef unsigned int         Enumeration32;/**< Local definition of 32 bit enumerated value */
 typedef unsigned long long   Enumeration64;/**< Local definition of 64 bit enumerated value */
 
+/* Filter values are in scaled nanoseconds (nanoseconds * 2^16) so
+ * sub-nanosecond corrections reach the servo
+ */
 typedef struct 
 {
-  Integer32  nsec_prev;
-  Integer32  y;
+  Integer64  scaled_prev;
+  Integer64  y;
+  Boolean    prev_valid;
 } offset_from_master_filter;
 
 typedef struct 
 {
-  Integer32  nsec_prev;
-  Integer32  y;
+  Integer64  scaled_prev;
+  Integer64  y;
   Integer32  s_exp;
 } one_way_delay_filter;
 
@@ -193,6 +197,9 @@ typedef struct
   unsigned char portMacAddress[6];      /**< Local Hardware Port MAC address */
   unsigned char rawDestAddress[6];      /**< Destination MAC Address for raw socket messages */
   unsigned char rawDestPDelayAddress[6];/**< Destination MAC Address for raw socket PDelay messages */
+  UInteger16    portIndex;              /**< Index of the PTP port owning this path (port_id - 1) */
+  UInteger8     readySockets;           /**< NET_xxx_SOCK_READY flags set by netSelect()/netSelectAll() */
+  Boolean       txStamps;               /**< Transmit time stamps come from the event socket error queue */
 } NetPath;
 
 #endif
@@ -160,9 +160,454 @@ void debug_dump_ptp_v2_port_identity_field (void * buf)
 
 #endif
 
+/* Message layouts
+ *
+ * Every V1 and V2 message layout handled here is declared once below as
+ * an ordered list of wire fields:
+ *
+ *   X(L, wire name, structure member, codec)
+ *
+ * From each list MSG_LAYOUT() generates a wire structure of byte arrays
+ * (so offsetof() gives each field's offset and sizeof() the message
+ * length), a straight-line msgDecode<L>() routine, a msgPut<L>_<field>()
+ * routine per field and a msgClear<L>() routine zeroing the reserved
+ * fields. The packers write each field straight from the clock data
+ * into the buffer, without staging the body in its message structure.
+ * Body layouts start with their header's wire structure so the offsets
+ * are absolute within the message. The *_LENGTH constants are checked
+ * against the generated structures at compile time.
+ *
+ * Codecs move big-endian values through memcpy(), so unaligned fields need
+ * no special handling. RESn fields are reserved or padding: they are written
+ * as zero and never read. I8W16 is a V1 Integer8 carried in a 16 bit
+ * field: it is sign-extended on encode and only the low byte is decoded.
+ */
+#define MSG_SIZE_U8       1
+#define MSG_SIZE_U16      2
+#define MSG_SIZE_I16      2
+#define MSG_SIZE_I8W16    2
+#define MSG_SIZE_U32      4
+#define MSG_SIZE_I32      4
+#define MSG_SIZE_I64      8
+#define MSG_SIZE_OCT2     2
+#define MSG_SIZE_OCT4     4
+#define MSG_SIZE_OCT6     6
+#define MSG_SIZE_OCT8     8
+#define MSG_SIZE_OCT16    16
+#define MSG_SIZE_TS       8   /* V1 TimeRepresentation */
+#define MSG_SIZE_V2TS     10  /* V2TimeRepresentation */
+#define MSG_SIZE_PORTID   10  /* PortIdentity */
+#define MSG_SIZE_RES1     1
+#define MSG_SIZE_RES2     2
+#define MSG_SIZE_RES3     3
+#define MSG_SIZE_RES4     4
+#define MSG_SIZE_RES10    10
+
+static inline UInteger16 msgGetBE16(const UInteger8 *p)
+{
+  UInteger16 x;
+
+  memcpy(&x, p, 2);
+  return flip16(x);
+}
+
+static inline UInteger32 msgGetBE32(const UInteger8 *p)
+{
+  UInteger32 x;
+
+  memcpy(&x, p, 4);
+  return flip32(x);
+}
+
+static inline void msgPutBE16(UInteger8 *p, UInteger16 v)
+{
+  v = flip16(v);
+  memcpy(p, &v, 2);
+}
+
+static inline void msgPutBE32(UInteger8 *p, UInteger32 v)
+{
+  v = flip32(v);
+  memcpy(p, &v, 4);
+}
+
+#define MSG_DEC_U8(p,v)     ((v) = (p)[0])
+#define MSG_DEC_U16(p,v)    ((v) = msgGetBE16(p))
+#define MSG_DEC_I16(p,v)    ((v) = (Integer16)msgGetBE16(p))
+#define MSG_DEC_I8W16(p,v)  ((v) = (Integer8)(p)[1])
+#define MSG_DEC_U32(p,v)    ((v) = msgGetBE32(p))
+#define MSG_DEC_I32(p,v)    ((v) = (Integer32)msgGetBE32(p))
+#define MSG_DEC_I64(p,v)    ((v) = (Integer64)(((UInteger64)msgGetBE32(p) << 32) \
+                                               | msgGetBE32((p) + 4)))
+#define MSG_DEC_OCT2(p,v)   memcpy((v), (p), 2)
+#define MSG_DEC_OCT4(p,v)   memcpy((v), (p), 4)
+#define MSG_DEC_OCT6(p,v)   memcpy((v), (p), 6)
+#define MSG_DEC_OCT8(p,v)   memcpy((v), (p), 8)
+#define MSG_DEC_OCT16(p,v)  memcpy((v), (p), 16)
+#define MSG_DEC_TS(p,v)     (MSG_DEC_U32((p), (v).seconds), \
+                             MSG_DEC_I32((p) + 4, (v).nanoseconds))
+#define MSG_DEC_V2TS(p,v)   (MSG_DEC_U16((p), (v).epoch_number), \
+                             MSG_DEC_U32((p) + 2, (v).seconds), \
+                             MSG_DEC_I32((p) + 6, (v).nanoseconds))
+#define MSG_DEC_PORTID(p,v) (MSG_DEC_OCT8((p), (v).clockIdentity), \
+                             MSG_DEC_U16((p) + 8, (v).portNumber))
+#define MSG_DEC_RES1(p,v)   ((void)0)
+#define MSG_DEC_RES2(p,v)   ((void)0)
+#define MSG_DEC_RES3(p,v)   ((void)0)
+#define MSG_DEC_RES4(p,v)   ((void)0)
+#define MSG_DEC_RES10(p,v)  ((void)0)
+
+#define MSG_ENC_U8(p,v)     ((p)[0] = (UInteger8)(v))
+#define MSG_ENC_U16(p,v)    msgPutBE16((p), (v))
+#define MSG_ENC_I16(p,v)    msgPutBE16((p), (Integer16)(v))
+#define MSG_ENC_I8W16(p,v)  msgPutBE16((p), (Integer16)(v))
+#define MSG_ENC_U32(p,v)    msgPutBE32((p), (v))
+#define MSG_ENC_I32(p,v)    msgPutBE32((p), (v))
+#define MSG_ENC_I64(p,v)    (msgPutBE32((p), (UInteger64)(v) >> 32), \
+                             msgPutBE32((p) + 4, (v)))
+#define MSG_ENC_OCT2(p,v)   memcpy((p), (v), 2)
+#define MSG_ENC_OCT4(p,v)   memcpy((p), (v), 4)
+#define MSG_ENC_OCT6(p,v)   memcpy((p), (v), 6)
+#define MSG_ENC_OCT8(p,v)   memcpy((p), (v), 8)
+#define MSG_ENC_OCT16(p,v)  memcpy((p), (v), 16)
+#define MSG_ENC_TS(p,v)     (MSG_ENC_U32((p), (v).seconds), \
+                             MSG_ENC_I32((p) + 4, (v).nanoseconds))
+#define MSG_ENC_V2TS(p,v)   (MSG_ENC_U16((p), (v).epoch_number), \
+                             MSG_ENC_U32((p) + 2, (v).seconds), \
+                             MSG_ENC_I32((p) + 6, (v).nanoseconds))
+#define MSG_ENC_PORTID(p,v) (MSG_ENC_OCT8((p), (v).clockIdentity), \
+                             MSG_ENC_U16((p) + 8, (v).portNumber))
+#define MSG_ENC_RES1(p,v)   memset((p), 0, 1)
+#define MSG_ENC_RES2(p,v)   memset((p), 0, 2)
+#define MSG_ENC_RES3(p,v)   memset((p), 0, 3)
+#define MSG_ENC_RES4(p,v)   memset((p), 0, 4)
+#define MSG_ENC_RES10(p,v)  memset((p), 0, 10)
+
+/* Kind of each codec: a VALUE has a msgPut routine, a RES field is
+ * zeroed by msgClear
+ */
+#define MSG_KIND_U8       VALUE
+#define MSG_KIND_U16      VALUE
+#define MSG_KIND_I16      VALUE
+#define MSG_KIND_I8W16    VALUE
+#define MSG_KIND_U32      VALUE
+#define MSG_KIND_I32      VALUE
+#define MSG_KIND_I64      VALUE
+#define MSG_KIND_OCT2     VALUE
+#define MSG_KIND_OCT4     VALUE
+#define MSG_KIND_OCT6     VALUE
+#define MSG_KIND_OCT8     VALUE
+#define MSG_KIND_OCT16    VALUE
+#define MSG_KIND_TS       VALUE
+#define MSG_KIND_V2TS     VALUE
+#define MSG_KIND_PORTID   VALUE
+#define MSG_KIND_RES1     RES
+#define MSG_KIND_RES2     RES
+#define MSG_KIND_RES3     RES
+#define MSG_KIND_RES4     RES
+#define MSG_KIND_RES10    RES
+
+/* Value parameter of the msgPut routine of each VALUE codec, the same
+ * type as the structure members the decoder fills
+ */
+#define MSG_TYPE_U8       UInteger8
+#define MSG_TYPE_U16      UInteger16
+#define MSG_TYPE_I16      Integer16
+#define MSG_TYPE_I8W16    Integer8
+#define MSG_TYPE_U32      UInteger32
+#define MSG_TYPE_I32      Integer32
+#define MSG_TYPE_I64      Integer64
+#define MSG_TYPE_OCT2     const void *
+#define MSG_TYPE_OCT4     const void *
+#define MSG_TYPE_OCT6     const void *
+#define MSG_TYPE_OCT8     const void *
+#define MSG_TYPE_OCT16    const void *
+#define MSG_TYPE_TS       TimeRepresentation
+#define MSG_TYPE_V2TS     V2TimeRepresentation
+#define MSG_TYPE_PORTID   PortIdentity
+
+/* PTP version 1 common header (MsgHeader) */
+#define V1_HEADER_LAYOUT(X,L)                                          \
+  X(L, versionPTP,                    versionPTP,                    U16)   \
+  X(L, versionNetwork,                versionNetwork,                U16)   \
+  X(L, subdomain,                     subdomain,                     OCT16) \
+  X(L, messageType,                   messageType,                   U8)    \
+  X(L, sourceCommunicationTechnology, sourceCommunicationTechnology, U8)    \
+  X(L, sourceUuid,                    sourceUuid,                    OCT6)  \
+  X(L, sourcePortId,                  sourcePortId,                  U16)   \
+  X(L, sequenceId,                    sequenceId,                    U16)   \
+  X(L, control,                       control,                       U8)    \
+  X(L, reserved1,                     reserved1,                     RES1)  \
+  X(L, flags,                         flags,                         OCT2)  \
+  X(L, reserved2,                     -,                             RES4)
+
+/* PTP version 1 Sync and Delay_Req body (MsgSync) */
+#define V1_SYNC_LAYOUT(X,L)                                                      \
+  X(L, originTimestamp,                originTimestamp,                    TS)    \
+  X(L, epochNumber,                    epochNumber,                        U16)   \
+  X(L, currentUTCOffset,               currentUTCOffset,                   I16)   \
+  X(L, reserved1,                      -,                                  RES1)  \
+  X(L, grandmasterCommTechnology,      grandmasterCommunicationTechnology, U8)    \
+  X(L, grandmasterClockUuid,           grandmasterClockUuid,               OCT6)  \
+  X(L, grandmasterPortId,              grandmasterPortId,                  U16)   \
+  X(L, grandmasterSequenceId,          grandmasterSequenceId,              U16)   \
+  X(L, reserved2,                      -,                                  RES3)  \
+  X(L, grandmasterClockStratum,        grandmasterClockStratum,            U8)    \
+  X(L, grandmasterClockIdentifier,     grandmasterClockIdentifier,         OCT4)  \
+  X(L, reserved3,                      -,                                  RES2)  \
+  X(L, grandmasterClockVariance,       grandmasterClockVariance,           I16)   \
+  X(L, reserved4,                      -,                                  RES1)  \
+  X(L, grandmasterPreferred,           grandmasterPreferred,               U8)    \
+  X(L, reserved5,                      -,                                  RES1)  \
+  X(L, grandmasterIsBoundaryClock,     grandmasterIsBoundaryClock,         U8)    \
+  X(L, reserved6,                      -,                                  RES2)  \
+  X(L, syncInterval,                   syncInterval,                       I8W16) \
+  X(L, reserved7,                      -,                                  RES2)  \
+  X(L, localClockVariance,             localClockVariance,                 I16)   \
+  X(L, reserved8,                      -,                                  RES2)  \
+  X(L, localStepsRemoved,              localStepsRemoved,                  U16)   \
+  X(L, reserved9,                      -,                                  RES3)  \
+  X(L, localClockStratum,              localClockStratum,                  U8)    \
+  X(L, localClockIdentifer,            localClockIdentifer,                OCT4)  \
+  X(L, reserved10,                     -,                                  RES1)  \
+  X(L, parentCommunicationTechnology,  parentCommunicationTechnology,      U8)    \
+  X(L, parentUuid,                     parentUuid,                         OCT6)  \
+  X(L, reserved11,                     -,                                  RES2)  \
+  X(L, parentPortField,                parentPortField,                    U16)   \
+  X(L, reserved12,                     -,                                  RES2)  \
+  X(L, estimatedMasterVariance,        estimatedMasterVariance,            I16)   \
+  X(L, estimatedMasterDrift,           estimatedMasterDrift,               I32)   \
+  X(L, reserved13,                     -,                                  RES3)  \
+  X(L, utcReasonable,                  utcReasonable,                      U8)
+
+/* PTP version 1 Follow_Up body (MsgFollowUp) */
+#define V1_FOLLOWUP_LAYOUT(X,L)                                              \
+  X(L, reserved1,                      -,                                  RES2)  \
+  X(L, associatedSequenceId,           associatedSequenceId,               U16)   \
+  X(L, preciseOriginTimestamp,         preciseOriginTimestamp,             TS)
+
+/* PTP version 1 Delay_Resp body (MsgDelayResp) */
+#define V1_DELAY_RESP_LAYOUT(X,L)                                            \
+  X(L, delayReceiptTimestamp,          delayReceiptTimestamp,              TS)    \
+  X(L, reserved1,                      -,                                  RES1)  \
+  X(L, requestingSourceCommTechnology, requestingSourceCommunicationTechnology, U8) \
+  X(L, requestingSourceUuid,           requestingSourceUuid,               OCT6)  \
+  X(L, requestingSourcePortId,         requestingSourcePortId,             U16)   \
+  X(L, requestingSourceSequenceId,     requestingSourceSequenceId,         U16)
+
+/* PTP version 2 common header (V2MsgHeader) */
+#define V2_HEADER_LAYOUT(X,L)                                                    \
+  X(L, transportSpecificAndMessageType, transportSpecificAndMessageType,   U8)    \
+  X(L, reserved1AndVersionPTP,          reserved1AndVersionPTP,            U8)    \
+  X(L, messageLength,                   messageLength,                     U16)   \
+  X(L, domainNumber,                    domainNumber,                      U8)    \
+  X(L, reserved2,                       reserved2,                         U8)    \
+  X(L, flags,                           flags,                             OCT2)  \
+  X(L, correctionField,                 correctionField,                   I64)   \
+  X(L, reserved3,                       reserved3,                         U32)   \
+  X(L, sourcePortId,                    sourcePortId,                      PORTID)\
+  X(L, sequenceId,                      sequenceId,                        U16)   \
+  X(L, control,                         control,                           U8)    \
+  X(L, logMeanMessageInterval,          logMeanMessageInterval,            U8)
+
+/* PTP version 2 Sync and Delay_Req body (V2MsgSync) */
+#define V2_SYNC_LAYOUT(X,L)                                                      \
+  X(L, originTimestamp,                 originTimestamp,                   V2TS)
+
+/* PTP version 2 Follow_Up body (V2MsgFollowUp) */
+#define V2_FOLLOWUP_LAYOUT(X,L)                                                  \
+  X(L, preciseOriginTimestamp,          preciseOriginTimestamp,            V2TS)
+
+/* PTP version 2 Delay_Resp body (V2MsgDelayResp) */
+#define V2_DELAY_RESP_LAYOUT(X,L)                                                \
+  X(L, receiveTimestamp,                receiveTimestamp,                  V2TS)  \
+  X(L, requestingPortId,                requestingPortId,                  PORTID)
+
+/* PTP version 2 PDelay_Req body (V2MsgPDelayReq) */
+#define V2_PDELAY_REQ_LAYOUT(X,L)                                                \
+  X(L, originTimestamp,                 originTimestamp,                   V2TS)  \
+  X(L, reserved,                        -,                                 RES10)
+
+/* PTP version 2 PDelay_Resp body (V2MsgPDelayResp) */
+#define V2_PDELAY_RESP_LAYOUT(X,L)                                               \
+  X(L, requestReceiptTimestamp,         requestReceiptTimestamp,           V2TS)  \
+  X(L, requestingPortId,                requestingPortId,                  PORTID)
+
+/* PTP version 2 PDelay_Resp_Follow_Up body (V2MsgPDelayRespFollowUp) */
+#define V2_PDELAY_RESP_FOLLOWUP_LAYOUT(X,L)                                      \
+  X(L, responseOriginTimestamp,         responseOriginTimestamp,           V2TS)  \
+  X(L, requestingPortId,                requestingPortId,                  PORTID)
+
+/* PTP version 2 Announce body (MsgAnnounce) */
+#define V2_ANNOUNCE_LAYOUT(X,L)                                                  \
+  X(L, originTimestamp,                 originTimestamp,                   V2TS)  \
+  X(L, currentUTCOffset,                currentUTCOffset,                  I16)   \
+  X(L, reserved,                        reserved,                          U8)    \
+  X(L, grandmasterPriority1,            grandmasterPriority1,              U8)    \
+  X(L, clockClass,                      grandmasterClockQuality.clockClass, U8)   \
+  X(L, clockAccuracy,                   grandmasterClockQuality.clockAccuracy, U8) \
+  X(L, offsetScaledLogVariance,         grandmasterClockQuality.offsetScaledLogVariance, U16) \
+  X(L, grandmasterPriority2,            grandmasterPriority2,              U8)    \
+  X(L, grandmasterIdentity,             grandmasterIdentity,               OCT8)  \
+  X(L, stepsRemoved,                    stepsRemoved,                      U16)   \
+  X(L, timeSource,                      timeSource,                        U8)
+
+#define MSG_WIRE_FIELD(L,wire,member,codec) UInteger8 wire[MSG_SIZE_##codec];
+#define MSG_DECODE_FIELD(L,wire,member,codec) \
+  MSG_DEC_##codec(p + offsetof(struct L##Wire, wire), msg->member);
+#define MSG_CAT(a,b)  MSG_CAT_(a,b)
+#define MSG_CAT_(a,b) a##b
+#define MSG_PUT_FIELD(L,wire,member,codec) \
+  MSG_CAT(MSG_PUT_, MSG_KIND_##codec)(L, wire, codec)
+#define MSG_PUT_VALUE(L,wire,codec)                                        \
+  static inline void msgPut##L##_##wire(void *buf, MSG_TYPE_##codec v)     \
+  {                                                                        \
+    MSG_ENC_##codec((UInteger8*)buf + offsetof(struct L##Wire, wire), v);  \
+  }
+#define MSG_PUT_RES(L,wire,codec)
+#define MSG_CLEAR_FIELD(L,wire,member,codec) \
+  MSG_CAT(MSG_CLEAR_, MSG_KIND_##codec)(L, wire, codec)
+#define MSG_CLEAR_VALUE(L,wire,codec)
+#define MSG_CLEAR_RES(L,wire,codec) \
+  MSG_ENC_##codec(p + offsetof(struct L##Wire, wire), 0);
+
+/** Generate the wire structure and codec routines for one layout */
+#define MSG_LAYOUT(L, Type, Base, LAYOUT)                                  \
+  struct L##Wire { Base LAYOUT(MSG_WIRE_FIELD, L) };                       \
+  static inline void msgDecode##L(const void *buf, Type *msg)              \
+  {                                                                        \
+    const UInteger8 *p = (const UInteger8*)buf;                            \
+    LAYOUT(MSG_DECODE_FIELD, L)                                            \
+  }                                                                        \
+  LAYOUT(MSG_PUT_FIELD, L)                                                 \
+  static inline void msgClear##L(void *buf)                                \
+  {                                                                        \
+    UInteger8 *p = (UInteger8*)buf;                                        \
+    (void)p;                                                               \
+    LAYOUT(MSG_CLEAR_FIELD, L)                                             \
+  }
+
+/** Compile time check of a generated layout against its length constant */
+#define MSG_LAYOUT_LENGTH(L, length) \
+  typedef char L##LengthCheck[(sizeof(struct L##Wire) == (length)) ? 1 : -1]
+
+MSG_LAYOUT(V1Header,              MsgHeader,               , V1_HEADER_LAYOUT)
+MSG_LAYOUT(V1Sync,                MsgSync,                 struct V1HeaderWire header;, V1_SYNC_LAYOUT)
+MSG_LAYOUT(V1FollowUp,            MsgFollowUp,             struct V1HeaderWire header;, V1_FOLLOWUP_LAYOUT)
+MSG_LAYOUT(V1DelayResp,           MsgDelayResp,            struct V1HeaderWire header;, V1_DELAY_RESP_LAYOUT)
+MSG_LAYOUT(V2Header,              V2MsgHeader,             , V2_HEADER_LAYOUT)
+MSG_LAYOUT(V2Sync,                V2MsgSync,               struct V2HeaderWire header;, V2_SYNC_LAYOUT)
+MSG_LAYOUT(V2FollowUp,            V2MsgFollowUp,           struct V2HeaderWire header;, V2_FOLLOWUP_LAYOUT)
+MSG_LAYOUT(V2DelayResp,           V2MsgDelayResp,          struct V2HeaderWire header;, V2_DELAY_RESP_LAYOUT)
+MSG_LAYOUT(V2PDelayReq,           V2MsgPDelayReq,          struct V2HeaderWire header;, V2_PDELAY_REQ_LAYOUT)
+MSG_LAYOUT(V2PDelayResp,          V2MsgPDelayResp,         struct V2HeaderWire header;, V2_PDELAY_RESP_LAYOUT)
+MSG_LAYOUT(V2PDelayRespFollowUp,  V2MsgPDelayRespFollowUp, struct V2HeaderWire header;, V2_PDELAY_RESP_FOLLOWUP_LAYOUT)
+MSG_LAYOUT(V2Announce,            MsgAnnounce,             struct V2HeaderWire header;, V2_ANNOUNCE_LAYOUT)
+
+MSG_LAYOUT_LENGTH(V1Header,             HEADER_LENGTH);
+MSG_LAYOUT_LENGTH(V1Sync,               SYNC_PACKET_LENGTH);
+MSG_LAYOUT_LENGTH(V1FollowUp,           FOLLOW_UP_PACKET_LENGTH);
+MSG_LAYOUT_LENGTH(V1DelayResp,          DELAY_RESP_PACKET_LENGTH);
+MSG_LAYOUT_LENGTH(V2Sync,               V2_SYNC_LENGTH);
+MSG_LAYOUT_LENGTH(V2FollowUp,           V2_FOLLOWUP_LENGTH);
+MSG_LAYOUT_LENGTH(V2DelayResp,          V2_DELAY_RESP_LENGTH);
+MSG_LAYOUT_LENGTH(V2PDelayReq,          V2_PDELAY_REQ_LENGTH);
+MSG_LAYOUT_LENGTH(V2PDelayResp,         V2_PDELAY_RESP_LENGTH);
+MSG_LAYOUT_LENGTH(V2PDelayRespFollowUp, V2_PDELAY_RESP_FOLLOWUP_LENGTH);
+MSG_LAYOUT_LENGTH(V2Announce,           V2_ANNOUNCE_LENGTH);
+
+/** Return the number of bytes the parsers read for a message type,
+ *  0 if the type is not handled
+ */
+static ssize_t msgParsedLength(UInteger8 version, UInteger8 type)
+{
+  if(version == 1)
+  {
+    switch(type)
+    {
+      case PTP_SYNC_MESSAGE:
+      case PTP_DELAY_REQ_MESSAGE:  return sizeof(struct V1SyncWire);
+      case PTP_FOLLOWUP_MESSAGE:   return sizeof(struct V1FollowUpWire);
+      case PTP_DELAY_RESP_MESSAGE: return sizeof(struct V1DelayRespWire);
+      /* Fixed part up to parameterLength, handleManagement() clears
+       * the tail the key dependent payload parsers read from
+       */
+      case PTP_MANAGEMENT_MESSAGE: return HEADER_LENGTH + 20;
+      default:                     return sizeof(struct V1HeaderWire);
+    }
+  }
+
+  switch(type)
+  {
+    case V2_SYNC_MESSAGE:
+    case V2_DELAY_REQ_MESSAGE:            return sizeof(struct V2SyncWire);
+    case V2_FOLLOWUP_MESSAGE:             return sizeof(struct V2FollowUpWire);
+    case V2_DELAY_RESP_MESSAGE:           return sizeof(struct V2DelayRespWire);
+    case V2_PDELAY_REQ_MESSAGE:           return sizeof(struct V2PDelayReqWire);
+    case V2_PDELAY_RESP_MESSAGE:          return sizeof(struct V2PDelayRespWire);
+    case V2_PDELAY_RESP_FOLLOWUP_MESSAGE: return sizeof(struct V2PDelayRespFollowUpWire);
+    case V2_ANNOUNCE_MESSAGE:             return sizeof(struct V2AnnounceWire);
+    default:                              return sizeof(struct V2HeaderWire);
+  }
+}
+
+/** Check that a received message covers every byte its parsers read.
+ *  The receive buffers are not cleared between messages, so anything
+ *  past length is stale data from an earlier packet.
+ */
 Boolean msgPeek(void *buf, ssize_t length)
 {
-  /* not implemented, just return TRUE */
+  UInteger8 *p = (UInteger8*)buf;
+  UInteger8  version;
+  UInteger8  type;
+  ssize_t    needed;
+
+  if(length < 2)
+  {
+    DBG("msgPeek: runt message, length %d\n", (int)length);
+    return FALSE;
+  }
+
+  version = msgGetPtpVersion(buf);
+  if(version == 1)
+  {
+    if(length < HEADER_LENGTH)
+    {
+      DBG("msgPeek: V1 message shorter than header, length %d\n", (int)length);
+      return FALSE;
+    }
+    type = p[offsetof(struct V1HeaderWire, control)];
+  }
+  else if(version == 2)
+  {
+    if(length < (ssize_t)sizeof(struct V2HeaderWire))
+    {
+      DBG("msgPeek: V2 message shorter than header, length %d\n", (int)length);
+      return FALSE;
+    }
+    if(msgGetBE16(p + offsetof(struct V2HeaderWire, messageLength)) > length)
+    {
+      DBG("msgPeek: V2 message truncated, messageLength %u length %d\n",
+          msgGetBE16(p + offsetof(struct V2HeaderWire, messageLength)), (int)length
+         );
+      return FALSE;
+    }
+    type = p[offsetof(struct V2HeaderWire, transportSpecificAndMessageType)] & 0x0F;
+  }
+  else
+  {
+    /* Unknown versions are reported and ignored by the caller */
+    return TRUE;
+  }
+
+  needed = msgParsedLength(version, type);
+  if(length < needed)
+  {
+    DBG("msgPeek: V%u type %u message too short, length %d need %d\n",
+        version, type, (int)length, (int)needed
+       );
+    return FALSE;
+  }
   return TRUE;
 }
 
@@ -175,16 +620,7 @@ void msgUnpackHeader(void *buf, MsgHeader *header)
 {
   DBGM("msgUnpackHeader:\n");
 
-  header->versionPTP                     = flip16(*(UInteger16*)(((UInteger8*)buf) + 0));
-  header->versionNetwork                 = flip16(*(UInteger16*)(((UInteger8*)buf) + 2));
-  memcpy(header->subdomain,                                     (((UInteger8*)buf) + 4), 16);
-  header->messageType                    =        *(UInteger8*) (((UInteger8*)buf) + 20);
-  header->sourceCommunicationTechnology  =        *(UInteger8*) (((UInteger8*)buf) + 21);
-  memcpy(header->sourceUuid,                                    (((UInteger8*)buf) + 22), 6);
-  header->sourcePortId                   = flip16(*(UInteger16*)(((UInteger8*)buf) + 28));
-  header->sequenceId                     = flip16(*(UInteger16*)(((UInteger8*)buf) + 30));
-  header->control                        =        *(UInteger8*) (((UInteger8*)buf) + 32);
-  memcpy(header->flags,                                         (((UInteger8*)buf) + 34), 2);
+  msgDecodeV1Header(buf, header);
 
   DBGM(" versionPTP.................... %u\n", header->versionPTP);
   DBGM(" versionNetwork................ %u\n", header->versionNetwork);
@@ -206,30 +642,12 @@ void msgUnpackHeader(void *buf, MsgHeader *header)
 
 void msgUnpackV2Header(void *buf, V2MsgHeader *header)
 {
-UInteger64 temp64BitInteger;
-
   DBGM("msgUnpackV2Header:\n");
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
 #endif
 
-  header->transportSpecificAndMessageType = *(UInteger8*)        (((UInteger8*)buf) + 0);
-  header->reserved1AndVersionPTP          = *(UInteger8*)        (((UInteger8*)buf) + 1);
-  header->messageLength                   = flip16(*(UInteger16*)(((UInteger8*)buf) + 2));
-  header->domainNumber                    = *(UInteger8*)        (((UInteger8*)buf) + 4);
-  header->reserved2                       = *(UInteger8*)        (((UInteger8*)buf) + 5);
-  memcpy(header->flags,                                          (((UInteger8*)buf) + 6), 2);
-  temp64BitInteger                        = flip32(*(UInteger32*)(((UInteger8*)buf) + 8));
-  temp64BitInteger = temp64BitInteger << 32 ;
-  header->correctionField                 = flip32(*(UInteger32*)(((UInteger8*)buf) + 12))
-                                          | temp64BitInteger;
-  header->reserved3                       = flip32(*(UInteger32*)(((UInteger8*)buf) + 16));
-
-  memcpy(header->sourcePortId.clockIdentity,                     (((UInteger8*)buf) + 20), 8);
-  header->sourcePortId.portNumber         = flip16(*(UInteger16*)(((UInteger8*)buf) + 28));
-  header->sequenceId                      = flip16(*(UInteger16*)(((UInteger8*)buf) + 30));
-  header->control                         = *(UInteger8*)        (((UInteger8*)buf) + 32);
-  header->logMeanMessageInterval          = *(UInteger8*)        (((UInteger8*)buf) + 33);
+  msgDecodeV2Header(buf, header);
 
   DBGM(" Transport Specific and Type... %02hhx\n",
        header->transportSpecificAndMessageType
@@ -269,9 +687,7 @@ void msgUnpackV2Sync(void *buf, V2MsgSync *sync)
 {
   DBGM("msgUnpackV2Sync:\n");
 
-  sync->originTimestamp.epoch_number = flip16(*(UInteger16*)(((UInteger8*)buf) + 34));
-  sync->originTimestamp.seconds      = flip32(*(UInteger32*)(((UInteger8*)buf) + 36));
-  sync->originTimestamp.nanoseconds  = flip32(*(Integer32*) (((UInteger8*)buf) + 40));
+  msgDecodeV2Sync(buf, sync);
 
   DBGM(" originTimestamp.epoch_number.. %u\n", sync->originTimestamp.epoch_number);
   DBGM(" originTimestamp.seconds....... %u\n", sync->originTimestamp.seconds);
@@ -282,32 +698,7 @@ void msgUnpackAnnounce(void *buf, MsgAnnounce *announce)
 {
   DBGM("msgUnpackAnnounce:\n");
 
-  /* Note for code below: stepsRemoved field is a 16 bit field that is not 16
-   * bit aligned which is why the code gets one byte at a time to avoid
-   * a possible alignment violation in some CPUs
-   */
-
-  announce->originTimestamp.epoch_number   = flip16(*(UInteger16*)(((UInteger8*)buf) + 34));
-  announce->originTimestamp.seconds        = flip32(*(UInteger32*)(((UInteger8*)buf) + 36));
-  announce->originTimestamp.nanoseconds    = flip32(*(Integer32*) (((UInteger8*)buf) + 40));
-  announce->currentUTCOffset               = flip16(*(Integer16*) (((UInteger8*)buf) + 44));
-  announce->reserved                       =        *(UInteger8*) (((UInteger8*)buf) + 46);
-  announce->grandmasterPriority1           =        *(UInteger8*) (((UInteger8*)buf) + 47);
-  announce->grandmasterClockQuality.clockClass    = *(UInteger8*) (((UInteger8*)buf) + 48);
-  announce->grandmasterClockQuality.clockAccuracy = *(UInteger8*) (((UInteger8*)buf) + 49); 
-  announce->grandmasterClockQuality.offsetScaledLogVariance 
-                                           = flip16(*(UInteger16*)(((UInteger8*)buf) + 50));
-  announce->grandmasterPriority2           =        *(UInteger8*) (((UInteger8*)buf) + 52);
-  memcpy(announce->grandmasterIdentity,                           (((UInteger8*)buf) + 53), 8);
-  
-  /* NOTE: stepRemoved is not 16 bit aligned in the message. 
-   * We therfore get it as two single byte reads instead
-   * for CPUs that need alignment to work properly
-   */
-  announce->stepsRemoved         =  ( (UInteger16) (*(UInteger8*) (((UInteger8*)buf) + 61) ) << 8)
-                                 |  ( (UInteger16) (*(UInteger8*) (((UInteger8*)buf) + 62) ) );
-  announce->timeSource                     =        *(UInteger8*) (((UInteger8*)buf) + 63);
-
+  msgDecodeV2Announce(buf, announce);
 
   DBGM(" originTimestamp.epoch_number.. %u\n", announce->originTimestamp.epoch_number);
   DBGM(" originTimestamp.seconds....... %u\n", announce->originTimestamp.seconds);
@@ -338,35 +729,8 @@ void msgUnpackAnnounce(void *buf, MsgAnnounce *announce)
 void msgUnpackSync(void *buf, MsgSync *sync)
 {
   DBGM("msgUnpackSync:\n");
-  sync->originTimestamp.seconds            = flip32(*(UInteger32*)(((UInteger8*)buf) + 40));
-  sync->originTimestamp.nanoseconds        = flip32(*(Integer32*) (((UInteger8*)buf) + 44));
-  sync->epochNumber                        = flip16(*(UInteger16*)(((UInteger8*)buf) + 48));
-  sync->currentUTCOffset                   = flip16(*(Integer16*) (((UInteger8*)buf) + 50));
-  sync->grandmasterCommunicationTechnology =        *(UInteger8*) (((UInteger8*)buf) + 53);
-  memcpy(sync->grandmasterClockUuid,                              (((UInteger8*)buf) + 54), 6);
-  sync->grandmasterPortId                  = flip16(*(UInteger16*)(((UInteger8*)buf) + 60));
-  sync->grandmasterSequenceId              = flip16(*(UInteger16*)(((UInteger8*)buf) + 62));
-  sync->grandmasterClockStratum            =        *(UInteger8*) (((UInteger8*)buf) + 67);
-  memcpy(sync->grandmasterClockIdentifier,                        (((UInteger8*)buf) + 68), 4);
-  sync->grandmasterClockVariance           = flip16(*(Integer16*) (((UInteger8*)buf) + 74));
-  sync->grandmasterPreferred               =        *(UInteger8*) (((UInteger8*)buf) + 77);
-  sync->grandmasterIsBoundaryClock         =        *(UInteger8*) (((UInteger8*)buf) + 79);
-  sync->syncInterval                       =        *(Integer8*)  (((UInteger8*)buf) + 83);
-  sync->localClockVariance                 = flip16(*(Integer16*) (((UInteger8*)buf) + 86));
-  sync->localStepsRemoved                  = flip16(*(UInteger16*)(((UInteger8*)buf) + 90));
-  sync->localClockStratum                  =        *(UInteger8*) (((UInteger8*)buf) + 95);
-  memcpy(sync->localClockIdentifer,                               (((UInteger8*)buf) + 96),
-         PTP_CODE_STRING_LENGTH
-        );
-  sync->parentCommunicationTechnology      =        *(UInteger8*) (((UInteger8*)buf) + 101);
-  memcpy(sync->parentUuid,                                        (((UInteger8*)buf) + 102),
-         PTP_UUID_LENGTH
-        );
-  sync->parentPortField                    = flip16(*(UInteger16*)(((UInteger8*)buf) + 110));
-  sync->estimatedMasterVariance            = flip16(*(Integer16*) (((UInteger8*)buf) + 114));
-  sync->estimatedMasterDrift               = flip32(*(Integer32*) (((UInteger8*)buf) + 116));
-  sync->utcReasonable                      =        *(UInteger8*) (((UInteger8*)buf) + 123);
 
+  msgDecodeV1Sync(buf, sync);
 
   DBGM(" originTimestamp.seconds....... %u\n",sync->originTimestamp.seconds);
   DBGM(" originTimestamp.nanoseconds... %d\n", sync->originTimestamp.nanoseconds);
@@ -422,9 +786,7 @@ void msgUnpackV2FollowUp(void *buf, V2MsgFollowUp *follow)
 {
   DBGM("msgUnpackV2FollowUp:\n");
 
-  follow->preciseOriginTimestamp.epoch_number = flip16(*(UInteger16*)(((UInteger8*)buf) + 34));
-  follow->preciseOriginTimestamp.seconds      = flip32(*(UInteger32*)(((UInteger8*)buf) + 36));
-  follow->preciseOriginTimestamp.nanoseconds  = flip32(*(Integer32*) (((UInteger8*)buf) + 40));
+  msgDecodeV2FollowUp(buf, follow);
 
   DBGM(" preciseOriginTimestamp.epoch.. %u\n", follow->preciseOriginTimestamp.epoch_number);
   DBGM(" preciseOriginTimestamp.secs... %u\n", follow->preciseOriginTimestamp.seconds);
@@ -436,9 +798,7 @@ void msgUnpackFollowUp(void *buf, MsgFollowUp *follow)
 {
   DBGM("msgUnpackFollowUp:\n");
 
-  follow->associatedSequenceId               = flip16(*(UInteger16*)(((UInteger8*)buf) + 42));
-  follow->preciseOriginTimestamp.seconds     = flip32(*(UInteger32*)(((UInteger8*)buf) + 44));
-  follow->preciseOriginTimestamp.nanoseconds = flip32(*(Integer32*) (((UInteger8*)buf) + 48));
+  msgDecodeV1FollowUp(buf, follow);
 
   DBGM(" associatedSequenceId.......... %u\n", follow->associatedSequenceId);
   DBGM(" preciseOriginTimestamp.secs... %u\n", follow->preciseOriginTimestamp.seconds);
@@ -449,11 +809,7 @@ void msgUnpackV2DelayResp(void *buf, V2MsgDelayResp *resp)
 {
   DBGM("msgUnpackV2DelayResp:\n");
 
-  resp->receiveTimestamp.epoch_number = flip16(*(UInteger16*) (((UInteger8*)buf) + 34));
-  resp->receiveTimestamp.seconds      = flip32(*(UInteger32*) (((UInteger8*)buf) + 36));
-  resp->receiveTimestamp.nanoseconds  = flip32(*(Integer32*)  (((UInteger8*)buf) + 40));
-  memcpy(resp->requestingPortId.clockIdentity,                (((UInteger8*)buf) + 44), 8);
-  resp->requestingPortId.portNumber    = flip16(*(UInteger16*)(((UInteger8*)buf) + 52));
+  msgDecodeV2DelayResp(buf, resp);
 
   DBGM(" receiveTimestamp.epoch_number. %u\n", resp->receiveTimestamp.epoch_number);
   DBGM(" receiveTimestamp.seconds...... %u\n", resp->receiveTimestamp.seconds);
@@ -475,11 +831,7 @@ void msgUnpackV2PDelayResp(void *buf, V2MsgPDelayResp *resp)
 {
   DBGM("msgUnpackV2DelayResp:\n");
 
-  resp->requestReceiptTimestamp.epoch_number = flip16(*(UInteger16*)(((UInteger8*)buf) + 34));
-  resp->requestReceiptTimestamp.seconds      = flip32(*(UInteger32*)(((UInteger8*)buf) + 36));
-  resp->requestReceiptTimestamp.nanoseconds  = flip32(*(Integer32*) (((UInteger8*)buf) + 40));
-  memcpy(resp->requestingPortId.clockIdentity,                      (((UInteger8*)buf) + 44), 8);
-  resp->requestingPortId.portNumber          = flip16(*(UInteger16*)(((UInteger8*)buf) + 52));
+  msgDecodeV2PDelayResp(buf, resp);
 
   DBGM(" requestReceiptTimestamp.epoch. %u\n", resp->requestReceiptTimestamp.epoch_number);
   DBGM(" requestReceiptTimestamp.secs.. %u\n", resp->requestReceiptTimestamp.seconds);
@@ -501,11 +853,7 @@ void msgUnpackV2PDelayRespFollowUp(void *buf, V2MsgPDelayRespFollowUp *resp)
 {
   DBGM("msgUnpackV2DelayRespFollowUp:\n");
 
-  resp->responseOriginTimestamp.epoch_number = flip16(*(UInteger16*)(((UInteger8*)buf) + 34));
-  resp->responseOriginTimestamp.seconds      = flip32(*(UInteger32*)(((UInteger8*)buf) + 36));
-  resp->responseOriginTimestamp.nanoseconds  = flip32(*(Integer32*) (((UInteger8*)buf) + 40));
-  memcpy(resp->requestingPortId.clockIdentity,                      (((UInteger8*)buf) + 44), 8);
-  resp->requestingPortId.portNumber          = flip16(*(UInteger16*)(((UInteger8*)buf) + 52));
+  msgDecodeV2PDelayRespFollowUp(buf, resp);
 
   DBGM(" responseOriginTimestamp.epoch. %u\n", resp->responseOriginTimestamp.epoch_number);
   DBGM(" responseOriginTimestamp.secs.. %u\n", resp->responseOriginTimestamp.seconds);
@@ -526,12 +874,8 @@ void msgUnpackV2PDelayRespFollowUp(void *buf, V2MsgPDelayRespFollowUp *resp)
 void msgUnpackDelayResp(void *buf, MsgDelayResp *resp)
 {
   DBGM("msgUnpackDelayResp:\n");
-  resp->delayReceiptTimestamp.seconds           = flip32(*(UInteger32*)(((UInteger8*)buf) + 40));
-  resp->delayReceiptTimestamp.nanoseconds       = flip32(*(Integer32*) (((UInteger8*)buf) + 44));
-  resp->requestingSourceCommunicationTechnology =        *(UInteger8*) (((UInteger8*)buf) + 49);
-  memcpy(resp->requestingSourceUuid,                                   (((UInteger8*)buf) + 50), 6);
-  resp->requestingSourcePortId                  = flip16(*(UInteger16*)(((UInteger8*)buf) + 56));
-  resp->requestingSourceSequenceId              = flip16(*(UInteger16*)(((UInteger8*)buf) + 58));
+
+  msgDecodeV1DelayResp(buf, resp);
 
   DBGM(" delayReceiptTimestamp.secs.... %u\n", resp->delayReceiptTimestamp.seconds);
   DBGM(" delayReceiptTimestamp.nsecs... %d\n", resp->delayReceiptTimestamp.nanoseconds);
@@ -905,36 +1249,22 @@ void msgPackAnnounce(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 32) =  V2_ALL_OTHERS_CONTROL;
   *(UInteger8*)   (((UInteger8*)buf) + 33) =  ptpClock->announce_interval;
 
-  /* Timestamp */
-
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(originTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(originTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(originTimestamp->nanoseconds);
-
-  /* Current UTC Offset */
-
-  *(UInteger16*)  (((UInteger8*)buf) + 44) =  flip16(ptpClock->current_utc_offset);
-
-  /* reserved */
-
-  *(UInteger8*)   (((UInteger8*)buf) + 46) =  0;
-
-  /* Grandmaster Priority1, Clock Quality, Priority2, Identity, Steps removed
-   * and Time source.  Used for remote to run best master clock algorithm.
-   * Note, some of these fields are byte aligned on odd addresses, so 
-   * for portability, some 16 bit values are copied a byte at a time
+  /* Timestamp, current UTC offset and the grandmaster Priority1, Clock
+   * Quality, Priority2, Identity, Steps removed and Time source used by
+   * the remote to run the best master clock algorithm
    */
 
-  *(UInteger8*)   (((UInteger8*)buf) + 47) =  ptpClock->grandmaster_priority1;
-  *(UInteger8*)   (((UInteger8*)buf) + 48) =  ptpClock->grandmaster_clock_quality.clockClass;
-  *(Enumeration8*)(((UInteger8*)buf) + 49) =  ptpClock->grandmaster_clock_quality.clockAccuracy;
-  *(UInteger16*)  (((UInteger8*)buf) + 50) 
-    = flip16(ptpClock->grandmaster_clock_quality.offsetScaledLogVariance);
-  *(UInteger8*)   (((UInteger8*)buf) + 52) =  ptpClock->grandmaster_priority2;
-  memcpy (        (((UInteger8*)buf) + 53),   ptpClock->parent_clock_identity, 8);
-  *(UInteger8*)   (((UInteger8*)buf) + 61) =  ptpClock->steps_removed >> 8;
-  *(UInteger8*)   (((UInteger8*)buf) + 62) =  ptpClock->steps_removed & 0xFF;
-  *(UInteger8*)   (((UInteger8*)buf) + 63) =  ptpClock->time_source;  
+  msgPutV2Announce_originTimestamp        (buf, *originTimestamp);
+  msgPutV2Announce_currentUTCOffset       (buf, ptpClock->current_utc_offset);
+  msgPutV2Announce_reserved               (buf, 0);
+  msgPutV2Announce_grandmasterPriority1   (buf, ptpClock->grandmaster_priority1);
+  msgPutV2Announce_clockClass             (buf, ptpClock->grandmaster_clock_quality.clockClass);
+  msgPutV2Announce_clockAccuracy          (buf, ptpClock->grandmaster_clock_quality.clockAccuracy);
+  msgPutV2Announce_offsetScaledLogVariance(buf, ptpClock->grandmaster_clock_quality.offsetScaledLogVariance);
+  msgPutV2Announce_grandmasterPriority2   (buf, ptpClock->grandmaster_priority2);
+  msgPutV2Announce_grandmasterIdentity    (buf, ptpClock->parent_clock_identity);
+  msgPutV2Announce_stepsRemoved           (buf, ptpClock->steps_removed);
+  msgPutV2Announce_timeSource             (buf, ptpClock->time_source);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -988,9 +1318,7 @@ void msgPackV2Sync(void                 *buf,
 
 
   /* Timestamp: */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(originTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(originTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(originTimestamp->nanoseconds);
+  msgPutV2Sync_originTimestamp(buf, *originTimestamp);
 
   DBGM("msgPackV2Sync:\n");
 
@@ -1000,13 +1328,44 @@ void msgPackV2Sync(void                 *buf,
 
 }
 
+/* Write the V1 Sync / Delay_Req body from the local clock data set */
+static void msgPutV1SyncBody(void               *buf,
+                             TimeRepresentation *originTimestamp,
+                             PtpClock           *ptpClock
+                            )
+{
+  msgClearV1Sync(buf);
+  msgPutV1Sync_originTimestamp            (buf, *originTimestamp);
+  msgPutV1Sync_epochNumber                (buf, ptpClock->epoch_number);
+  msgPutV1Sync_currentUTCOffset           (buf, ptpClock->current_utc_offset);
+  msgPutV1Sync_grandmasterCommTechnology  (buf, ptpClock->grandmaster_communication_technology);
+  msgPutV1Sync_grandmasterClockUuid       (buf, ptpClock->grandmaster_uuid_field);
+  msgPutV1Sync_grandmasterPortId          (buf, ptpClock->grandmaster_port_id_field);
+  msgPutV1Sync_grandmasterSequenceId      (buf, ptpClock->grandmaster_sequence_number);
+  msgPutV1Sync_grandmasterClockStratum    (buf, ptpClock->grandmaster_stratum);
+  msgPutV1Sync_grandmasterClockIdentifier (buf, ptpClock->grandmaster_identifier);
+  msgPutV1Sync_grandmasterClockVariance   (buf, ptpClock->grandmaster_v1_variance);
+  msgPutV1Sync_grandmasterPreferred       (buf, ptpClock->grandmaster_preferred);
+  msgPutV1Sync_grandmasterIsBoundaryClock (buf, ptpClock->grandmaster_is_boundary_clock);
+  msgPutV1Sync_syncInterval               (buf, ptpClock->sync_interval);
+  msgPutV1Sync_localClockVariance         (buf, ptpClock->clock_v1_variance);
+  msgPutV1Sync_localStepsRemoved          (buf, ptpClock->steps_removed);
+  msgPutV1Sync_localClockStratum          (buf, ptpClock->clock_stratum);
+  msgPutV1Sync_localClockIdentifer        (buf, ptpClock->clock_identifier);
+  msgPutV1Sync_parentCommunicationTechnology(buf, ptpClock->parent_communication_technology);
+  msgPutV1Sync_parentUuid                 (buf, ptpClock->parent_uuid);
+  msgPutV1Sync_parentPortField            (buf, ptpClock->parent_port_id);
+  msgPutV1Sync_estimatedMasterVariance    (buf, ptpClock->observed_v1_variance);
+  msgPutV1Sync_estimatedMasterDrift       (buf, __atomic_load_n(&ptpClock->published_drift, __ATOMIC_RELAXED));
+  msgPutV1Sync_utcReasonable              (buf, ptpClock->utc_reasonable);
+}
+
 void msgPackSync(void               *buf, 
                  Boolean             burst,
                  TimeRepresentation *originTimestamp,
                  PtpClock           *ptpClock
                 )
 {
-
 /* PTP header fields */
 
   *(UInteger8*)(((UInteger8*)buf) + 20) = 1;  /* Event messageType */
@@ -1023,31 +1382,8 @@ void msgPackSync(void               *buf,
     clearFlag( (((UInteger8*)buf) + 34), PARENT_STATS);
   
 /* Sync message specific fields */
-  
-  *(Integer32*)(((UInteger8*)buf) + 40) =   flip32(originTimestamp->seconds);
-  *(Integer32*)(((UInteger8*)buf) + 44) =   flip32(originTimestamp->nanoseconds);
-  *(Integer32*)(((UInteger8*)buf) + 48) =   shift16(flip16(ptpClock->epoch_number), 0)
-                            | shift16(flip16(ptpClock->current_utc_offset), 1);
-  *(Integer32*)(((UInteger8*)buf) + 52) =   shift8(ptpClock->grandmaster_communication_technology, 1);
-  memcpy(      (((UInteger8*)buf) + 54),    ptpClock->grandmaster_uuid_field, 6);
-  *(Integer32*)(((UInteger8*)buf) + 60) =   shift16(flip16(ptpClock->grandmaster_port_id_field), 0)
-                            | shift16(flip16(ptpClock->grandmaster_sequence_number), 1);
-  *(Integer32*)(((UInteger8*)buf) + 64) =   shift8(ptpClock->grandmaster_stratum, 3);
-  memcpy(      (((UInteger8*)buf) + 68),    ptpClock->grandmaster_identifier, 4);
-  *(Integer32*)(((UInteger8*)buf) + 72) =   shift16(flip16(ptpClock->grandmaster_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 76) =   shift16(flip16(ptpClock->grandmaster_preferred), 0)
-                            | shift16(flip16(ptpClock->grandmaster_is_boundary_clock), 1);
-  *(Integer32*)(((UInteger8*)buf) + 80) =   shift16(flip16(ptpClock->sync_interval), 1);
-  *(Integer32*)(((UInteger8*)buf) + 84) =   shift16(flip16(ptpClock->clock_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 88) =   shift16(flip16(ptpClock->steps_removed), 1);
-  *(Integer32*)(((UInteger8*)buf) + 92) =   shift8(ptpClock->clock_stratum, 3);
-  memcpy(      (((UInteger8*)buf) + 96),    ptpClock->clock_identifier, 4);
-  *(Integer32*)(((UInteger8*)buf) + 100) =  shift8(ptpClock->parent_communication_technology, 1);
-  memcpy(      (((UInteger8*)buf) + 102),   ptpClock->parent_uuid, 6);
-  *(Integer32*)(((UInteger8*)buf) + 108) =  shift16(flip16(ptpClock->parent_port_id), 1);
-  *(Integer32*)(((UInteger8*)buf) + 112) =  shift16(flip16(ptpClock->observed_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 116) =  flip32(ptpClock->observed_drift);
-  *(Integer32*)(((UInteger8*)buf) + 120) =  shift8(ptpClock->utc_reasonable, 3);
+
+  msgPutV1SyncBody(buf, originTimestamp, ptpClock);
 }
 
 void msgPackV2DelayReq(void                 *buf, 
@@ -1073,9 +1409,7 @@ void msgPackV2DelayReq(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 33) =  LOGMEAN_DELAY_REQ;
 
   /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(originTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(originTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(originTimestamp->nanoseconds);
+  msgPutV2Sync_originTimestamp(buf, *originTimestamp);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1105,13 +1439,9 @@ void msgPackV2PDelayReq(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 32) =  V2_ALL_OTHERS_CONTROL;
   *(UInteger8*)   (((UInteger8*)buf) + 33) =  LOGMEAN_PDELAY_REQ;
 
-  /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(originTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(originTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(originTimestamp->nanoseconds);
-
-  /* Reserved */
-  memset(         (((UInteger8*)buf) + 44),   0, 10);
+  /* Timestamp and reserved */
+  msgClearV2PDelayReq(buf);
+  msgPutV2PDelayReq_originTimestamp(buf, *originTimestamp);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1126,7 +1456,6 @@ void msgPackDelayReq(void               *buf,
                      PtpClock           *ptpClock
                     )
 {
-
 /* PTP header fields */
 
   *(UInteger8*)(((UInteger8*)buf) + 20) =  1;  /* Event messageType */
@@ -1142,32 +1471,9 @@ void msgPackDelayReq(void               *buf,
   else
     clearFlag( (((UInteger8*)buf) + 34),   PARENT_STATS);
 
-/* Delay request specific fields */  
-
-  *(Integer32*)(((UInteger8*)buf) + 40) =  flip32(originTimestamp->seconds);
-  *(Integer32*)(((UInteger8*)buf) + 44) =  flip32(originTimestamp->nanoseconds);
-  *(Integer32*)(((UInteger8*)buf) + 48) =  shift16(flip16(ptpClock->epoch_number), 0)
-                           | shift16(flip16(ptpClock->current_utc_offset), 1);
-  *(Integer32*)(((UInteger8*)buf) + 52) =  shift8(ptpClock->grandmaster_communication_technology, 1);
-  memcpy(      (((UInteger8*)buf) + 54),   ptpClock->grandmaster_uuid_field, 6);
-  *(Integer32*)(((UInteger8*)buf) + 60) =  shift16(flip16(ptpClock->grandmaster_port_id_field), 0)
-                           | shift16(flip16(ptpClock->grandmaster_sequence_number), 1);
-  *(Integer32*)(((UInteger8*)buf) + 64) =  shift8(ptpClock->grandmaster_stratum, 3);
-  memcpy(      (((UInteger8*)buf) + 68),   ptpClock->grandmaster_identifier, 4);
-  *(Integer32*)(((UInteger8*)buf) + 72) =  shift16(flip16(ptpClock->grandmaster_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 76) =  shift16(flip16(ptpClock->grandmaster_preferred), 0)
-                           | shift16(flip16(ptpClock->grandmaster_is_boundary_clock), 1);
-  *(Integer32*)(((UInteger8*)buf) + 80) =  shift16(flip16(ptpClock->sync_interval), 1);
-  *(Integer32*)(((UInteger8*)buf) + 84) =  shift16(flip16(ptpClock->clock_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 88) =  shift16(flip16(ptpClock->steps_removed), 1);
-  *(Integer32*)(((UInteger8*)buf) + 92) =  shift8(ptpClock->clock_stratum, 3);
-  memcpy(      (((UInteger8*)buf) + 96),   ptpClock->clock_identifier, 4);
-  *(Integer32*)(((UInteger8*)buf) + 100) = shift8(ptpClock->parent_communication_technology, 1);
-  memcpy(      (((UInteger8*)buf) + 102),  ptpClock->parent_uuid, 6);
-  *(Integer32*)(((UInteger8*)buf) + 108) = shift16(flip16(ptpClock->parent_port_id), 1);
-  *(Integer32*)(((UInteger8*)buf) + 112) = shift16(flip16(ptpClock->observed_v1_variance), 1);
-  *(Integer32*)(((UInteger8*)buf) + 116) = flip32(ptpClock->observed_drift);
-  *(Integer32*)(((UInteger8*)buf) + 120) = shift8(ptpClock->utc_reasonable, 3);
+/* Delay request specific fields */
+
+  msgPutV1SyncBody(buf, originTimestamp, ptpClock);
 }
 
 void msgPackV2FollowUp(void                 *buf, 
@@ -1197,9 +1503,7 @@ void msgPackV2FollowUp(void                 *buf,
   }
 
   /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(preciseOriginTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(preciseOriginTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(preciseOriginTimestamp->nanoseconds);
+  msgPutV2FollowUp_preciseOriginTimestamp(buf, *preciseOriginTimestamp);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1213,7 +1517,6 @@ void msgPackFollowUp(void               *buf,
                      PtpClock           *ptpClock
                     )
 {
-
 /* PTP header fields */
 
   *(UInteger8*)(((UInteger8*)buf) + 20) =  2;  /* General messageType */
@@ -1224,10 +1527,10 @@ void msgPackFollowUp(void               *buf,
   clearFlag(   (((UInteger8*)buf) + 34),   PARENT_STATS);
 
 /* Follow Up fields */
-  
-  *(Integer32*)(((UInteger8*)buf) + 40) = shift16(flip16(associatedSequenceId), 1);
-  *(Integer32*)(((UInteger8*)buf) + 44) = flip32(preciseOriginTimestamp->seconds);
-  *(Integer32*)(((UInteger8*)buf) + 48) = flip32(preciseOriginTimestamp->nanoseconds);
+
+  msgClearV1FollowUp(buf);
+  msgPutV1FollowUp_associatedSequenceId  (buf, associatedSequenceId);
+  msgPutV1FollowUp_preciseOriginTimestamp(buf, *preciseOriginTimestamp);
 }
 
 void msgPackV2DelayResp(void                 *buf, 
@@ -1262,18 +1565,9 @@ void msgPackV2DelayResp(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 32) =  V2_DELAY_RESP_CONTROL;
 
 
-  /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(delayReceiptTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(delayReceiptTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(delayReceiptTimestamp->nanoseconds);
-
-  /* requestingPortId, copy from Delay Request header */
-
-  memcpy((((UInteger8*)buf) + 44),
-         header->sourcePortId.clockIdentity,  
-         8
-        );
-  *(UInteger16*)  (((UInteger8*)buf) + 52) = flip16(header->sourcePortId.portNumber);
+  /* Timestamp and requestingPortId (copied from the request header) */
+  msgPutV2DelayResp_receiveTimestamp(buf, *delayReceiptTimestamp);
+  msgPutV2DelayResp_requestingPortId(buf, header->sourcePortId);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1315,18 +1609,9 @@ void msgPackV2PDelayResp(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 33) =  LOGMEAN_PDELAY_RESP;
 
 
-  /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(requestReceiptTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(requestReceiptTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(requestReceiptTimestamp->nanoseconds);
-
-  /* requestingPortId, copy from PDelay Request message header */
-
-  memcpy((((UInteger8*)buf) + 44),
-         header->sourcePortId.clockIdentity,
-         8
-        );
-  *(UInteger16*)  (((UInteger8*)buf) + 52) = flip16(header->sourcePortId.portNumber);
+  /* Timestamp and requestingPortId (copied from the request header) */
+  msgPutV2PDelayResp_requestReceiptTimestamp(buf, *requestReceiptTimestamp);
+  msgPutV2PDelayResp_requestingPortId       (buf, header->sourcePortId);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1362,18 +1647,9 @@ void msgPackV2PDelayRespFollowUp(void                 *buf,
   *(UInteger8*)   (((UInteger8*)buf) + 33) =  LOGMEAN_PDELAY_RESP_FOLLOWUP;
 
 
-  /* Timestamp */
-  *(UInteger16*)  (((UInteger8*)buf) + 34) =  flip16(responseOriginTimestamp->epoch_number);
-  *(UInteger32*)  (((UInteger8*)buf) + 36) =  flip32(responseOriginTimestamp->seconds);
-  *(UInteger32*)  (((UInteger8*)buf) + 40) =  flip32(responseOriginTimestamp->nanoseconds);
-
-  /* requestingPortId, copy from PDelay Request message header */
-
-  memcpy((((UInteger8*)buf) + 44),
-         header->sourcePortId.clockIdentity,
-         8
-        );
-  *(UInteger16*)  (((UInteger8*)buf) + 52) = flip16(header->sourcePortId.portNumber);
+  /* Timestamp and requestingPortId (copied from the request header) */
+  msgPutV2PDelayRespFollowUp_responseOriginTimestamp(buf, *responseOriginTimestamp);
+  msgPutV2PDelayRespFollowUp_requestingPortId       (buf, header->sourcePortId);
 
 #ifdef PTPD_DBG
   debug_dump_ptp_v2_header(buf);
@@ -1387,7 +1663,6 @@ void msgPackDelayResp(void               *buf,
                       PtpClock           *ptpClock
                      )
 {
-
 /* PTP header fields */
 
   *(UInteger8*)(((UInteger8*)buf) + 20) =  2;  /* General messageType */
@@ -1399,12 +1674,12 @@ void msgPackDelayResp(void               *buf,
   
 /* Delay Request fields */
 
-  *(Integer32*)(((UInteger8*)buf) + 40) =  flip32(delayReceiptTimestamp->seconds);
-  *(Integer32*)(((UInteger8*)buf) + 44) =  flip32(delayReceiptTimestamp->nanoseconds);
-  *(Integer32*)(((UInteger8*)buf) + 48) =  shift8(header->sourceCommunicationTechnology, 1);
-  memcpy(      (((UInteger8*)buf) + 50),   header->sourceUuid, 6);
-  *(Integer32*)(((UInteger8*)buf) + 56) =  shift16(flip16(header->sourcePortId), 0)
-                           | shift16(flip16(header->sequenceId), 1);
+  msgClearV1DelayResp(buf);
+  msgPutV1DelayResp_delayReceiptTimestamp     (buf, *delayReceiptTimestamp);
+  msgPutV1DelayResp_requestingSourceCommTechnology(buf, header->sourceCommunicationTechnology);
+  msgPutV1DelayResp_requestingSourceUuid      (buf, header->sourceUuid);
+  msgPutV1DelayResp_requestingSourcePortId    (buf, header->sourcePortId);
+  msgPutV1DelayResp_requestingSourceSequenceId(buf, header->sequenceId);
 }
 
 UInteger16 msgPackManagement(void          *buf, 
@@ -1531,7 +1806,7 @@ UInteger16 msgPackManagementResponse(void          *buf,
     *(Integer32*)(((UInteger8*)buf) + 88) =  shift16(flip16(ptpClock->parent_v1_variance), 1);
     *(Integer32*)(((UInteger8*)buf) + 92) =  shift8(ptpClock->parent_stats, 3);
     *(Integer32*)(((UInteger8*)buf) + 96) =  shift16(flip16(ptpClock->observed_v1_variance), 1);
-    *(Integer32*)(((UInteger8*)buf) + 100) = flip32(ptpClock->observed_drift);
+    *(Integer32*)(((UInteger8*)buf) + 100) = flip32(__atomic_load_n(&ptpClock->published_drift, __ATOMIC_RELAXED));
     *(Integer32*)(((UInteger8*)buf) + 104) = shift8(ptpClock->utc_reasonable, 3);
     *(Integer32*)(((UInteger8*)buf) + 108) = shift8(ptpClock->grandmaster_communication_technology, 3);
     memcpy(      (((UInteger8*)buf) + 112),  ptpClock->grandmaster_uuid_field, 6);
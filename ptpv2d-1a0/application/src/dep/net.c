@@ -88,6 +88,332 @@
 #include "../mpc831x.h"
 #endif
 
+#ifdef linux
+/* Persistent epoll readiness engine shared by all ports.  The epoll
+ * instance is created on the first call to netInit() and each port's
+ * receive sockets are registered with the port index and socket flag
+ * packed into the event data, so netSelect() and netSelectAll() can
+ * report exactly which socket on which port is ready without rebuilding
+ * an fd_set or scanning every port on each pass of the main loop.
+ * With port threads each thread has its own epoll instance.
+ */
+static PTPD_THREAD_LOCAL int       netEpollFd = -1;
+static PTPD_THREAD_LOCAL NetPath **netEpollPaths;     /**< Net path of each port, indexed by portIndex */
+static PTPD_THREAD_LOCAL int       netEpollPathCount; /**< Number of entries allocated at netEpollPaths */
+
+static PTPD_THREAD_LOCAL int       netTimerFd = -1;
+
+#define NET_EPOLL_DATA(index, flag)  ((((UInteger32)(index)) << 8) | (flag))
+#define NET_EPOLL_INDEX(data)        ((data) >> 8)
+#define NET_EPOLL_FLAG(data)         ((data) & 0xFF)
+#define NET_EPOLL_TIMER              0xFFFFFFFF   /**< Event data tag of the timer fd */
+
+/** Function to create the epoll instance on first use
+ *
+ * @return Returns TRUE if OK, otherwise FALSE
+ */
+static Boolean netEpollCreate(void)
+{
+  if(netEpollFd < 0)
+  {
+    if((netEpollFd = epoll_create(NET_EPOLL_MAX_EVENTS)) < 0)
+    {
+      PERROR("netEpollCreate: failed to create epoll instance");
+      return FALSE;
+    }
+    fcntl(netEpollFd, F_SETFD, FD_CLOEXEC);
+  }
+  return TRUE;
+}
+
+/** Function to register the protocol timer fd (see timer.c) with the
+ * epoll readiness engine, so the main loop wakes up exactly at the
+ * earliest timer deadline
+ *
+ * @return Returns TRUE if OK, otherwise FALSE
+ */
+Boolean netRegisterTimer(int fd)
+{
+  struct epoll_event ev;
+
+  if(!netEpollCreate())
+    return FALSE;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events   = EPOLLIN;
+  ev.data.u32 = NET_EPOLL_TIMER;
+
+  if(epoll_ctl(netEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    PERROR("netRegisterTimer: failed to register timer fd %d", fd);
+    return FALSE;
+  }
+  netTimerFd = fd;
+  DBGV("netRegisterTimer: timer fd %d\n", fd);
+  return TRUE;
+}
+
+/** Function to register a receive socket with the epoll readiness engine
+ *
+ * @return Returns TRUE if OK, otherwise FALSE
+ */
+static Boolean netEpollAdd(SOCKET     sock,  /**< Socket to register */
+                           UInteger16 index, /**< Port index (port_id - 1) */
+                           UInteger8  flag   /**< NET_xxx_SOCK_READY flag for this socket */
+                          )
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events   = EPOLLIN;
+  ev.data.u32 = NET_EPOLL_DATA(index, flag);
+
+  if(epoll_ctl(netEpollFd, EPOLL_CTL_ADD, sock, &ev) < 0)
+  {
+    PERROR("netEpollAdd: failed to register socket %d", sock);
+    return FALSE;
+  }
+  DBGV("netEpollAdd: socket %d, port index %d, flag 0x%2.2x\n",
+       sock,
+       index,
+       flag
+      );
+  return TRUE;
+}
+
+/** Function to remove a receive socket from the epoll readiness engine */
+static void netEpollDel(SOCKET sock)
+{
+  struct epoll_event ev;  /* Unused, but required by kernels before 2.6.9 */
+
+  if(netEpollFd >= 0 && sock > 0)
+  {
+    epoll_ctl(netEpollFd, EPOLL_CTL_DEL, sock, &ev);
+  }
+}
+
+/**
+ * Function to wait for receive readiness on all registered sockets
+ * with an optional time to wait.  For every ready socket, the matching
+ * NET_xxx_SOCK_READY flag is set in the owning port's NetPath so that
+ * handle() reads only that socket.
+ *
+ * @return Returns number of ready sockets, 0 for timeout/signal or
+ *         negative for error
+ */
+static int netEpollWait(TimeInternal *timeout)
+{
+  struct epoll_event events[NET_EPOLL_MAX_EVENTS];
+  int                timeout_ms;
+  int                ret, i;
+  UInteger32         index;
+  UInteger8          flag;
+  UInteger64         expirations;
+
+  if(timeout)
+  {
+    /* epoll_wait() wants milliseconds, round up so a short
+     * poll timeout does not turn into a busy loop
+     */
+    timeout_ms = timeout->seconds*1000 + (timeout->nanoseconds + 999999)/1000000;
+    DBGV("netEpollWait: timeout requested %ds %dns\n",
+         (unsigned int)timeout->seconds,
+         (int) timeout->nanoseconds
+        );
+  }
+  else
+  {
+    DBGV("netEpollWait: NULL timeout pointer, wait for event\n");
+    timeout_ms = -1;
+  }
+
+  ret = epoll_wait(netEpollFd, events, NET_EPOLL_MAX_EVENTS, timeout_ms);
+
+  if(ret < 0)
+  {
+    if(errno == EAGAIN || errno == EINTR)
+    {
+      DBGV("netEpollWait: errno EAGAIN or EINTR (%d)\n",errno);
+      return 0;
+    }
+    DBG("netEpollWait: unexpected errno: %d\n", errno);
+    return ret;
+  }
+
+  for(i = 0; i < ret; i++)
+  {
+    if(events[i].data.u32 == NET_EPOLL_TIMER)
+    {
+      /* Timer deadline reached, consume the expiration count so the
+       * fd is not reported again until timerArm() re-arms it
+       */
+      if(read(netTimerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+      {
+        PERROR("netEpollWait: failed to read timer fd");
+      }
+      continue;
+    }
+    index = NET_EPOLL_INDEX(events[i].data.u32);
+    flag  = NET_EPOLL_FLAG(events[i].data.u32);
+    if(index < netEpollPathCount && netEpollPaths[index])
+    {
+      /* A non empty error queue is reported as EPOLLERR, on the event
+       * socket that means transmit time stamps are waiting
+       */
+      if((events[i].events & EPOLLERR) && flag == NET_EVENT_SOCK_READY)
+      {
+        netEpollPaths[index]->readySockets |= NET_TX_STAMP_READY;
+        if(!(events[i].events & EPOLLIN))
+          continue;
+      }
+      netEpollPaths[index]->readySockets |= flag;
+    }
+  }
+  DBGV("netEpollWait: return: %d\n",ret);
+  return ret;
+}
+#endif /* linux */
+
+#ifdef SOCKET_TIMESTAMPING
+#if defined(linux) && defined(SO_TIMESTAMPING) && !defined(CONFIG_MPC831X)
+/** Use the NIC hardware receive stamp in preference to the software
+ *  stamp (set when disciplining a PTP hardware clock, see clockIsPhc)
+ */
+static Boolean netPreferHwStamps = FALSE;
+
+/** The NIC driver also stamps transmitted frames in hardware */
+static Boolean netHwTxStamps     = FALSE;
+
+/**
+ * Function to turn on hardware receive time stamping in the NIC
+ * driver (SIOCSHWTSTAMP).  Needed when a PTP hardware clock is
+ * disciplined, as software stamps are in system time, not PHC time.
+ * Transmit stamping is asked for as well and netHwTxStamps records
+ * whether the driver accepted it.
+ *
+ * @return Returns TRUE if the driver accepted a receive filter
+ */
+static Boolean netEnableHwTimestamps(NetPath     *netPath, /**< Network path (ifName, eventSock) */
+                                     RunTimeOpts *rtOpts   /**< Run time options */
+                                    )
+{
+  struct ifreq           ifr;
+  struct hwtstamp_config config;
+
+  memset(&ifr,    0, sizeof(ifr));
+  memset(&config, 0, sizeof(config));
+  strncpy(ifr.ifr_name, netPath->ifName, IFNAMSIZ - 1);
+  ifr.ifr_data = (void *)&config;
+
+  for (config.tx_type = HWTSTAMP_TX_ON; ; config.tx_type = HWTSTAMP_TX_OFF)
+  {
+    config.rx_filter = rtOpts->ptpv2 ? HWTSTAMP_FILTER_PTP_V2_EVENT
+                                     : HWTSTAMP_FILTER_PTP_V1_L4_EVENT;
+    if (ioctl(netPath->eventSock, SIOCSHWTSTAMP, &ifr) == 0)
+      break;
+
+    /* Some drivers only support stamping every packet */
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+    if (ioctl(netPath->eventSock, SIOCSHWTSTAMP, &ifr) == 0)
+      break;
+
+    if (config.tx_type == HWTSTAMP_TX_OFF)
+      return FALSE;
+  }
+  netHwTxStamps = (config.tx_type == HWTSTAMP_TX_ON);
+  DBG("netEnableHwTimestamps: %s rx_filter %d tx_type %d\n",
+      netPath->ifName, config.rx_filter, config.tx_type
+     );
+  return TRUE;
+}
+
+/**
+ * Function to have the kernel loop sent event messages back through
+ * the socket error queue together with their transmit time stamp.
+ * Software stamps are only used while the system clock is disciplined,
+ * hardware stamps only when the driver stamps transmitted frames.
+ *
+ * @return Returns TRUE if transmit stamps will be on the error queue
+ */
+static Boolean netEnableTxTimestamps(SOCKET sock)
+{
+  int temp;
+
+  temp = SOF_TIMESTAMPING_RX_SOFTWARE
+       | SOF_TIMESTAMPING_SOFTWARE
+       | SOF_TIMESTAMPING_RX_HARDWARE
+       | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+  if (netPreferHwStamps)
+  {
+    if (!netHwTxStamps)
+      return FALSE;
+    temp |= SOF_TIMESTAMPING_TX_HARDWARE;
+  }
+  else
+  {
+    temp |= SOF_TIMESTAMPING_TX_SOFTWARE;
+  }
+
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &temp, sizeof(int)) < 0)
+    return FALSE;
+
+  DBG("netEnableTxTimestamps: socket %d using the error queue (%s)\n",
+      sock, netPreferHwStamps ? "hardware" : "software"
+     );
+  return TRUE;
+}
+#endif
+
+/**
+ * Function to make receive time stamps available through recvmsg()
+ * with the best resolution the system offers.  In order of preference:
+ * SO_TIMESTAMPING (software and hardware receive stamps, nanoseconds),
+ * SO_TIMESTAMPNS (software, nanoseconds) and SO_TIMESTAMP (software,
+ * microseconds).  netGetRxTimestamp() accepts any of the three.
+ *
+ * @return Returns TRUE if OK, otherwise FALSE
+ */
+static Boolean netEnableRxTimestamps(SOCKET sock)
+{
+  int temp;
+
+#if defined(linux) && !defined(CONFIG_MPC831X)
+#ifdef SO_TIMESTAMPING
+  temp = SOF_TIMESTAMPING_RX_SOFTWARE
+       | SOF_TIMESTAMPING_SOFTWARE
+       | SOF_TIMESTAMPING_RX_HARDWARE
+       | SOF_TIMESTAMPING_RAW_HARDWARE;
+
+  if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &temp, sizeof(int)) == 0)
+  {
+    DBG("netEnableRxTimestamps: socket %d using SO_TIMESTAMPING\n", sock);
+    return TRUE;
+  }
+#endif
+#ifdef SO_TIMESTAMPNS
+  temp = 1;
+  if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &temp, sizeof(int)) == 0)
+  {
+    DBG("netEnableRxTimestamps: socket %d using SO_TIMESTAMPNS\n", sock);
+    return TRUE;
+  }
+#endif
+#endif
+
+  /* MPC831X reads the hardware stamp later in protocol.c, it only
+   * needs SCM_TIMESTAMP to flag that a stamp was taken
+   */
+  temp = 1;
+  if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &temp, sizeof(int)) < 0)
+  {
+    return FALSE;
+  }
+  DBG("netEnableRxTimestamps: socket %d using SO_TIMESTAMP\n", sock);
+  return TRUE;
+}
+#endif /* SOCKET_TIMESTAMPING */
+
 #ifdef __WINDOWS__
 
 /* AKB added windows version of sendmsg and recvmsg */
@@ -1280,6 +1606,9 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
   char   addrStr[NET_ADDRESS_LENGTH];
   char   interface_name[IFACE_NAME_LENGTH];
   char * s;
+#ifdef linux
+  NetPath **paths;
+#endif
   
   DBG("netInit: entering\n");
 
@@ -1288,6 +1617,10 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
            ptpClock->port_id_field
           );
 
+  netPath->portIndex    = ptpClock->port_id_field - 1;
+  netPath->readySockets = 0;
+  netPath->txStamps     = FALSE;
+
   DBG("netInit: Setting up sockets\n");
   /* open event and general sockets for IEEE 1588 operation */
 
@@ -1335,30 +1668,26 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
    * or find and validate network interface 
    */
 
-  if (rtOpts->ifaceName[0] != '\0')
+  if (rtOpts->portIfaceName && netPath->portIndex < rtOpts->numberPorts)
   {
-     strncpy(interface_name, rtOpts->ifaceName, IFACE_NAME_LENGTH);
-     DBGV("netInit: rtOpts->ifaceName port id: %d is specified as %s\n",
+     // Boundary clock, each port is bound to its own interface from the -b list
+     strncpy(interface_name, rtOpts->portIfaceName[netPath->portIndex], IFACE_NAME_LENGTH);
+     DBGV("netInit: rtOpts->portIfaceName port id: %d is specified as %s\n",
            ptpClock->port_id_field,
            interface_name
           );
   }
-  else
+  else if (rtOpts->ifaceName[0] != '\0')
   {
-#if (MAX_PTP_PORTS > 1)
-      //
-      // AKB: new code for multiple port support.  If not bound to an interface, use port
-      // id number to specify ethernet interface to use eth0 + (port id - 1)
-      //
-      strncpy(interface_name, "eth0", IFACE_NAME_LENGTH);
-      interface_name[3] += (ptpClock->port_id_field -1);
-      DBGV("netInit: rtOpts->ifaceName port id: %d set to %s\n",
+     strncpy(interface_name, rtOpts->ifaceName, IFACE_NAME_LENGTH);
+     DBGV("netInit: rtOpts->ifaceName port id: %d is specified as %s\n",
            ptpClock->port_id_field,
            interface_name
           );
-#else 
+  }
+  else
+  {
       interface_name[0] = '\0';
-#endif
   }
 
 
@@ -1395,6 +1724,48 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
           3
          );
 
+  if (ptpClock->port_id_field > 1)
+  {
+    /* All ports of a boundary clock belong to one clock, so they share
+     * the identity of port 1 and differ only in their port number
+     */
+    memcpy(ptpClock->port_uuid_field,
+           ptpClockFirstPort(ptpClock)->port_uuid_field,
+           PTP_UUID_LENGTH
+          );
+    memcpy(ptpClock->port_clock_identity,
+           ptpClockFirstPort(ptpClock)->port_clock_identity,
+           8
+          );
+  }
+
+#ifdef linux
+  if (rtOpts->numberPorts > 1)
+  {
+    /* Sockets of every port are bound to the PTP ports on INADDR_ANY,
+     * restrict each one to its own interface so a port only sees
+     * messages from its own link
+     */
+    if(  setsockopt(netPath->eventSock,
+                    SOL_SOCKET,
+                    SO_BINDTODEVICE,
+                    netPath->ifName,
+                    strlen(netPath->ifName) + 1
+                   ) < 0
+      || setsockopt(netPath->generalSock,
+                    SOL_SOCKET,
+                    SO_BINDTODEVICE,
+                    netPath->ifName,
+                    strlen(netPath->ifName) + 1
+                   ) < 0
+      )
+    {
+      PERROR("netInit: failed to bind sockets to interface %s", netPath->ifName);
+      return FALSE;
+    }
+  }
+#endif
+
   /* Set socket options for event and general sockets for address reuse */
 
   temp = 1;
@@ -1757,35 +2128,57 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
 #ifdef SOCKET_TIMESTAMPING
   /* make timestamps available through recvmsg() */
 
-  temp = 1;
-
-  if(  setsockopt(netPath->eventSock,
-                  SOL_SOCKET,
-                  SO_TIMESTAMP,
-                  &temp,
-                  sizeof(int)
-                 ) < 0
-    || setsockopt(netPath->generalSock,
-                  SOL_SOCKET,
-                  SO_TIMESTAMP,
-                  &temp,
-                  sizeof(int)
-                 ) < 0
+  if(  !netEnableRxTimestamps(netPath->eventSock)
+    || !netEnableRxTimestamps(netPath->generalSock)
     )
   {
     PERROR("netInit: failed to enable receive time stamps");
     return FALSE;
   }
 
+#if defined(linux) && defined(SO_TIMESTAMPING) && !defined(CONFIG_MPC831X)
+  netPreferHwStamps = FALSE;
+  netHwTxStamps     = FALSE;
+  if (clockIsPhc())
+  {
+    /* software stamps (and the multicast loopback used without
+     * transmit stamps) are in system time, which the servo would then
+     * compare with the PHC it steers, so both directions must be
+     * stamped by the NIC
+     */
+    if (!netEnableHwTimestamps(netPath, rtOpts) || !netHwTxStamps)
+    {
+      PERROR("netInit: no hardware receive and transmit time stamps on %s for clock %s\n",
+             netPath->ifName,
+             rtOpts->clockName
+            );
+      return FALSE;
+    }
+    netPreferHwStamps = TRUE;
+  }
+
+  /* With transmit stamps on the error queue the multicast loopback of
+   * sent event messages is not needed for their time stamps.  It stays
+   * on so other instances on this host receive them, handle() drops
+   * the copies of our own.
+   */
+  netPath->txStamps = netEnableTxTimestamps(netPath->eventSock);
+  if (!netPath->txStamps)
+  {
+    if (netPreferHwStamps)
+    {
+      PERROR("netInit: failed to enable hardware transmit time stamps on %s\n",
+             netPath->ifName
+            );
+      return FALSE;
+    }
+    DBG("netInit: no error queue transmit stamps, using multi-cast loopback\n");
+  }
+#endif
+
   if (rtOpts->ptp8021AS)
   {
-     if(  setsockopt(netPath->rawSock,
-                     SOL_SOCKET,
-                     SO_TIMESTAMP,
-                     &temp,
-                     sizeof(int)
-                    ) < 0
-       )
+     if(!netEnableRxTimestamps(netPath->rawSock))
      {
        PERROR("netInit: failed to enable raw socket time stamps");
        return FALSE;
@@ -1799,6 +2192,46 @@ Boolean netInit(NetPath *netPath, RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
 #endif /* #ifdef SW_LOOPBACK_TIMESTAMPING */
 
+#ifdef linux
+  /* Register receive sockets with the epoll readiness engine,
+   * creating it on first use
+   */
+  if(!netEpollCreate())
+  {
+    return FALSE;
+  }
+
+  if (netPath->portIndex >= netEpollPathCount)
+  {
+    paths = realloc(netEpollPaths, (netPath->portIndex + 1) * sizeof(NetPath *));
+    if (!paths)
+    {
+      PERROR("netInit: failed to grow epoll port table");
+      return FALSE;
+    }
+    memset(&paths[netEpollPathCount],
+           0,
+           (netPath->portIndex + 1 - netEpollPathCount) * sizeof(NetPath *)
+          );
+    netEpollPaths     = paths;
+    netEpollPathCount = netPath->portIndex + 1;
+  }
+
+  if(   !netEpollAdd(netPath->eventSock,   netPath->portIndex, NET_EVENT_SOCK_READY)
+     || !netEpollAdd(netPath->generalSock, netPath->portIndex, NET_GENERAL_SOCK_READY)
+     || (   netPath->rawSock > 0
+         && !netEpollAdd(netPath->rawSock, netPath->portIndex, NET_RAW_SOCK_READY)
+        )
+    )
+  {
+    PERROR("netInit: failed to register sockets for port index %d",
+           netPath->portIndex
+          );
+    return FALSE;
+  }
+  netEpollPaths[netPath->portIndex] = netPath;
+#endif
+
   return TRUE;
 }
 
@@ -1853,6 +2286,20 @@ Boolean netShutdown(NetPath *netPath)
 
   // Remove 802.1AS PTP multicast address
 
+#ifdef linux
+  // Remove sockets from the epoll readiness engine before closing
+
+  netEpollDel(netPath->eventSock);
+  netEpollDel(netPath->generalSock);
+  netEpollDel(netPath->rawSock);
+  if(netPath->portIndex < netEpollPathCount && netEpollPaths[netPath->portIndex] == netPath)
+  {
+    netEpollPaths[netPath->portIndex] = 0;
+  }
+#endif
+  netPath->readySockets = 0;
+  netPath->txStamps     = FALSE;
+
   // Close sockets if not already closed
   
   if(netPath->eventSock > 0)
@@ -1927,25 +2374,59 @@ Boolean netShutdown(NetPath *netPath)
   return TRUE;
 }
 
+#ifndef linux
+/** Function to limit a select() timeout to the earliest protocol timer
+ * deadline (see timerArm), as there is no timer fd to wake up on
+ *
+ * @return Returns the timeout pointer to use (may be NULL to block)
+ */
+static TimeInternal *netTimerClip(TimeInternal *timeout,   /**< Requested timeout or NULL */
+                                  TimeInternal *timer_wait /**< Storage for clipped timeout */
+                                 )
+{
+  if(!timerWaitTime(timer_wait))
+    return timeout;
+  if(   timeout
+     && (   timeout->seconds < timer_wait->seconds
+         || (   timeout->seconds == timer_wait->seconds
+             && timeout->nanoseconds < timer_wait->nanoseconds
+            )
+        )
+    )
+    return timeout;
+  return timer_wait;
+}
+#endif
+
 /**
  * @fn netSelect
  *
  * Function to check multiple sockets on a single port if anything is ready to receive
- * with an optional time to wait for event 
+ * with an optional time to wait for event.  Ready sockets are reported by
+ * setting NET_xxx_SOCK_READY flags in netPath->readySockets.
+ *
+ * On linux this waits on the persistent epoll instance, which covers all
+ * registered ports (only one in single port operation).
  *
  *@note This is still a work in progress for supporting Windows/winsock
  */
 int netSelect(TimeInternal *timeout, NetPath *netPath)
 {
+#ifdef linux
+  return netEpollWait(timeout);
+#else
   int    ret;
   SOCKET nfds;
   fd_set readfds;
   struct timeval tv, *tv_ptr;
+  TimeInternal timer_wait;
   
   if(timeout < 0) /* Make sure we have a non-negative timeout */
   {
     return FALSE;
   }
+
+  timeout = netTimerClip(timeout, &timer_wait);
   
   /* Setup fd_set structure for select function */
 
@@ -2050,22 +2531,39 @@ int netSelect(TimeInternal *timeout, NetPath *netPath)
     }
     DBG("netSelect: unexpected errno: %d, select returns %d\n", errno, ret);
   }
+  else if(ret > 0)
+  {
+    /* Report which sockets are ready so handle() only reads those */
+    if(netPath->eventSock != -1 && FD_ISSET(netPath->eventSock, &readfds))
+      netPath->readySockets |= NET_EVENT_SOCK_READY;
+    if(netPath->generalSock != -1 && FD_ISSET(netPath->generalSock, &readfds))
+      netPath->readySockets |= NET_GENERAL_SOCK_READY;
+    if(netPath->rawSock != -1 && FD_ISSET(netPath->rawSock, &readfds))
+      netPath->readySockets |= NET_RAW_SOCK_READY;
+  }
   DBGV("netSelect: return: %d\n",ret);  
   return ret;
+#endif /* linux */
 }
 
 /**
  * @fn netSelectAll
  *
  * Function to check multiple sockets on all ports if anything is ready to receive
- * with an optional time to wait for event 
+ * with an optional time to wait for event.  Ready sockets are reported by
+ * setting NET_xxx_SOCK_READY flags in each port's netPath.readySockets.
  */
 
 int netSelectAll(TimeInternal *timeout, PtpClock *ptpClock)
 {
+#ifdef linux
+  return netEpollWait(timeout);
+#else
   int ret, nfds;
+  PtpClock *firstPtpClock = ptpClock;
   fd_set readfds;
   struct timeval tv, *tv_ptr;
+  TimeInternal timer_wait;
   int i;
 
   
@@ -2074,6 +2572,8 @@ int netSelectAll(TimeInternal *timeout, PtpClock *ptpClock)
     return FALSE;
   }
 
+  timeout = netTimerClip(timeout, &timer_wait);
+
   /* Setup fd_set structure for select function */
   /* Loop through all ports, to get receive sockets */
   /* Find highest Number Socket for select() function */
@@ -2081,7 +2581,7 @@ int netSelectAll(TimeInternal *timeout, PtpClock *ptpClock)
   FD_ZERO(&readfds);
   nfds = 0;
 
-  for (i=0; i<MAX_PTP_PORTS; i++)
+  for (i=0; i<firstPtpClock->number_ports; i++)
   {
     if  (ptpClock->netPath.eventSock != -1)
     {
@@ -2173,8 +2673,24 @@ int netSelectAll(TimeInternal *timeout, PtpClock *ptpClock)
     }
     DBG("netSelectAll: unexpected errno: %d, select returns %d\n",errno, ret); 
   }
+  else if(ret > 0)
+  {
+    /* Report which sockets are ready on each port so handle() only reads those */
+    ptpClock = firstPtpClock;
+    for (i=0; i<firstPtpClock->number_ports; i++)
+    {
+      if(ptpClock->netPath.eventSock != -1 && FD_ISSET(ptpClock->netPath.eventSock, &readfds))
+        ptpClock->netPath.readySockets |= NET_EVENT_SOCK_READY;
+      if(ptpClock->netPath.generalSock != -1 && FD_ISSET(ptpClock->netPath.generalSock, &readfds))
+        ptpClock->netPath.readySockets |= NET_GENERAL_SOCK_READY;
+      if(ptpClock->netPath.rawSock != -1 && FD_ISSET(ptpClock->netPath.rawSock, &readfds))
+        ptpClock->netPath.readySockets |= NET_RAW_SOCK_READY;
+      ptpClock++;
+    }
+  }
   DBGV("netSelectAll: return: %d\n",ret);  
   return ret;
+#endif /* linux */
 }
 
 #ifdef __WINDOWS__
@@ -2216,6 +2732,116 @@ int netRecvSocketCheck(SOCKET sd)
 }
 #endif
 
+/**
+ * Function to get the receive time stamp of a message from the ancillary
+ * (control) data returned by recvmsg() or recvmmsg()
+ *
+ * @return Returns TRUE if a usable time stamp was found, otherwise FALSE
+ */
+static Boolean netGetRxTimestamp(struct msghdr *msg,  /**< Received message header */
+                                 TimeInternal  *time  /**< Receive time stamp (returned) */
+                                )
+{
+#ifdef SOCKET_TIMESTAMPING
+  struct cmsghdr *cmsg;
+  struct timeval *tv;
+  struct timespec *ts;
+  Boolean found;
+
+  /* get time stamp of packet */
+  if(!time)
+  {
+    PERROR("netGetRxTimestamp: null time stamp argument\n");
+    return FALSE;
+  }
+  
+  if(msg->msg_flags&MSG_CTRUNC)
+  {
+    PERROR("netGetRxTimestamp: truncated ancillary data\n");
+    return FALSE;
+  }
+  
+  if(msg->msg_controllen < CMSG_LEN(sizeof(struct timeval)))
+  {
+    PERROR("netGetRxTimestamp: short ancillary data (%d/%d)\n",
+      (int)msg->msg_controllen, (int)CMSG_LEN(sizeof(struct timeval)));
+    
+    return FALSE;
+  }
+
+  found = FALSE;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL && !found; cmsg = CMSG_NXTHDR(msg, cmsg))
+  {
+    if (cmsg->cmsg_level != SOL_SOCKET)
+      continue;
+
+    switch (cmsg->cmsg_type)
+    {
+#if defined(linux) && defined(SO_TIMESTAMPING)
+    case SCM_TIMESTAMPING:
+      /* ts[0] is the software stamp, ts[2] the raw hardware stamp.
+       * Only the hardware stamp is used when disciplining a PHC (it
+       * is in PHC time, the software one in system time), otherwise
+       * the software stamp, falling back to the hardware one
+       */
+      ts = (struct timespec *)CMSG_DATA(cmsg);
+#ifndef CONFIG_MPC831X
+      if (netPreferHwStamps)
+        ts += 2;
+      else
+#endif
+      if (ts[0].tv_sec == 0 && ts[0].tv_nsec == 0)
+        ts += 2;
+      if (ts->tv_sec != 0 || ts->tv_nsec != 0)
+      {
+        time->seconds     = ts->tv_sec;
+        time->nanoseconds = ts->tv_nsec;
+        found = TRUE;
+      }
+      break;
+#endif
+#if defined(linux) && defined(SO_TIMESTAMPNS)
+    case SCM_TIMESTAMPNS:
+      ts = (struct timespec *)CMSG_DATA(cmsg);
+      time->seconds     = ts->tv_sec;
+      time->nanoseconds = ts->tv_nsec;
+      found = TRUE;
+      break;
+#endif
+    case SCM_TIMESTAMP:
+      tv = (struct timeval *)CMSG_DATA(cmsg);
+      time->seconds     = tv->tv_sec;
+      time->nanoseconds = tv->tv_usec*1000;
+      found = TRUE;
+      break;
+    }
+  }
+
+  if(found)
+  {
+#ifdef CONFIG_MPC831X
+    /* Time is gotten later in protocol.c when the frame is parsed to get sequence number
+     * and frame type.  This is because the newer Ethernet driver from Freescale
+     * now has a queue for both and when you get the timestamp, you pass the message
+     * type and sequence number for which you want to get the timestamp.
+     *
+     * As this is now done in protocol.c, we'll just return 0 in the timestamp.
+     * This also allows us to not have to pass the state in this call.
+     */
+    time->seconds     = 0;
+    time->nanoseconds = 0;
+#else
+    DBGV("netGetRxTimestamp: recv time stamp %us %dns\n", time->seconds, time->nanoseconds);
+#endif
+    return TRUE;
+  }
+#endif /* SOCKET_TIMESTAMPING */
+
+  DBG("netGetRxTimestamp: no receive time stamp\n");
+  return FALSE;
+}
+
 /** Function to receive a PTP event messsage */
 ssize_t netRecvEvent(Octet *buf, 
                      TimeInternal *time,
@@ -2230,24 +2856,16 @@ ssize_t netRecvEvent(Octet *buf,
 #ifdef SOCKET_TIMESTAMPING
   union {
       struct cmsghdr cm;
-      char control[CMSG_SPACE(sizeof(struct timeval))];
+      char control[NET_RX_CONTROL_SIZE];
   } cmsg_un;
-  struct cmsghdr *cmsg;
 #endif
 
-  struct timeval *tv;
-  
   vec[0].iov_base = buf;
   vec[0].iov_len  = PACKET_SIZE;
   
-  memset(&msg,       0, sizeof(msg));
-  memset(&from_addr, 0, sizeof(from_addr));
-  memset(buf,        0, PACKET_SIZE);
-
-#ifdef SOCKET_TIMESTAMPING
-  memset(&cmsg_un,   0, sizeof(cmsg_un));
-#endif
-
+  /* The buffers are not cleared: every msghdr field is set below and
+   * handleMessage() checks the received length before any parser reads
+   */
 #ifdef __WINDOWS__
   msg.msg_name       = &from_addr;
 #else
@@ -2260,6 +2878,9 @@ ssize_t netRecvEvent(Octet *buf,
 #ifdef SOCKET_TIMESTAMPING
   msg.msg_control    = cmsg_un.control;
   msg.msg_controllen = sizeof(cmsg_un.control);
+#else
+  msg.msg_control    = NULL;
+  msg.msg_controllen = 0;
 #endif
   msg.msg_flags = 0;
 
@@ -2327,111 +2948,335 @@ ssize_t netRecvEvent(Octet *buf,
   }
 #endif
 
-#ifdef SOCKET_TIMESTAMPING
-  /* get time stamp of packet */
-  if(!time)
+  if(!netGetRxTimestamp(&msg, time))
   {
-    PERROR("netRecvEvent:   null time stamp argument\n");
-    return 0;
-  }
-  
-  if(msg.msg_flags&MSG_CTRUNC)
-  {
-    PERROR("netRecvEvent:   truncated ancillary data\n");
+    /* do not try to get by with recording the time here, better to fail
+       because the time recorded could be well after the message receive,
+       which would put a big spike in the offset signal sent to the clock servo */
     return 0;
   }
-  
-  if(msg.msg_controllen < sizeof(cmsg_un.control))
+
+  DBGV("netRecvEvent:   %s length: %d\n",
+       netPath->ifName,
+       ret
+      );
+
+  /* Temp for debug: dump hex data *
+
+  int i;
+#ifdef DBGM_ENABLED
+  if ((debugLevel & 4) == 4 )
   {
-    PERROR("netRecvEvent:   short ancillary data (%d/%d)\n",
-      msg.msg_controllen, (int)sizeof(cmsg_un.control));
-    
-    return 0;
+    for (i=0; i<ret; i++)
+    {
+      if (i % 16 == 0)
+      {
+         fprintf(stderr, "\nnetRecvEvent:   ");
+         fprintf(stderr, "%4.4x:", i);
+      }
+      fprintf(stderr, " %2.2x", buf[i]);
+    }
+    fprintf(stderr,"\n\n");
   }
 #endif
-  
-  tv = 0;
+  * */
 
-#ifdef SOCKET_TIMESTAMPING
-  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
-  {
-    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP)
-      tv = (struct timeval *)CMSG_DATA(cmsg);
+  return ret;
+}
+
+#if defined(linux) && defined(SO_TIMESTAMPING) && !defined(CONFIG_MPC831X)
+/**
+ * Function to find the PTP message in a frame looped back on the error
+ * queue.  Depending on the driver the frame starts at the link or at
+ * the IP header, the PTP message is the UDP payload.
+ *
+ * @return Returns offset of the PTP message or -1 if not found
+ */
+static ssize_t netTxStampPayload(UInteger8  *frame,  /**< Looped back frame */
+                                 ssize_t     length, /**< Frame length */
+                                 ssize_t    *ptpLen  /**< PTP message length (returned) */
+                                )
+{
+  ssize_t    offset = 0;
+  UInteger16 type;
+  UInteger16 udpLen;
+
+  if(length > 0 && (frame[0] >> 4) != 4)
+  {
+    /* Link layer header, with optional VLAN tag */
+    if(length < 14)
+      return -1;
+    type   = (frame[12] << 8) | frame[13];
+    offset = 14;
+    if(type == 0x8100 && length >= 18)
+    {
+      type    = (frame[16] << 8) | frame[17];
+      offset += 4;
+    }
+    if(type != 0x0800)
+      return -1;
   }
+
+  /* IPv4 header, then the UDP header */
+  if(   length < offset + 20
+     || (frame[offset] >> 4) != 4
+     || frame[offset + 9] != IPPROTO_UDP
+    )
+    return -1;
+  offset += (frame[offset] & 0x0F) * 4;
+
+  if(length < offset + 8)
+    return -1;
+  udpLen  = (frame[offset + 4] << 8) | frame[offset + 5];
+  offset += 8;
+
+  if(udpLen < 8 || offset + udpLen - 8 > length)
+    return -1;
+  *ptpLen = udpLen - 8;
+  return offset;
+}
 #endif
 
-  if(tv)
-#ifdef CONFIG_MPC831X
-  {
+/**
+ * Function to receive one sent PTP event message looped back on the
+ * event socket error queue together with its transmit time stamp.
+ * The PTP message is copied to buf, so it can be dispatched like any
+ * message that is from self.
+ *
+ * @return Returns message length, 0 if the error queue is empty or
+ *         holds no usable stamp, negative on socket error
+ */
+ssize_t netRecvTxStamp(Octet        *buf,     /**< Buffer for the sent PTP message */
+                       TimeInternal *time,    /**< Transmit time stamp (returned) */
+                       NetPath      *netPath  /**< Network path of the port */
+                      )
+{
+#if defined(linux) && defined(SO_TIMESTAMPING) && !defined(CONFIG_MPC831X)
+  ssize_t                   ret;
+  ssize_t                   offset;
+  ssize_t                   length;
+  struct msghdr             msg;
+  struct iovec              vec[1];
+  struct cmsghdr           *cmsg;
+  struct sock_extended_err *err;
+  Boolean                   isStamp;
+  UInteger8                 frame[PACKET_SIZE + NET_TX_HEADER_SPACE];
+  union {
+      struct cmsghdr cm;
+      char control[NET_TX_CONTROL_SIZE];
+  } cmsg_un;
 
-/*  Original code from Freescale patch for versions prior to 2007-08-27 versions
+  vec[0].iov_base    = frame;
+  vec[0].iov_len     = sizeof(frame);
 
-    if (port_state == PTP_MASTER)
-    {
-      mpc831x_get_tx_time(time);
-      DBGV("netRecvEvent:   HW tx time %9.9us %9.9dns\n", time->seconds, time->nanoseconds);
-    }
-    else
+  msg.msg_name       = NULL;
+  msg.msg_namelen    = 0;
+  msg.msg_iov        = vec;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = cmsg_un.control;
+  msg.msg_controllen = sizeof(cmsg_un.control);
+  msg.msg_flags      = 0;
+
+  ret = recvmsg(netPath->eventSock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+  if(ret < 0)
+  {
+    if(errno == EAGAIN || errno == EINTR)
+      return 0;
+    return ret;
+  }
+
+  /* Only entries from the time stamping code are of interest */
+  isStamp = FALSE;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
     {
-      mpc831x_get_rx_time(time);
-      DBGV("netRecvEvent:   HW rx time %9.9us %9.9dns\n", time->seconds, time->nanoseconds);
+      err     = (struct sock_extended_err *)CMSG_DATA(cmsg);
+      isStamp = (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING);
     }
-*/
-
-    /* Time is gotten later in protocol.c when the frame is parsed to get sequence number
-     * and frame type.  This is because the newer Ethernet driver from Freescale
-     * now has a queue for both and when you get the timestamp, you pass the message
-     * type and sequence number for which you want to get the timestamp.
-     *
-     * As this is now done in protocol.c, we'll just return 0 in the timestamp.
-     * This also allows us to not have to pass the state in this call.
-     */
-    time->seconds     = 0;
-    time->nanoseconds = 0;
   }
-#else
+  if(!isStamp || (msg.msg_flags & MSG_TRUNC))
   {
-    time->seconds     = tv->tv_sec;
-    time->nanoseconds = tv->tv_usec*1000;
-    DBGV("netRecvEvent:   recv time stamp %us %dns\n", time->seconds, time->nanoseconds);
+    DBG("netRecvTxStamp: %s unexpected error queue entry\n", netPath->ifName);
+    return 0;
   }
-#endif
-  else
+
+  if(!netGetRxTimestamp(&msg, time))
   {
-    /* do not try to get by with recording the time here, better to fail
-       because the time recorded could be well after the message receive,
-       which would put a big spike in the offset signal sent to the clock servo */
-    DBG("netRecvEvent:   no receive time stamp\n");
     return 0;
   }
 
-  DBGV("netRecvEvent:   %s length: %d\n",
+  offset = netTxStampPayload(frame, ret, &length);
+  if(offset < 0 || length > PACKET_SIZE)
+  {
+    DBG("netRecvTxStamp: %s no PTP message in %d byte frame\n",
+        netPath->ifName,
+        (int)ret
+       );
+    return 0;
+  }
+  memcpy(buf, frame + offset, length);
+
+  DBGV("netRecvTxStamp: %s length: %d, sent %us %dns\n",
        netPath->ifName,
-       ret
+       (int)length,
+       time->seconds,
+       time->nanoseconds
       );
+  return length;
+#else
+  return 0;
+#endif
+}
 
-  /* Temp for debug: dump hex data *
+#ifdef linux
+/**
+ * Function to drain up to NET_RX_BATCH datagrams from a socket with a
+ * single recvmmsg() call.  Messages are received directly into the
+ * preallocated buffers of the receive ring (at the same payload offset
+ * as inputBuffer) together with their receive time stamps.
+ *
+ * @return Returns number of ring slots filled, 0 if nothing was
+ *         available or negative on socket error
+ */
+static int netRecvBatch(NetRxRing  *ring,        /**< Receive ring to fill */
+                        SOCKET      sock,        /**< Socket to read */
+                        Boolean     timestamped, /**< TRUE to require a receive time stamp */
+                        const char *caller       /**< Caller name for debug messages */
+                       )
+{
+  struct mmsghdr     msgs[NET_RX_BATCH];
+  struct iovec       vec[NET_RX_BATCH];
+  struct sockaddr_in from_addr[NET_RX_BATCH];
+  union {
+      struct cmsghdr cm;
+      char control[NET_RX_CONTROL_SIZE];
+  } cmsg_un[NET_RX_BATCH];
+  NetRxSlot *        slot;
+  int                ret, i;
 
-  int i;
-#ifdef DBGM_ENABLED
-  if ((debugLevel & 4) == 4 )
+  ring->count = 0;
+  ring->next  = 0;
+
+  /* recvmmsg() updates the name and control lengths, so the headers
+   * are set up on every call.  The ring buffers themselves are not
+   * cleared, only the received length of each slot is used.
+   */
+  for(i = 0; i < NET_RX_BATCH; i++)
   {
-    for (i=0; i<ret; i++)
+    vec[i].iov_base                 = &ring->slot[i].buffer[16];
+    vec[i].iov_len                  = PACKET_SIZE;
+    msgs[i].msg_hdr.msg_name        = &from_addr[i];
+    msgs[i].msg_hdr.msg_namelen     = sizeof(from_addr[i]);
+    msgs[i].msg_hdr.msg_iov         = &vec[i];
+    msgs[i].msg_hdr.msg_iovlen      = 1;
+    msgs[i].msg_hdr.msg_control     = timestamped ? cmsg_un[i].control : 0;
+    msgs[i].msg_hdr.msg_controllen  = timestamped ? sizeof(cmsg_un[i].control) : 0;
+    msgs[i].msg_hdr.msg_flags       = 0;
+    msgs[i].msg_len                 = 0;
+  }
+
+  ret = recvmmsg(sock, msgs, NET_RX_BATCH, MSG_DONTWAIT, 0);
+
+  if(ret <= 0)
+  {
+    if(ret == 0 || errno == EAGAIN || errno == EINTR)
     {
-      if (i % 16 == 0)
+      DBGV("%s: No message (EAGAIN or EINTR)\n", caller);
+      return 0;
+    }
+    DBGV("%s: recvmmsg error : %d\n", caller, ret);
+    return ret;
+  }
+
+  for(i = 0; i < ret; i++)
+  {
+    slot         = &ring->slot[i];
+    slot->length = msgs[i].msg_len;
+
+    if(msgs[i].msg_hdr.msg_flags&MSG_TRUNC)
+    {
+      PERROR("%s: received truncated message\n", caller);
+      slot->length = 0;
+    }
+    else if(timestamped)
+    {
+      if(!netGetRxTimestamp(&msgs[i].msg_hdr, &slot->time))
       {
-         fprintf(stderr, "\nnetRecvEvent:   ");
-         fprintf(stderr, "%4.4x:", i);
+        /* No usable receive time stamp, drop message as for netRecvEvent() */
+        slot->length = 0;
       }
-      fprintf(stderr, " %2.2x", buf[i]);
     }
-    fprintf(stderr,"\n\n");
+    else
+    {
+      clearTime(&slot->time);
+    }
+  }
+
+  ring->count = ret;
+  DBGV("%s: received %d messages\n", caller, ret);
+  return ret;
+}
+#endif /* linux */
+
+/**
+ * Function to receive a batch of PTP event messages and their receive
+ * time stamps into a receive ring
+ *
+ * @return Returns number of ring slots filled, 0 if nothing was
+ *         available or negative on socket error
+ */
+int netRecvEventBatch(NetRxRing *ring,   /**< Receive ring to fill */
+                      NetPath   *netPath /**< Network path of the port */
+                     )
+{
+#ifdef linux
+  return netRecvBatch(ring, netPath->eventSock, TRUE, "netRecvEventBatch");
+#else
+  ssize_t ret;
+
+  /* No recvmmsg(), fall back to a single message per call */
+  ring->count = 0;
+  ring->next  = 0;
+  ret = netRecvEvent(&ring->slot[0].buffer[16], &ring->slot[0].time, netPath);
+  if(ret > 0)
+  {
+    ring->slot[0].length = ret;
+    ring->count          = 1;
   }
+  return ret;
 #endif
-  * */
+}
 
+/**
+ * Function to receive a batch of PTP general messages into a receive ring
+ *
+ * @return Returns number of ring slots filled, 0 if nothing was
+ *         available or negative on socket error
+ */
+int netRecvGeneralBatch(NetRxRing *ring,   /**< Receive ring to fill */
+                        NetPath   *netPath /**< Network path of the port */
+                       )
+{
+#ifdef linux
+  return netRecvBatch(ring, netPath->generalSock, FALSE, "netRecvGeneralBatch");
+#else
+  ssize_t ret;
+
+  /* No recvmmsg(), fall back to a single message per call */
+  ring->count = 0;
+  ring->next  = 0;
+  ret = netRecvGeneral(&ring->slot[0].buffer[16], netPath);
+  if(ret > 0)
+  {
+    ring->slot[0].length = ret;
+    clearTime(&ring->slot[0].time);
+    ring->count          = 1;
+  }
   return ret;
+#endif
 }
+
 /** Function to receive a PTP General message */
 ssize_t netRecvGeneral(Octet *buf, NetPath *netPath)
 {
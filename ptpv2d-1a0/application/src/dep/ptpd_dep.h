@@ -64,6 +64,9 @@
 #include<stdlib.h>
 #include<stdio.h>
 #include<string.h>
+#include<stddef.h>
+#include<limits.h>
+#include<math.h>
 
 #ifndef __WINDOWS__
 #include<unistd.h>
@@ -84,9 +87,23 @@
 #include<arpa/inet.h>
 #endif
 
-/* System configuration info */
+#ifdef linux
+#include<sys/epoll.h>
+#include<sys/timerfd.h>
+#include<linux/net_tstamp.h>
+#include<linux/errqueue.h>
+#include<linux/sockios.h>
+#endif
+
+#ifndef __WINDOWS__
+#include<pthread.h>
+#include<sched.h>
+#endif
 
-#define MAX_PTP_PORTS 1
+/* Event loop state (epoll set, timer heap) belongs to the thread running
+ * the loop, so each port thread (-T option) has its own
+ */
+#define PTPD_THREAD_LOCAL __thread
 
 /* system messages */
 
@@ -170,6 +187,89 @@ static inline Integer32 flip32(x)
 #define setFlag(x,y)    ( *(UInteger8*)((x)+((y)<8?1:0)) |=   1<<((y)<8?(y):(y)-8)  )
 #define clearFlag(x,y)  ( *(UInteger8*)((x)+((y)<8?1:0)) &= ~(1<<((y)<8?(y):(y)-8)) )
 
+/* Zero-copy message view accessors. Each field is decoded straight from
+ * the receive buffer when it is read. Reads that would run past the
+ * received length return zero (or FALSE/NULL) instead of touching memory
+ * beyond the message.
+ */
+static inline void msgViewInit(MsgView *view, const void *buf, Integer32 length)
+{
+  view->buf    = (const UInteger8*)buf;
+  view->length = length;
+}
+
+static inline Boolean msgViewHas(const MsgView *view, Integer32 offset, Integer32 size)
+{
+  return offset >= 0 && size >= 0 && offset <= view->length - size;
+}
+
+static inline UInteger8 msgViewU8(const MsgView *view, Integer32 offset)
+{
+  return msgViewHas(view, offset, 1) ? view->buf[offset] : 0;
+}
+
+static inline UInteger16 msgViewU16(const MsgView *view, Integer32 offset)
+{
+  UInteger16 x;
+
+  if (!msgViewHas(view, offset, 2))
+    return 0;
+  memcpy(&x, view->buf + offset, 2);  /* fields are not always aligned */
+  return flip16(x);
+}
+
+static inline UInteger32 msgViewU32(const MsgView *view, Integer32 offset)
+{
+  UInteger32 x;
+
+  if (!msgViewHas(view, offset, 4))
+    return 0;
+  memcpy(&x, view->buf + offset, 4);
+  return flip32(x);
+}
+
+static inline UInteger64 msgViewU64(const MsgView *view, Integer32 offset)
+{
+  if (!msgViewHas(view, offset, 8))
+    return 0;
+  return ((UInteger64)msgViewU32(view, offset) << 32) | msgViewU32(view, offset + 4);
+}
+
+/** Pointer to size raw octets at offset, or NULL if out of range */
+static inline const UInteger8 *msgViewOctets(const MsgView *view, Integer32 offset, Integer32 size)
+{
+  return msgViewHas(view, offset, size) ? view->buf + offset : NULL;
+}
+
+/** Decode a 10 octet V2 timestamp at offset */
+static inline Boolean msgViewV2Timestamp(const MsgView *view, Integer32 offset,
+                                         V2TimeRepresentation *timestamp)
+{
+  if (!msgViewHas(view, offset, 10))
+    return FALSE;
+  timestamp->epoch_number = msgViewU16(view, offset);
+  timestamp->seconds      = msgViewU32(view, offset + 2);
+  timestamp->nanoseconds  = (Integer32)msgViewU32(view, offset + 6);
+  return TRUE;
+}
+
+/** Compare a 10 octet V2 port identity at offset without copying it out */
+static inline Boolean msgViewPortIdentityIs(const MsgView *view, Integer32 offset,
+                                            const Octet *clockIdentity, UInteger16 portNumber)
+{
+  return msgViewHas(view, offset, 10)
+      && msgViewU16(view, offset + 8) == portNumber
+      && !memcmp(view->buf + offset, clockIdentity, 8);
+}
+
+/* V2 header fields */
+#define msgViewV2MessageType(v)       (msgViewU8((v), V2_MESSAGE_TYPE_OFFSET) & 0x0F)
+#define msgViewV2TransportSpecific(v) (msgViewU8((v), V2_MESSAGE_TYPE_OFFSET) >> 4)
+#define msgViewV2Flags0(v)            msgViewU8((v), V2_FLAGS_OFFSET)
+#define msgViewV2Correction(v)        ((Integer64)msgViewU64((v), V2_CORRECTION_OFFSET))
+#define msgViewV2SequenceId(v)        msgViewU16((v), V2_SEQUENCE_ID_OFFSET)
+#define msgViewV2SourcePortNumber(v)  msgViewU16((v), V2_SOURCE_PORT_ID_OFFSET + 8)
+
 
 /* msg.c */
 Boolean    msgPeek                   (void*,ssize_t);
@@ -256,35 +356,29 @@ Boolean netShutdown     (NetPath*);
 int     netSelect       (TimeInternal*,NetPath*);
 int     netSelectAll    (TimeInternal*, PtpClock*);           /* Added for multiple port support */
 ssize_t netRecvEvent    (Octet*,TimeInternal*,NetPath*);
+ssize_t netRecvTxStamp  (Octet*,TimeInternal*,NetPath*);      /* Looped back sent message and its transmit time */
 ssize_t netRecvGeneral  (Octet*,NetPath*);
 ssize_t netRecvRaw      (Octet*,NetPath*);                    /* Added for 802.1AS support */
+int     netRecvEventBatch  (NetRxRing*,NetPath*);               /* Batched receive into ring */
+int     netRecvGeneralBatch(NetRxRing*,NetPath*);
+#ifdef linux
+Boolean netRegisterTimer(int);
+#endif
 ssize_t netSendEvent    (Octet*,UInteger16,NetPath*,Boolean); /* Added Pdelay flag */
 ssize_t netSendGeneral  (Octet*,UInteger16,NetPath*,Boolean); /* Added Pdelay flag */
 ssize_t netSendRaw      (Octet*,UInteger16,NetPath*,Boolean); /* Added for 802.1AS and 1588 Annex F support */
 
 /* servo.c */
-void initClock(RunTimeOpts*,PtpClock*);
-
-void updatePathDelay(one_way_delay_filter *owd_filt,  // one way delay filter
-                     RunTimeOpts          *rtOpts,    // run time options
-                     PtpClock             *ptpClock   // PTP main data structure
-                    );
-
-void updateDelay(TimeInternal *         send_time, // Delay Req. sent by slave time
-                 TimeInternal *         recv_time, // Delay Req. received by master time
-                 one_way_delay_filter * owd_filt,  // one way delay filter
-                 RunTimeOpts *          rtOpts,    // run time options
-                 PtpClock *             ptpClock   // PTP main data structure
-                );
-
-void updateOffset(TimeInternal *              send_time,  // Sync message reported Transmit time
-                  TimeInternal *              recv_time,  // Sync message local    Receive  time
-                  offset_from_master_filter * ofm_filt,   // Offset from Master filter
-                  RunTimeOpts *               rtOpts,     // Run Time Options
-                  PtpClock *                  ptpClock    // PTP main data structure
-                 );
-
-void updateClock(RunTimeOpts*,PtpClock*);
+void initClock     (RunTimeOpts*,PtpClock*);
+void initClockPort (RunTimeOpts*,PtpClock*);
+void servoClearCurrent(RunTimeOpts*,PtpClock*);
+void servoStats    (RunTimeOpts*,PtpClock*);
+void servoSync     (TimeInternal*,TimeInternal*,UInteger16,RunTimeOpts*,PtpClock*);
+void servoDelay    (TimeInternal*,TimeInternal*,RunTimeOpts*,PtpClock*);
+void servoPathDelay(RunTimeOpts*,PtpClock*);
+void servoHoldover (RunTimeOpts*,PtpClock*);
+void servoDrain    (RunTimeOpts*,PtpClock*,PtpClock*);
+void servoWriteState(RunTimeOpts*,PtpClock*);
 
 /* startup.c */
 PtpClock * ptpdStartup(int,char**,Integer16*,RunTimeOpts*);
@@ -295,17 +389,31 @@ void       displayStats(RunTimeOpts*,PtpClock*);
 Boolean    nanoSleep(TimeInternal*);
 void       getTime(TimeInternal*, Integer16); // AKB: added UTC offset
 void       setTime(TimeInternal*, Integer16); // AKB: added UTC offset
+Boolean    stepTime(TimeInternal*);
 UInteger16 getRand(UInteger32*);
 Boolean    adjFreq(Integer32);
 void       setPtpTimeFromSystem(Integer16);
 void       setSystemTimeFromPtp(Integer16);
+Boolean    clockInit(RunTimeOpts*);
+void       clockShutdown(void);
+Boolean    clockIsPhc(void);
+
+/* thread.c */
+void       threadProtocol (RunTimeOpts*,PtpClock*);
+void       threadWakeServo(void);
+void       clockLock      (void);
+void       clockUnlock    (void);
 
 /* timer.c */
-void       initTimer   (Integer32,UInteger32);  // AKB: Changed from (void) to add secs and usecs
-void       timerUpdate (IntervalTimer*,int);    // AKB: Added port ID for multiple port support
+Boolean    initTimer   (Integer8);
+void       timerUpdate (void);
 void       timerStop   (UInteger16,IntervalTimer*);
-void       timerStart  (UInteger16,UInteger16,IntervalTimer*);
+void       timerStart  (UInteger16,UInteger32,IntervalTimer*);
 Boolean    timerExpired(UInteger16,IntervalTimer*,int);// AKB: add port ID for multi port support
+void       timerArm    (void);
+Boolean    timerWaitTime(TimeInternal*);
+Integer64  timerNow    (void);
+Integer64  timerNextDeadline(void);
 
 /* ledlib.c */
 /* Function to manipulate LEDs on MPC8313ERDB board, could
@@ -58,7 +58,83 @@
 
 #include "../ptpd.h"
 
-void initClockVars(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+/*
+ * The protocol engine does not run the servo itself, it only queues a
+ * Measurement (the time stamps and corrections of a completed Sync or
+ * delay exchange) on the port's MeasureQueue with servoPost().  The
+ * queue is drained by servoDrain(), which runs the filters, the servo
+ * and the statistics; in the main loop after the received messages are
+ * dispatched, or in the servo thread with port threads (-T).  So the
+ * filter state, offset, delays and drift of a port are only written by
+ * the consumer side.
+ */
+
+/** Function to empty the delay window, the count of rejected samples
+ * is kept for the statistics
+ */
+static void clearDelayWindow(delay_window *window)
+{
+  window->count      = 0;
+  window->next       = 0;
+  window->minq_head  = 0;
+  window->minq_tail  = 0;
+  window->reject_run = 0;
+}
+
+/**
+ * Function to put the servo in a lock state: empty the offset window
+ * and select the attenuations of the state
+ */
+static void servoSetState(RunTimeOpts *rtOpts,   /**< run time options */
+                          PtpClock    *ptpClock, /**< PTP main data structure */
+                          UInteger8    state     /**< SERVO_UNLOCKED, _ACQUIRING, _LOCKED or _HOLDOVER */
+                         )
+{
+  servo_supervisor *s = &ptpClock->supervisor;
+
+  /* no negative or zero attenuation */
+  if(rtOpts->ap < 1)
+    rtOpts->ap = 1;
+  if(rtOpts->ai < 1)
+    rtOpts->ai = 1;
+
+  s->state = state;
+  s->count = 0;
+  s->next  = 0;
+  s->ap    = rtOpts->ap;
+  s->ai    = rtOpts->ai;
+
+  if (rtOpts->fixedGains)
+    return;
+
+  /* widen the loop by the bandwidth ratio for each state below locked,
+   * dividing P by it and I by its square so the loop keeps its damping.
+   * P stays at 2 or more unless set lower, removing the whole offset at
+   * each Sync is too noisy.
+   */
+  if (state == SERVO_UNLOCKED || state == SERVO_ACQUIRING)
+  {
+    s->ap /= SERVO_GAIN_STEP;
+    s->ai /= SERVO_GAIN_STEP * SERVO_GAIN_STEP;
+    if (state == SERVO_UNLOCKED)
+    {
+      s->ap /= SERVO_GAIN_STEP;
+      s->ai /= SERVO_GAIN_STEP * SERVO_GAIN_STEP;
+    }
+    if (s->ap < 2)
+      s->ap = rtOpts->ap < 2 ? rtOpts->ap : 2;
+    if (s->ai < 1)
+      s->ai = 1;
+  }
+
+  DBG("servoSetState: state %d, attenuations P %d, I %d\n",
+      state,
+      s->ap,
+      s->ai
+     );
+}
+
+static void initClockVars(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
   DBG("initClockVars:\n");
   
@@ -66,26 +142,36 @@ void initClockVars(RunTimeOpts *rtOpts, PtpClock *ptpClock)
   clearTime(&ptpClock->master_to_slave_delay);
   clearTime(&ptpClock->slave_to_master_delay);
   clearTime(&ptpClock->offset_from_master);   /* AKB: 9/18/2007 Clear offset from master */
+  ptpClock->offset_from_master_scaled         = 0;
   ptpClock->ofm_filt.y                        = 0;
-  ptpClock->ofm_filt.nsec_prev                = -1; /* AKB: -1 used for non-valid nsec time */
+  ptpClock->ofm_filt.prev_valid               = FALSE;
 
-  ptpClock->observed_v1_variance = 0;
-  ptpClock->observed_drift       = 0;  /* clears clock servo accumulator (the I term) */
+  ptpClock->observed_v1_variance  = 0;
+  ptpClock->observed_drift        = 0;  /* clears clock servo accumulator (the I term) */
+  ptpClock->observed_drift_scaled = 0;
+  ptpClock->pi_last_t             = 0;
   ptpClock->owd_filt.s_exp       = 0;  /* clears one-way delay filter */
-  ptpClock->halfEpoch            = ptpClock->halfEpoch || rtOpts->halfEpoch;
-  rtOpts->halfEpoch              = 0;
+  clearDelayWindow(&ptpClock->owd_window);
+  servoSetState(rtOpts, ptpClock, SERVO_UNLOCKED);
+  memset(&ptpClock->linreg, 0, sizeof(linreg_servo));  /* empties regression window */
+  memset(&ptpClock->kalman, 0, sizeof(kalman_servo));
 }
 
-void initClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+/** Function to apply the half epoch option to a port on (re)start.
+ * halfEpoch belongs to the port, so this runs on the port's side of
+ * the queue; only the first port to start takes the option.
+ */
+static void initHalfEpoch(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
-  DBG("initClock:\n");
-  
-  /* clear vars */
-
-  initClockVars(rtOpts,ptpClock);
-  
-  /* level clock */
+  if (__atomic_exchange_n(&rtOpts->halfEpoch, FALSE, __ATOMIC_RELAXED))
+    ptpClock->halfEpoch = TRUE;
+}
 
+/** Function to level the clock, i.e. set the frequency adjustment
+ * back to its base value
+ */
+static void levelClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
   if(!rtOpts->noAdjust)
   {
     ptpClock->baseAdjustValue = rtOpts->baseAdjustValue;
@@ -97,119 +183,313 @@ void initClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
   }
 }
 
-void updatePathDelay(one_way_delay_filter *owd_filt,  /**< one way delay filter */
-                     RunTimeOpts          *rtOpts,    /**< run time options */
-                     PtpClock             *ptpClock   /**< PTP main data structure */
-                    )
+/**
+ * Function to queue a measurement for the servo.  A full queue drops
+ * the measurement, the servo catches up on the next one.
+ */
+static Boolean servoPost(Measurement *measurement, /**< Measurement to queue */
+                         RunTimeOpts *rtOpts,      /**< run time options */
+                         PtpClock    *ptpClock     /**< Port taking the measurement */
+                        )
 {
-  Integer16 s;
-  TimeInternal remote_time;
-  
-  
-  DBGV("updatePathDelay:\n");
+  MeasureQueue *queue = &ptpClock->measure_queue;
+  UInteger32    head  = queue->head;
 
-  DBGV(" t1 PDelay Req  Tx time %10.10ds.%9.9dns\n",
-       ptpClock->t1_pdelay_req_tx_time.seconds,
-       ptpClock->t1_pdelay_req_tx_time.nanoseconds
-      );
-  
-  DBGV(" t2 PDelay Req  Rx time %10.10ds.%9.9dns\n",
-       ptpClock->t2_pdelay_req_rx_time.seconds,
-       ptpClock->t2_pdelay_req_rx_time.nanoseconds
-      );
+  if (head - queue->tail_cache >= MEASURE_QUEUE_SIZE)
+  {
+    queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head - queue->tail_cache >= MEASURE_QUEUE_SIZE)
+    {
+      DBG("servoPost: queue of port %d full, measurement %d dropped\n",
+          ptpClock->port_id_field,
+          measurement->type
+         );
+      return FALSE;
+    }
+  }
 
-  DBGV(" t3 PDelay Resp Tx time %10.10ds.%9.9dns\n",
-       ptpClock->t3_pdelay_resp_tx_time.seconds,
-       ptpClock->t3_pdelay_resp_tx_time.nanoseconds
-      );
+  measurement->port_state         = ptpClock->port_state;
+  measurement->port_id_field      = ptpClock->port_id_field;
+  measurement->current_utc_offset = ptpClock->current_utc_offset;
+  queue->slot[head & (MEASURE_QUEUE_SIZE - 1)] = *measurement;
 
-  DBGV(" t4 PDelay Resp Rx time %10.10ds.%9.9dns\n",
-       ptpClock->t4_pdelay_resp_rx_time.seconds,
-       ptpClock->t4_pdelay_resp_rx_time.nanoseconds
-      );
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
 
-  DBGV(" PDelay Resp correction %10.10ds.%9.9dns\n",
-       ptpClock->pdelay_resp_correction.seconds,
-       ptpClock->pdelay_resp_correction.nanoseconds
-      );
+  if(rtOpts->portThreads)
+    threadWakeServo();
+  return TRUE;
+}
 
-  DBGV(" PDelay Resp follow up  %10.10ds.%9.9dns\n",
-       ptpClock->pdelay_followup_correction.seconds,
-       ptpClock->pdelay_followup_correction.nanoseconds
-      );
+/** Function to restart the servo: clear its variables and level the clock */
+void initClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  Measurement measurement = { MEASURE_RESET };
 
-  /* calc 'slave_to_master_delay' */
-  subTime(&ptpClock->one_way_delay,          // Result
-          &ptpClock->t4_pdelay_resp_rx_time, // PDelay Response Receive time
-          &ptpClock->t1_pdelay_req_tx_time   // minus PDelay Request Transmit time
-         );
+  DBG("initClock:\n");
+  initHalfEpoch(rtOpts, ptpClock);
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  DBGV(" (t4-t1)                %10.10ds.%9.9dns\n",
-       ptpClock->one_way_delay.seconds,
-       ptpClock->one_way_delay.nanoseconds
-      );
+/** Function to clear the filters of a port without touching the clock,
+ * for a port of a boundary clock whose other port is disciplining it
+ */
+void initClockPort(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  Measurement measurement = { MEASURE_CLEAR };
 
-  subTime(&remote_time,                      // Result
-          &ptpClock->t3_pdelay_resp_tx_time, // PDelay Resp Transmit time (from responder)
-          &ptpClock->t2_pdelay_req_rx_time   // minus PDelay Request Receive time (from responder)
-         );
+  DBG("initClockPort:\n");
+  initHalfEpoch(rtOpts, ptpClock);
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  DBGV(" (t3-t2)                %10.10ds.%9.9dns\n",
-       remote_time.seconds,
-       remote_time.nanoseconds
-      );
+/** Function to clear the offset from master and one way delay of a
+ * port (m1), which belong to the servo
+ */
+void servoClearCurrent(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  Measurement measurement = { MEASURE_CURRENT };
 
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  subTime(&ptpClock->one_way_delay,          // Result
-          &ptpClock->one_way_delay,          // (T4-T1)
-          &remote_time                       // minus (T3-T2)
-         );
+/** Function to have the servo display the statistics after a port
+ * state change, as they are mostly servo data
+ */
+void servoStats(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  Measurement measurement = { MEASURE_STATS };
 
-  DBGV(" (t4-t1)-(t3-t2)        %10.10ds.%9.9dns\n",
-       ptpClock->one_way_delay.seconds,
-       ptpClock->one_way_delay.nanoseconds
-      );
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  subTime(&ptpClock->one_way_delay,          // Result
-          &ptpClock->one_way_delay,          // Current Calculation
-          &ptpClock->pdelay_resp_correction // minus PDelay Resp Correction
-         );
+/** Function to queue the time stamps of a Sync (with its Follow_Up) */
+void servoSync(TimeInternal *send_time,   /**< Sync message reported Transmit time */
+               TimeInternal *recv_time,   /**< Sync message local    Receive  time */
+               UInteger16    sequenceId,  /**< Sync sequence id */
+               RunTimeOpts  *rtOpts,      /**< run time options */
+               PtpClock     *ptpClock     /**< PTP main data structure */
+              )
+{
+  Measurement measurement = { MEASURE_SYNC };
+
+  measurement.sequence_id = sequenceId;
+  copyTime(&measurement.t1, send_time);
+  copyTime(&measurement.t2, recv_time);
+  measurement.correction  = ptpClock->sync_correction
+                          + ptpClock->followup_correction;
+  if (rtOpts->ptpv2)
+    memcpy(measurement.parent_identity, ptpClock->parent_clock_identity, 8);
+  else
+    memcpy(measurement.parent_identity, ptpClock->parent_uuid, PTP_UUID_LENGTH);
+  measurement.parent_port_id = ptpClock->parent_port_id;
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  DBGV(" minus 1st correction   %10.10ds.%9.9dns\n",
-       ptpClock->one_way_delay.seconds,
-       ptpClock->one_way_delay.nanoseconds
-      );
+/** Function to queue the time stamps of a Delay_Req/Delay_Resp exchange */
+void servoDelay(TimeInternal *send_time,  /**< Delay Req. sent by slave time */
+                TimeInternal *recv_time,  /**< Delay Req. received by master time */
+                RunTimeOpts  *rtOpts,     /**< run time options */
+                PtpClock     *ptpClock    /**< PTP main data structure */
+               )
+{
+  Measurement measurement = { MEASURE_DELAY };
+
+  measurement.sequence_id = ptpClock->sentDelayReqSequenceId;
+  copyTime(&measurement.t3, send_time);
+  copyTime(&measurement.t4, recv_time);
+  measurement.correction  = ptpClock->delay_resp_correction;
+  servoPost(&measurement, rtOpts, ptpClock);
+}
+
+/** Function to queue the time stamps of a completed PDelay exchange and
+ * clear them for the next one
+ */
+void servoPathDelay(RunTimeOpts *rtOpts,   /**< run time options */
+                    PtpClock    *ptpClock  /**< PTP main data structure */
+                   )
+{
+  Measurement measurement = { MEASURE_PDELAY };
+
+  measurement.sequence_id         = ptpClock->sentDelayReqSequenceId;
+  copyTime(&measurement.t1, &ptpClock->t1_pdelay_req_tx_time);
+  copyTime(&measurement.t2, &ptpClock->t2_pdelay_req_rx_time);
+  copyTime(&measurement.t3, &ptpClock->t3_pdelay_resp_tx_time);
+  copyTime(&measurement.t4, &ptpClock->t4_pdelay_resp_rx_time);
+  measurement.correction          = ptpClock->pdelay_resp_correction;
+  measurement.followup_correction = ptpClock->pdelay_followup_correction;
+  servoPost(&measurement, rtOpts, ptpClock);
+
+  clearTime(&ptpClock->t1_pdelay_req_tx_time);
+  clearTime(&ptpClock->t2_pdelay_req_rx_time);
+  clearTime(&ptpClock->t3_pdelay_resp_tx_time);
+  clearTime(&ptpClock->t4_pdelay_resp_rx_time);
+  ptpClock->pdelay_resp_correction     = 0;
+  ptpClock->pdelay_followup_correction = 0;
+}
+
+/** Function to queue a holdover update, run every HOLDOVER_INTERVAL
+ * while the port has no master
+ */
+void servoHoldover(RunTimeOpts *rtOpts,   /**< run time options */
+                   PtpClock    *ptpClock  /**< PTP main data structure */
+                  )
+{
+  Measurement measurement = { MEASURE_HOLDOVER };
+
+  servoPost(&measurement, rtOpts, ptpClock);
+}
 
-  subTime(&ptpClock->one_way_delay,             // Result
-          &ptpClock->one_way_delay,             // Current Calculation
-          &ptpClock->pdelay_followup_correction // minus PDelay Resp Correction
+/** qsort() comparison of two delay samples */
+static int compareScaled(const void *a, const void *b)
+{
+  TimeScaled x = *(const TimeScaled *)a;
+  TimeScaled y = *(const TimeScaled *)b;
+
+  return (x > y) - (x < y);
+}
+
+/** Function to get the median of n samples, sorts the samples */
+static TimeScaled medianScaled(TimeScaled *v, int n)
+{
+  qsort(v, n, sizeof(TimeScaled), compareScaled);
+  return (n & 1) ? v[n/2] : v[n/2 - 1]/2 + v[n/2]/2;
+}
+
+/**
+ * Function to check a one way delay sample against the samples in the
+ * delay window.  The window is at most DELAY_WINDOW_MAX samples, so its
+ * median and median absolute deviation are found by sorting a copy.
+ * Checks start once the window holds DELAY_WINDOW_MIN_SAMPLES samples,
+ * or all of them for a smaller window.  A window of one exchange keeps
+ * every sample, as a rejected one would restart the window anyway.
+ *
+ * @return Returns TRUE if the sample is further than rtOpts->delayRejectMads
+ *         median absolute deviations from the median
+ */
+static Boolean delayOutlier(TimeScaled    delay,   /**< New one way delay sample (ns * 2^16) */
+                            delay_window *window,  /**< Delay window */
+                            RunTimeOpts  *rtOpts   /**< run time options */
+                           )
+{
+  TimeScaled v[DELAY_WINDOW_MAX];
+  TimeScaled median;
+  TimeScaled mad;
+  int        i;
+  int        needed = rtOpts->delayWindow < DELAY_WINDOW_MIN_SAMPLES
+                    ? rtOpts->delayWindow : DELAY_WINDOW_MIN_SAMPLES;
+
+  if (!rtOpts->delayRejectMads || needed < 2 || window->count < needed)
+    return FALSE;
+
+  memcpy(v, window->sample, window->count * sizeof(TimeScaled));
+  median = medianScaled(v, window->count);
+  for (i = 0; i < window->count; i++)
+    v[i] = llabs(v[i] - median);
+  mad = medianScaled(v, window->count);
+
+  /* Time stamp resolution makes the MAD of a quiet path near zero */
+  if (mad < DELAY_MAD_MIN)
+    mad = DELAY_MAD_MIN;
+
+  DBGV("delayOutlier: median %lld, MAD %lld (ns * 2^16)\n", median, mad);
+  return llabs(delay - median) > mad * rtOpts->delayRejectMads;
+}
+
+/**
+ * Function to filter a new one way delay sample with the windowed
+ * minimum filter (-W) and store the result in one_way_delay (and
+ * one_way_delay_scaled for offset calculations).  Outliers are counted
+ * and dropped; as many in a row as the window holds mean the path
+ * changed, so the window restarts from the new sample.
+ */
+static void filterDelayWindow(TimeScaled    delay,     /**< New one way delay sample (ns * 2^16) */
+                              delay_window *window,    /**< Delay window */
+                              RunTimeOpts  *rtOpts,    /**< run time options */
+                              PtpClock     *ptpClock   /**< PTP main data structure */
+                             )
+{
+  UInteger16 size = rtOpts->delayWindow;
+  UInteger32 back;
+
+  if (llabs(delay) >= (1000000000LL << 16))
+  {
+    DBG("filterDelayWindow: One way delay seconds != 0, sample dropped\n");
+    window->rejected++;
+    return;
+  }
+
+  if (delayOutlier(delay, window, rtOpts))
+  {
+    window->rejected++;
+    if (++window->reject_run < size)
+    {
+      DBG("filterDelayWindow: outlier %lld ns rejected (%u so far)\n",
+          scaledToNs(delay),
+          window->rejected
          );
+      return;
+    }
+    DBG("filterDelayWindow: %d outliers in a row, restarting delay window\n",
+        window->reject_run
+       );
+    clearDelayWindow(window);
+  }
+  window->reject_run = 0;
 
-  DBGV(" minus 2nd correction   %10.10ds.%9.9dns\n",
-       ptpClock->one_way_delay.seconds,
-       ptpClock->one_way_delay.nanoseconds
-      );
+  window->sample[window->next] = delay;
+  window->next = (window->next + 1) % size;
+  if (window->count < size)
+    window->count++;
+
+  /* Drop the front if it left the window, then every larger sample from
+   * the back, which can never be the minimum while the new one is in
+   * the window
+   */
+  if (   window->minq_head != window->minq_tail
+      && window->seq - window->minq_seq[window->minq_head % DELAY_WINDOW_MAX] >= size
+     )
+    window->minq_head++;
+  while (window->minq_tail != window->minq_head)
+  {
+    back = (window->minq_tail - 1) % DELAY_WINDOW_MAX;
+    if (window->minq_delay[back] < delay)
+      break;
+    window->minq_tail--;
+  }
+  window->minq_seq[window->minq_tail % DELAY_WINDOW_MAX]   = window->seq++;
+  window->minq_delay[window->minq_tail % DELAY_WINDOW_MAX] = delay;
+  window->minq_tail++;
 
-  halveTime(&ptpClock->one_way_delay);
+  ptpClock->one_way_delay_scaled = window->minq_delay[window->minq_head % DELAY_WINDOW_MAX];
+  nsToTime(&ptpClock->one_way_delay, scaledToNs(ptpClock->one_way_delay_scaled));
 
-  DBGV(" divided by 2           %10.10ds.%9.9dns\n",
-       ptpClock->one_way_delay.seconds,
-       ptpClock->one_way_delay.nanoseconds
+  DBGV("filterDelayWindow: sample %lld, window minimum %lld (ns * 2^16)\n",
+       delay,
+       ptpClock->one_way_delay_scaled
       );
+}
 
+/**
+ * Function to filter a new one way delay sample with the variable
+ * cutoff low pass filter and store the result in one_way_delay
+ * (and one_way_delay_scaled for offset calculations)
+ */
+static void filterOneWayDelay(TimeScaled             delay,     /**< New one way delay sample (ns * 2^16) */
+                              one_way_delay_filter * owd_filt,  /**< one way delay filter */
+                              RunTimeOpts *          rtOpts,    /**< run time options */
+                              PtpClock *             ptpClock   /**< PTP main data structure */
+                             )
+{
+  Integer16 s;
 
-  copyTime( &ptpClock->slave_to_master_delay, // Destination
-            &ptpClock->one_way_delay          // Source
-          );
+  if (rtOpts->delayWindow)
+  {
+    filterDelayWindow(delay, &ptpClock->owd_window, rtOpts, ptpClock);
+    return;
+  }
 
-  clearTime(&ptpClock->t1_pdelay_req_tx_time);
-  clearTime(&ptpClock->t2_pdelay_req_rx_time);
-  clearTime(&ptpClock->t3_pdelay_resp_tx_time);
-  clearTime(&ptpClock->t4_pdelay_resp_rx_time);
-  clearTime(&ptpClock->pdelay_resp_correction);
-  clearTime(&ptpClock->pdelay_followup_correction);
-  clearTime(&ptpClock->t1_sync_delta_time);
-  clearTime(&ptpClock->t2_sync_delta_time);  
+  ptpClock->one_way_delay_scaled = delay;
+  nsToTime(&ptpClock->one_way_delay, scaledToNs(delay));
 
   if(ptpClock->one_way_delay.seconds)       // Check if delay is larger than one second
   {
@@ -218,23 +498,23 @@ void updatePathDelay(one_way_delay_filter *owd_filt,  /**< one way delay filter
      * of previously received sent time of Sync message (usually from 
      * preciseOriginTimestamp of follow up message) and return
      */
-    DBG("updatePathDelay: One way delay seconds != 0\n");
-    DBG("updatePathDelay: Clearing one way delay filter s_exp, nsec_prev\n");
-    owd_filt->s_exp     = 0;
-    owd_filt->nsec_prev = 0;
+    DBG("filterOneWayDelay: One way delay seconds != 0\n");
+    DBG("filterOneWayDelay: Clearing one way delay filter s_exp, scaled_prev\n");
+    owd_filt->s_exp       = 0;
+    owd_filt->scaled_prev = 0;
     return;
   }
   
   /* avoid overflowing filter */
   s =  rtOpts->s;
-  while(abs(owd_filt->y)>>(31-s))
+  while(s > 0 && (llabs(owd_filt->y)>>(62-s)))
     --s;
 
-  DBGV("updatePathDelay: rtOpts->s: %d, s:%d\n", 
+  DBGV("filterOneWayDelay: rtOpts->s: %d, s:%d\n", 
        rtOpts->s,
        s
       );
-  DBGV("updatePathDelay: current owd_filt->y: %d, s_exp: %d\n", 
+  DBGV("filterOneWayDelay: current owd_filt->y: %lld, s_exp: %d\n", 
        owd_filt->y,
        owd_filt->s_exp
       );  
@@ -250,211 +530,1054 @@ void updatePathDelay(one_way_delay_filter *owd_filt,  /**< one way delay filter
   /* filter 'one_way_delay' */
   owd_filt->y = (owd_filt->s_exp-1)
                 *owd_filt->y/owd_filt->s_exp 
-              + (ptpClock->one_way_delay.nanoseconds/2 
-                 + owd_filt->nsec_prev/2
+              + (delay/2 
+                 + owd_filt->scaled_prev/2
                 ) 
                 /owd_filt->s_exp;
 
-  /* Record previous one way delay nanosecond value
+  /* Record previous one way delay value
    * and update it with value calculated above
    */  
-  owd_filt->nsec_prev = ptpClock->one_way_delay.nanoseconds;
-  ptpClock->one_way_delay.nanoseconds = owd_filt->y;
+  owd_filt->scaled_prev = delay;
+  ptpClock->one_way_delay_scaled = owd_filt->y;
+  nsToTime(&ptpClock->one_way_delay, scaledToNs(owd_filt->y));
   
-  DBGV("updatePathDelay: delay filter y:%d, s_exp:%d\n",
+  DBGV("filterOneWayDelay: delay filter y:%lld, s_exp:%d\n",
        owd_filt->y,
        owd_filt->s_exp
       );
 }
 
-void updateDelay(TimeInternal *         send_time, /**< Delay Req. sent by slave time */
-                 TimeInternal *         recv_time, /**< Delay Req. received by master time */
-                 one_way_delay_filter * owd_filt,  /**< one way delay filter */
-                 RunTimeOpts *          rtOpts,    /**< run time options */
-                 PtpClock *             ptpClock   /**< PTP main data structure */
-                )
+/**
+ * Function to update the peer path delay from a PDelay measurement
+ */
+static void updatePathDelay(Measurement          *m,         /**< PDelay measurement */
+                            one_way_delay_filter *owd_filt,  /**< one way delay filter */
+                            RunTimeOpts          *rtOpts,    /**< run time options */
+                            PtpClock             *ptpClock   /**< PTP main data structure */
+                           )
 {
-  Integer16 s;
+  TimeNs     remote_time;
+  TimeScaled delay;
+  
+  
+  DBGV("updatePathDelay:\n");
+
+  DBGV(" t1 PDelay Req  Tx time %10.10ds.%9.9dns\n",
+       m->t1.seconds,
+       m->t1.nanoseconds
+      );
+  
+  DBGV(" t2 PDelay Req  Rx time %10.10ds.%9.9dns\n",
+       m->t2.seconds,
+       m->t2.nanoseconds
+      );
+
+  DBGV(" t3 PDelay Resp Tx time %10.10ds.%9.9dns\n",
+       m->t3.seconds,
+       m->t3.nanoseconds
+      );
+
+  DBGV(" t4 PDelay Resp Rx time %10.10ds.%9.9dns\n",
+       m->t4.seconds,
+       m->t4.nanoseconds
+      );
+
+  DBGV(" PDelay Resp correction %lld (ns * 2^16)\n",
+       m->correction
+      );
+
+  DBGV(" PDelay Resp follow up  %lld (ns * 2^16)\n",
+       m->followup_correction
+      );
+
+  /* calc 'slave_to_master_delay' in scaled nanoseconds:
+   * ((t4-t1) - (t3-t2) - corrections) / 2
+   */
+  delay       = timeToNs(&m->t4)   // PDelay Response Receive time
+              - timeToNs(&m->t1);  // minus PDelay Request Transmit time
+
+  remote_time = timeToNs(&m->t3)   // PDelay Resp Transmit time (from responder)
+              - timeToNs(&m->t2);  // minus PDelay Request Receive time (from responder)
+
+  DBGV(" (t4-t1)                %lldns\n", delay);
+  DBGV(" (t3-t2)                %lldns\n", remote_time);
+
+  delay = nsToScaled(delay - remote_time)
+        - m->correction                // minus PDelay Resp Correction
+        - m->followup_correction;      // minus PDelay Resp Follow Up Correction
+  delay /= 2;
+
+  DBGV(" minus corr., divided by 2 %lld (ns * 2^16)\n", delay);
+
+  nsToTime(&ptpClock->slave_to_master_delay, scaledToNs(delay));
+
+  filterOneWayDelay(delay, owd_filt, rtOpts, ptpClock);
+}
+
+static void updateDelay(Measurement *          m,         /**< Delay Req/Resp measurement */
+                        one_way_delay_filter * owd_filt,  /**< one way delay filter */
+                        RunTimeOpts *          rtOpts,    /**< run time options */
+                        PtpClock *             ptpClock   /**< PTP main data structure */
+                       )
+{
+  TimeScaled slave_to_master;
   
   DBGV("updateDelay:\n");
   
-  /* calc 'slave_to_master_delay' */
-  subTime(&ptpClock->slave_to_master_delay, // Result
-          recv_time,                        // Send time
-          send_time                         // minus Receive time
-         );
+  /* calc 'slave_to_master_delay' (Receive time minus Send time,
+   * minus correction for V2 Delay Resp, which is zero if V1)
+   */
+  slave_to_master = nsToScaled(timeToNs(&m->t4) - timeToNs(&m->t3))
+                  - m->correction;
+  nsToTime(&ptpClock->slave_to_master_delay, scaledToNs(slave_to_master));
+  
+  /* update 'one_way_delay', assumes delay is symetrical */
+  filterOneWayDelay((ptpClock->master_to_slave_scaled + slave_to_master) / 2,
+                    owd_filt,
+                    rtOpts,
+                    ptpClock
+                   );
+}
+
+
+/**
+ * @fn updateOffset
+ * Filter function for calculating Offset from Master
+ * when running in PTP_SLAVE mode.
+ */
+static void updateOffset(Measurement *               m,          /**< Sync measurement */
+                         offset_from_master_filter * ofm_filt,   /**< Offset from Master filter */
+                         RunTimeOpts *               rtOpts,     /**< Run Time Options */
+                         PtpClock *                  ptpClock    /**< PTP main data structure */
+                        )
+{
+  TimeScaled offset;
+
+  DBGV("updateOffset:\n");
+  
+  /* calc 'master_to_slave_delay': Recorded time of Sync message minus
+   * Send time of Sync message (from follow-up), minus V2 corrections
+   * (set to zero if received Sync/Follow-up is from V1 MASTER)
+   */
+  ptpClock->master_to_slave_scaled = nsToScaled(timeToNs(&m->t2) - timeToNs(&m->t1))
+                                   - m->correction;
+  nsToTime(&ptpClock->master_to_slave_delay,
+           scaledToNs(ptpClock->master_to_slave_scaled)
+          );
+
+  /* update 'offset_from_master' (minus one way delay calc from
+   * Delay Request/response)
+   */
+  offset = ptpClock->master_to_slave_scaled - ptpClock->one_way_delay_scaled;
+  ptpClock->offset_from_master_scaled = offset;
+  nsToTime(&ptpClock->offset_from_master, scaledToNs(offset));
+
+  if(ptpClock->offset_from_master.seconds)
+  {
+    /* cannot filter with secs, clear filter */
+    ofm_filt->prev_valid = FALSE;  /* AKB: make sure next calc correct */
+
+#ifdef CONFIG_MPC831X
+    /* set meter to max */
+    led_meter(255);
+#endif
+
+    return;
+  }
+  
+  /* filter 'offset_from_master' */
+  /* 
+   * Offset from Master Filtering 
+   * this uses a simple two sample average:
+   *
+   * y[x] = x[n]/2 + x[n-1]/2
+   *
+   */
+
+  /* The Kalman servo filters the raw offset itself */
+  if (ofm_filt->prev_valid && rtOpts->servo != SERVO_KALMAN)  /* AKB: Make sure previous timestamp is valid */
+  {
+     // Previous timestamp is valid, calculate new offset from master 
+     // based on previous and current timestamps
+
+     ofm_filt->y =   // Offset from master filter Y 
+                     offset/2                  // current  / 2
+                   + ofm_filt->scaled_prev/2;  // previous / 2
+
+     ofm_filt->scaled_prev = offset;           // Store current for next time
+
+     // Set offset to current Y value
+     ptpClock->offset_from_master_scaled = ofm_filt->y;
+     nsToTime(&ptpClock->offset_from_master, scaledToNs(ofm_filt->y));
+
+#ifdef CONFIG_MPC831X
+     if (abs(ptpClock->offset_from_master.nanoseconds) > 255)
+     {
+       /* set meter to max */
+       led_meter(255);
+     }
+     else
+     {
+       /* set meter based on nanoseconds between 0 and 255 absolute */
+       led_meter(abs(ptpClock->offset_from_master.nanoseconds));
+     }
+#endif
+
+  }
+  else
+  {
+
+     // AKB: Previous timestamp is not valid, set filter Y to current value
+     ofm_filt->y           = offset; 
+     ofm_filt->scaled_prev = offset;
+     ofm_filt->prev_valid  = TRUE;
+  }
+  
+  DBGV("updateOffset: offset filter y:%lld (ns * 2^16)\n", ofm_filt->y);
+}
+
+/**
+ * Function to add the offset from master to the supervisor's window and
+ * change the lock state when the RMS offset over a full window crosses
+ * a threshold.  The thresholds are raised by the measurement noise, so
+ * a noisy path still locks and a quiet one locks only once settled.
+ */
+static void servoSupervise(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  servo_supervisor *s     = &ptpClock->supervisor;
+  UInteger8         state = s->state;
+  double            o, prev, sum, diff;
+  Integer32         lock, acquire;
+  int               i;
+
+  s->offset[s->next] = ptpClock->offset_from_master_scaled / 65536.0;
+  s->next            = (s->next + 1) % SERVO_RMS_WINDOW;
+  if (s->count < SERVO_RMS_WINDOW)
+    s->count++;
+  if (s->count < SERVO_RMS_WINDOW)
+    return;
+
+  /* RMS offset, and the measurement noise from the differences of
+   * successive offsets (the servo and oscillator move the offset
+   * little from one Sync to the next)
+   */
+  sum  = 0;
+  diff = 0;
+  prev = s->offset[s->next];
+  for (i = 0; i < SERVO_RMS_WINDOW; i++)
+  {
+    o     = s->offset[(s->next + i) % SERVO_RMS_WINDOW];
+    sum  += o * o;
+    diff += (o - prev) * (o - prev);
+    prev  = o;
+  }
+  s->rms   = (Integer32)sqrt(sum / SERVO_RMS_WINDOW);
+  s->noise = (Integer32)sqrt(diff / (2 * (SERVO_RMS_WINDOW - 1)));
+
+  /* locked when the offset is down to the noise */
+  lock    = SERVO_LOCK_NS    + SERVO_NOISE_RATIO * s->noise;
+  acquire = SERVO_ACQUIRE_NS + SERVO_NOISE_RATIO * s->noise;
+
+  switch (s->state)
+  {
+  case SERVO_UNLOCKED:
+    if (s->rms < acquire)
+      state = SERVO_ACQUIRING;
+    break;
+
+  case SERVO_ACQUIRING:
+    if (s->rms < lock)
+      state = SERVO_LOCKED;
+    else if (s->rms > acquire * SERVO_HYSTERESIS)
+      state = SERVO_UNLOCKED;
+    break;
+
+  case SERVO_LOCKED:
+    if (s->rms > lock * SERVO_HYSTERESIS)
+      state = SERVO_ACQUIRING;
+    break;
+
+  default:
+    state = SERVO_ACQUIRING;
+    break;
+  }
+
+  if (state != s->state)
+  {
+    DBG("servoSupervise: RMS offset %d ns, noise %d ns, state %d to %d\n",
+        s->rms,
+        s->noise,
+        s->state,
+        state
+       );
+    servoSetState(rtOpts, ptpClock, state);
+  }
+}
+
+/**
+ * Function to get the P attenuation for a Sync dt seconds after the
+ * previous one.  The P term is a frequency, the offset removed per
+ * second, so it does not depend on the Sync rate; but with a Sync
+ * interval near the attenuation it would remove the whole offset before
+ * the next Sync, so the attenuation is kept to SERVO_AP_INTERVALS
+ * intervals or more.
+ */
+static double servoAp(PtpClock *ptpClock, double dt)
+{
+  double ap = dt * SERVO_AP_INTERVALS;
+
+  return ap > ptpClock->supervisor.ap ? ap : ptpClock->supervisor.ap;
+}
+
+/**
+ * PI controller servo, returns the frequency adjustment (ppb) for the
+ * current offset from master.  The I term integrates the offset over
+ * the measured time since the previous Sync, so the gains mean the same
+ * at any Sync rate and a lost Sync does not change them.
+ */
+static Integer32 piServo(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  Integer32 adj;
+  TimeNs    t  = timeToNs(&ptpClock->last_sync.t2);
+  double    dt = 0;
+  double    ap, ai;
+
+  DBGV("piServo: using PI controller to update clock\n");
+
+  /* nothing to integrate over for the first Sync after a reset, and
+   * a long run of lost Syncs is not allowed to wind up the I term
+   */
+  if (ptpClock->pi_last_t)
+    dt = (t - ptpClock->pi_last_t) / 1e9;
+  if (dt < 0)
+    dt = 0;
+  else if (dt > SERVO_INTERVAL_MAX)
+    dt = SERVO_INTERVAL_MAX;
+  ptpClock->pi_last_t = t;
+
+  /* a P attenuation raised for a long interval lowers the damping,
+   * which goes with ap / sqrt(ai), so raise the I attenuation to match
+   */
+  ap = servoAp(ptpClock, dt);
+  ai = ptpClock->supervisor.ai * (ap / ptpClock->supervisor.ap) * (ap / ptpClock->supervisor.ap);
+
+  DBGV("  previous observed drift: %10d\n",
+       ptpClock->observed_drift
+      );
+  DBGV("  P attenuation:           %10d\n",
+       ptpClock->supervisor.ap
+      );
+  DBGV("  I attenuation:           %10d\n",
+       ptpClock->supervisor.ai
+      );
+  
+  DBGV("  current observed drift:  %d\n",
+       ptpClock->observed_drift
+      );
+
+
+  DBGV("  current offset           %lldns\n",
+       scaledToNs(ptpClock->offset_from_master_scaled)
+      );
+  DBGV("  Sync interval            %.6fs\n",
+       dt
+      );
+
+  /* the accumulator for the I component, kept in ppb * 2^16 so
+   * offsets smaller than the I attenuation are not lost
+   */
+  ptpClock->observed_drift_scaled += (Integer64)(ptpClock->offset_from_master_scaled * dt / ai);
+  
+  DBGV("  new observed drift (I):  %lld (ppb * 2^16)\n",
+       ptpClock->observed_drift_scaled
+      );
+
+  /* clamp the accumulator to ADJ_FREQ_MAX for sanity */
+  if(     ptpClock->observed_drift_scaled > nsToScaled(ADJ_FREQ_MAX))
+    ptpClock->observed_drift_scaled =  nsToScaled(ADJ_FREQ_MAX);
+  else if(ptpClock->observed_drift_scaled < -nsToScaled(ADJ_FREQ_MAX))
+    ptpClock->observed_drift_scaled = -nsToScaled(ADJ_FREQ_MAX);
+
+  ptpClock->observed_drift = (Integer32)scaledToNs(ptpClock->observed_drift_scaled);
+
+  DBGV("  clamped drift:           %d\n",
+       ptpClock->observed_drift
+      );
+  
+  adj = (Integer32)scaledToNs(  (Integer64)(ptpClock->offset_from_master_scaled / ap)
+                              + ptpClock->observed_drift_scaled
+                             );
+
+  DBGV("  calculated adjust:       %d\n",
+       adj
+      );
+  
+  DBGV("  base adjust:             %d\n",
+       ptpClock->baseAdjustValue
+      );
+
+  return adj;
+}
+
+/**
+ * Function to turn a servo output into the whole ppb adjFreq() takes.
+ * The fraction left over is carried into the next adjustment, so the
+ * rounding averages out instead of leaving a phase offset.
+ */
+static Integer32 servoRound(double adj, double *residue)
+{
+  Integer32 whole;
+
+  adj += *residue;
+  if(     adj >  ADJ_FREQ_MAX)
+    adj =  ADJ_FREQ_MAX;
+  else if(adj < -ADJ_FREQ_MAX)
+    adj = -ADJ_FREQ_MAX;
+
+  whole    = (Integer32)floor(adj + 0.5);
+  *residue = adj - whole;
+  return whole;
+}
+
+/**
+ * Function to rebuild the linear regression sums from the window, with
+ * x and y relative to the oldest sample
+ */
+static void linregRebase(linreg_servo *lr, UInteger16 size)
+{
+  UInteger16 i, j;
+  double     x, y0;
+
+  i  = (lr->next + size - lr->count) % size;
+  y0 = lr->y[i];
+
+  lr->origin = lr->t[i];
+  lr->phase -= y0;
+  lr->sx = lr->sy = lr->sxx = lr->sxy = lr->syy = 0;
+
+  for (j = 0; j < lr->count; j++, i = (i + 1) % size)
+  {
+    x         = (lr->t[i] - lr->origin) / 1e9;
+    lr->y[i] -= y0;
+    lr->sx   += x;
+    lr->sy   += lr->y[i];
+    lr->sxx  += x * x;
+    lr->sxy  += x * lr->y[i];
+    lr->syy  += lr->y[i] * lr->y[i];
+  }
+}
+
+/**
+ * Linear regression servo, returns the frequency adjustment (ppb) for
+ * the current offset from master.  The slope of the fit is the
+ * frequency error of the clock, the fitted offset at the current Sync
+ * is removed over the P attenuation in seconds like the P term of the
+ * PI servo.
+ */
+static Integer32 linregServo(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  linreg_servo *lr   = &ptpClock->linreg;
+  UInteger16    size = rtOpts->servoWindow;
+  TimeNs        t    = timeToNs(&ptpClock->last_sync.t2);
+  double        offset = ptpClock->offset_from_master_scaled / 65536.0;
+  double        n, x, y, mx, my, sxx, sxy, syy;
+  double        drift, estimate;
+  double        dt = 0;
+  Integer32     adj;
+
+  /* time the clock was moved by the adjustment of the previous sample */
+  if (lr->count)
+  {
+    dt         = (t - lr->last_t) / 1e9;
+    lr->phase += lr->last_adj * dt;
+  }
+  else
+    lr->origin = t;
+  lr->last_t = t;
+
+  /* a full window drops its oldest sample */
+  if (lr->count == size)
+  {
+    x        = (lr->t[lr->next] - lr->origin) / 1e9;
+    y        = lr->y[lr->next];
+    lr->sx  -= x;
+    lr->sy  -= y;
+    lr->sxx -= x * x;
+    lr->sxy -= x * y;
+    lr->syy -= y * y;
+    lr->count--;
+  }
+
+  x = (t - lr->origin) / 1e9;
+  y = offset + lr->phase;
+  lr->t[lr->next] = t;
+  lr->y[lr->next] = y;
+  lr->sx  += x;
+  lr->sy  += y;
+  lr->sxx += x * x;
+  lr->sxy += x * y;
+  lr->syy += y * y;
+  lr->count++;
+
+  if (++lr->next == size)
+  {
+    lr->next = 0;
+    linregRebase(lr, size);
+    x = (t - lr->origin) / 1e9;
+  }
+
+  /* until the window has enough samples keep the current drift */
+  drift    = ptpClock->observed_drift;
+  estimate = offset;
+  if (lr->count >= LINREG_MIN_SAMPLES)
+  {
+    n   = lr->count;
+    mx  = lr->sx / n;
+    my  = lr->sy / n;
+    sxx = lr->sxx - n * mx * mx;
+    sxy = lr->sxy - n * mx * my;
+    syy = lr->syy - n * my * my;
+    if (sxx > 0)
+    {
+      drift      = sxy / sxx;
+      estimate   = my + drift * (x - mx) - lr->phase;
+      syy       -= drift * sxy;   /* sum of squared residuals */
+      lr->jitter = syy > 0 ? (Integer32)sqrt(syy / n) : 0;
+    }
+  }
+
+  DBGV("linregServo: %d samples, drift %.3f ppb, offset %.1f ns, fit %.1f ns, jitter %d ns\n",
+       lr->count,
+       drift,
+       offset,
+       estimate,
+       lr->jitter
+      );
+
+  /* clamp the drift to ADJ_FREQ_MAX for sanity */
+  if(     drift >  ADJ_FREQ_MAX)
+    drift =  ADJ_FREQ_MAX;
+  else if(drift < -ADJ_FREQ_MAX)
+    drift = -ADJ_FREQ_MAX;
+
+  ptpClock->observed_drift        = (Integer32)drift;
+  ptpClock->observed_drift_scaled = (Integer64)(drift * 65536);
+
+  adj = servoRound(drift + estimate / servoAp(ptpClock, dt), &lr->residue);
+
+  lr->last_adj = rtOpts->noAdjust ? 0 : adj;
+  return adj;
+}
+
+/**
+ * Kalman filter servo, returns the frequency adjustment (ppb) for the
+ * current offset from master.  State is the phase and the frequency
+ * error of the free running clock, the adjustment applied since the
+ * previous measurement is the control input.  Like the other servos
+ * the estimated frequency error is cancelled and the estimated phase
+ * removed over the P attenuation in seconds.
+ */
+static Integer32 kalmanServo(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+{
+  kalman_servo *k = &ptpClock->kalman;
+  TimeNs        t = timeToNs(&ptpClock->last_sync.t2);
+  double        z = ptpClock->offset_from_master_scaled / 65536.0;
+  double        dt = 0;
+  double        diff, innovation, s, k0, k1, p00, p01;
+  Integer32     adj;
+
+  if (!k->valid)
+  {
+    /* start from the measurement and the drift found so far */
+    k->valid   = TRUE;
+    k->phase   = z;
+    k->freq    = ptpClock->observed_drift;
+    k->r       = KALMAN_R_INITIAL;
+    k->q       = KALMAN_Q_FREQ;
+    k->p[0][0] = KALMAN_R_INITIAL;
+    k->p[0][1] = 0;
+    k->p[1][0] = 0;
+    k->p[1][1] = KALMAN_P_FREQ;
+  }
+  else
+  {
+    dt = (t - k->last_t) / 1e9;
+
+    /* measurement noise from the second difference of the free running
+     * offset, 6 times the noise variance for white noise while the
+     * oscillator contributes little over a few Sync intervals
+     */
+    diff = z - k->last_z + k->last_adj * dt;
+    if (k->samples++)
+    {
+      s   = k->samples - 1 < KALMAN_R_WEIGHT ? k->samples - 1 : KALMAN_R_WEIGHT;
+      k->r += ((diff - k->last_diff) * (diff - k->last_diff) / 6 - k->r) / s;
+    }
+    if (k->r < KALMAN_R_MIN)
+      k->r = KALMAN_R_MIN;
+    k->last_diff = diff;
+
+    /* predict: phase moves by the frequency error less the adjustment */
+    k->phase += (k->freq - k->last_adj) * dt;
+
+    k->p[0][0] += dt * (k->p[1][0] + k->p[0][1] + dt * k->p[1][1])
+                + KALMAN_Q_PHASE * dt + k->q * dt * dt * dt / 3;
+    k->p[0][1] += dt * k->p[1][1] + k->q * dt * dt / 2;
+    k->p[1][0] += dt * k->p[1][1] + k->q * dt * dt / 2;
+    k->p[1][1] += k->q * dt;
+
+    /* update */
+    innovation = z - k->phase;
+    s   = k->p[0][0] + k->r;
+    k0  = k->p[0][0] / s;
+    k1  = k->p[1][0] / s;
+    p00 = k->p[0][0];
+    p01 = k->p[0][1];
+
+    k->phase   += k0 * innovation;
+    k->freq    += k1 * innovation;
+    k->p[0][0] -= k0 * p00;
+    k->p[0][1] -= k0 * p01;
+    k->p[1][0] -= k1 * p00;
+    k->p[1][1] -= k1 * p01;
+
+    /* frequency wander matched to the frequency corrections, never
+     * below the oscillator model
+     */
+    if (dt > 0 && k->samples > KALMAN_WARMUP)
+    {
+      k->q += (k1 * innovation * k1 * innovation / dt - k->q) / KALMAN_Q_WEIGHT;
+      if (k->q < KALMAN_Q_FREQ)
+        k->q = KALMAN_Q_FREQ;
+    }
+  }
+  k->last_z = z;
+  k->last_t = t;
+  k->jitter = (Integer32)sqrt(k->r);
+
+  DBGV("kalmanServo: offset %.1f ns, phase %.1f ns, freq %.3f ppb, noise %d ns\n",
+       z,
+       k->phase,
+       k->freq,
+       k->jitter
+      );
+
+  /* clamp the frequency to ADJ_FREQ_MAX for sanity */
+  if(     k->freq >  ADJ_FREQ_MAX)
+    k->freq =  ADJ_FREQ_MAX;
+  else if(k->freq < -ADJ_FREQ_MAX)
+    k->freq = -ADJ_FREQ_MAX;
+
+  ptpClock->observed_drift        = (Integer32)k->freq;
+  ptpClock->observed_drift_scaled = (Integer64)(k->freq * 65536);
+
+  adj = servoRound(k->freq + k->phase / servoAp(ptpClock, dt), &k->residue);
+
+  k->last_adj = rtOpts->noAdjust ? 0 : adj;
+  return adj;
+}
+
+/** Function to get the current time of the clock in nanoseconds */
+static TimeNs holdoverNow(PtpClock *ptpClock)
+{
+  TimeInternal now;
+
+  getTime(&now, ptpClock->current_utc_offset);
+  return timeToNs(&now);
+}
+
+/**
+ * Function to save the servo state to the state file (-j): the frequency,
+ * the one way delay filter and the parent they belong to.  The state is
+ * written to a temporary file which is renamed over the state file, so
+ * a crash leaves either the old or the new state, never part of one.
+ * The fsync() can block for milliseconds, so this only runs from
+ * servoWriteState(), outside the servo.
+ */
+static void servoSaveState(RunTimeOpts *rtOpts,  /**< run time options */
+                           servo_state *state    /**< State to save */
+                          )
+{
+  char       tmp[PATH_MAX];
+  FILE      *fp;
+  UInteger8 *id = (UInteger8 *)state->parent_identity;
+  int        ok;
+
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", rtOpts->stateFile) >= (int)sizeof(tmp))
+  {
+    NOTIFY("servoSaveState: state file name too long\n");
+    return;
+  }
 
-  /* Correction for V2 Delay Resp (variable is zero if V1) */
+  fp = fopen(tmp, "w");
+  if (!fp)
+  {
+    PERROR("servoSaveState: failed to create %s", tmp);
+    return;
+  }
 
-  subTime(&ptpClock->slave_to_master_delay,
-          &ptpClock->slave_to_master_delay,
-          &ptpClock->delay_resp_correction
-         );
-  
-  /* update 'one_way_delay' */
-  addTime(&ptpClock->one_way_delay,         // Result (divided by 2 later)
-          &ptpClock->master_to_slave_delay, // Master to slave delay (from sync/follow-up)
-          &ptpClock->slave_to_master_delay  // Slave to master delay (from delay request/response)
+  fprintf(fp,
+          "%s %d\n"
+          "saved %lld\n"
+          "parent %02x%02x%02x%02x%02x%02x%02x%02x %u\n"
+          "freq %.3f\n"
+          "delay %lld %lld %d %lld\n",
+          STATE_FILE_MAGIC, STATE_FILE_VERSION,
+          (long long)state->saved,
+          id[0], id[1], id[2], id[3], id[4], id[5], id[6], id[7],
+          state->parent_port_id,
+          state->freq,
+          state->owd_filt.y,
+          state->owd_filt.scaled_prev,
+          state->owd_filt.s_exp,
+          state->one_way_delay_scaled
          );
 
-  halveTime(&ptpClock->one_way_delay);      // Divide by 2 to get one way delay
-                                            // Assumes delay is symetrical
-  
-  if(ptpClock->one_way_delay.seconds)       // Check if delay is larger than one second
+  ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fclose(fp) != 0 || !ok || rename(tmp, rtOpts->stateFile) < 0)
   {
-
-    /* Delay is larger than one second, clear s_exp and timestamp
-     * of previously received sent time of Sync message (usually from 
-     * preciseOriginTimestamp of follow up message) and return
-     */
-    DBG("updateDelay: One way delay seconds != 0\n");
-    DBG("updateDelay: Clearing one way delay filter s_exp, nsec_prev\n");
-    owd_filt->s_exp = owd_filt->nsec_prev = 0;
+    PERROR("servoSaveState: failed to write %s", rtOpts->stateFile);
+    unlink(tmp);
     return;
   }
-  
-  /* avoid overflowing filter */
-  s =  rtOpts->s;
-  while(abs(owd_filt->y)>>(31-s))
-    --s;
+  DBGV("servoSaveState: frequency %.3f ppb saved\n", state->freq);
+}
 
-  DBGV("updateDelay: rtOpts->s: %d, s:%d\n", 
-       rtOpts->s,
-       s
-      );
-  DBGV("updateDelay: current owd_filt->y: %d, s_exp: %d\n", 
-       owd_filt->y,
-       owd_filt->s_exp
-      );  
+/**
+ * Function to hand the servo state to servoWriteState().  If the last
+ * state handed over has not been written yet, it is kept and this one
+ * dropped.
+ */
+static void servoQueueState(PtpClock *ptpClock,  /**< Servo data set */
+                            double    freq       /**< adjFreq() value to save (ppb) */
+                           )
+{
+  servo_state *state = &ptpClock->state_save;
 
-  /* crank down filter cutoff by increasing 's_exp' */
-  if(owd_filt->s_exp < 1)
-    owd_filt->s_exp = 1;
-  else if(owd_filt->s_exp < 1<<s)
-    ++owd_filt->s_exp;
-  else if(owd_filt->s_exp > 1<<s)
-    owd_filt->s_exp = 1<<s;
-  
-  /* filter 'one_way_delay' */
-  owd_filt->y = (owd_filt->s_exp-1)
-                *owd_filt->y/owd_filt->s_exp 
-              + (ptpClock->one_way_delay.nanoseconds/2 
-                 + owd_filt->nsec_prev/2
-                ) 
-                /owd_filt->s_exp;
+  if (__atomic_load_n(&ptpClock->state_save_pending, __ATOMIC_ACQUIRE))
+    return;
 
-  /* Record previous one way delay nanosecond value
-   * and update it with value calculated above
-   */  
-  owd_filt->nsec_prev = ptpClock->one_way_delay.nanoseconds;
-  ptpClock->one_way_delay.nanoseconds = owd_filt->y;
-  
-  DBGV("updateDelay: delay filter y:%d, s_exp:%d\n",
-       owd_filt->y,
-       owd_filt->s_exp
-      );
+  state->saved                = time(NULL);
+  memcpy(state->parent_identity, ptpClock->last_sync.parent_identity, 8);
+  state->parent_port_id       = ptpClock->last_sync.parent_port_id;
+  state->freq                 = freq;
+  state->owd_filt             = ptpClock->owd_filt;
+  state->one_way_delay_scaled = ptpClock->one_way_delay_scaled;
+  __atomic_store_n(&ptpClock->state_save_pending, TRUE, __ATOMIC_RELEASE);
 }
 
-
 /**
- * @fn updateOffset
- * Filter function for calculating Offset from Master
- * when running in PTP_SLAVE mode.
+ * Function to write the state the servo handed over to the state file,
+ * if there is one.  Called from the main loop after the servo has run,
+ * or from the main thread with port threads, so the file system never
+ * delays a measurement.
  */
-void updateOffset(TimeInternal *              send_time,  /**< Sync message reported Transmit time */
-                  TimeInternal *              recv_time,  /**< Sync message local    Receive  time */
-                  offset_from_master_filter * ofm_filt,   /**< Offset from Master filter */
-                  RunTimeOpts *               rtOpts,     /**< Run Time Options */
-                  PtpClock *                  ptpClock    /**< PTP main data structure */
-                 )
+void servoWriteState(RunTimeOpts *rtOpts,  /**< run time options */
+                     PtpClock    *servo    /**< Servo data set */
+                    )
 {
-  DBGV("updateOffset:\n");
-  
-  /* calc 'master_to_slave_delay' */
-  subTime(&ptpClock->master_to_slave_delay, // Result: Master to slave delay
-          recv_time,                        // Recorded time of Sync message
-          send_time                         // minus Send time of Sync message (from follow-up)
-         );
-  
-  /* Update for V2 corrections (set to zero if received Sync/Follow-up is from V1 MASTER) */
+  servo_state state;
 
-  subTime(&ptpClock->master_to_slave_delay,
-          &ptpClock->master_to_slave_delay,
-          &ptpClock->sync_correction
-         );
+  if (   !rtOpts->stateFile
+      || !__atomic_load_n(&servo->state_save_pending, __ATOMIC_ACQUIRE)
+     )
+    return;
 
-  subTime(&ptpClock->master_to_slave_delay,
-          &ptpClock->master_to_slave_delay,
-          &ptpClock->followup_correction
-         );
+  state = servo->state_save;
+  __atomic_store_n(&servo->state_save_pending, FALSE, __ATOMIC_RELEASE);
+  servoSaveState(rtOpts, &state);
+}
 
-  /* update 'offset_from_master' */
-  subTime(&ptpClock->offset_from_master,    // Result: Offset from master
-          &ptpClock->master_to_slave_delay, // From above calculation
-          &ptpClock->one_way_delay          // minus one way delay calc from Delay Request/response
-         );
+/**
+ * Function to read the state file (-j)
+ *
+ * @return Returns TRUE if the file holds a servo state
+ */
+static Boolean servoLoadState(RunTimeOpts *rtOpts, servo_state *state)
+{
+  FILE        *fp;
+  char         magic[32];
+  char         id[17];
+  int          version;
+  unsigned int port;
+  int          i, n;
+
+  fp = fopen(rtOpts->stateFile, "r");
+  if (!fp)
+  {
+    if (errno != ENOENT)
+      PERROR("servoLoadState: failed to open %s", rtOpts->stateFile);
+    return FALSE;
+  }
 
-  if(ptpClock->offset_from_master.seconds)
+  n = fscanf(fp,
+             "%31s %d saved %lld parent %16s %u freq %lf delay %lld %lld %d %lld",
+             magic,
+             &version,
+             &state->saved,
+             id,
+             &port,
+             &state->freq,
+             &state->owd_filt.y,
+             &state->owd_filt.scaled_prev,
+             &state->owd_filt.s_exp,
+             &state->one_way_delay_scaled
+            );
+  fclose(fp);
+
+  if (n != 10 || strcmp(magic, STATE_FILE_MAGIC) || version != STATE_FILE_VERSION || strlen(id) != 16)
   {
-    /* cannot filter with secs, clear filter */
-    ofm_filt->nsec_prev = -1;  /* AKB: Use invalid number to make sure next calc correct */
+    NOTIFY("servoLoadState: %s is not a servo state file, ignored\n", rtOpts->stateFile);
+    return FALSE;
+  }
+  for (i = 0; i < 8; i++)
+  {
+    sscanf(id + 2*i, "%2hhx", &state->parent_identity[i]);
+  }
+  state->parent_port_id = port;
+  return TRUE;
+}
 
-#ifdef CONFIG_MPC831X
-    /* set meter to max */
-    led_meter(255);
-#endif
+/**
+ * Function to warm start on the first Sync: if the state file was saved
+ * recently and for the same parent, restore the frequency and the one
+ * way delay filter instead of finding them again.
+ */
+static void servoWarmStart(Measurement *m,       /**< First Sync measurement */
+                           RunTimeOpts *rtOpts,  /**< run time options */
+                           PtpClock    *port,    /**< Port that took the measurement */
+                           PtpClock    *servo    /**< Servo data set */
+                          )
+{
+  servo_state *state = &servo->warm_start;
+  Integer64    age;
+  Integer32    adj;
+
+  state->checked = TRUE;
+  if (!servoLoadState(rtOpts, state))
+    return;
 
+  age = (Integer64)time(NULL) - state->saved;
+  if (age < 0 || age > STATE_MAX_AGE)
+  {
+    NOTIFY("servoWarmStart: state saved %lld s ago is too old, ignored\n", age);
+    return;
+  }
+  if (   memcmp(state->parent_identity, m->parent_identity, 8)
+      || state->parent_port_id != m->parent_port_id
+     )
+  {
+    NOTIFY("servoWarmStart: state saved for another master, ignored\n");
     return;
   }
-  
-  /* filter 'offset_from_master' */
-  /* 
-   * Offset from Master Filtering 
-   * this uses a simple two sample average:
-   *
-   * y[x] = x[n]/2 + x[n-1]/2
-   *
-   */
 
-  if (ofm_filt->nsec_prev != -1)  /* AKB: Make sure previous timestamp is valid */
+  port->owd_filt             = state->owd_filt;
+  port->one_way_delay_scaled = state->one_way_delay_scaled;
+  nsToTime(&port->one_way_delay, scaledToNs(port->one_way_delay_scaled));
+
+  if (!rtOpts->noAdjust)
   {
-     // Previous timestamp is valid, calculate new offset from master 
-     // based on previous and current timestamps
+    adj = (Integer32)floor(state->freq + 0.5);
+    adjFreq(adj);
+    servo->observed_drift        = servo->baseAdjustValue - adj;
+    servo->observed_drift_scaled = nsToScaled(servo->observed_drift);
+  }
 
-     ofm_filt->y =   // Offset from master filter Y 
-                     ptpClock->offset_from_master.nanoseconds/2  // current  / 2
-                   + ofm_filt->nsec_prev/2;                      // previous / 2
+  NOTIFY("servoWarmStart: frequency %.1f ppb, one way delay %lld ns from state saved %lld s ago\n",
+         state->freq,
+         scaledToNs(state->one_way_delay_scaled),
+         age
+        );
+}
 
-     ofm_filt->nsec_prev = ptpClock->offset_from_master.nanoseconds;// Store current for next time
+/**
+ * Function to add the frequency applied by a locked servo to the
+ * holdover history, one mean value per HOLDOVER_INTERVAL
+ */
+static void holdoverSample(RunTimeOpts *rtOpts,   /**< run time options */
+                           PtpClock    *ptpClock, /**< PTP main data structure */
+                           Integer32    freq      /**< Value passed to adjFreq() */
+                          )
+{
+  holdover_servo *h   = &ptpClock->holdover;
+  TimeNs          now = holdoverNow(ptpClock);
 
-     ptpClock->offset_from_master.nanoseconds = ofm_filt->y;  // Set offset to current Y value
+  if (   ptpClock->port_state != PTP_SLAVE
+      || llabs(scaledToNs(ptpClock->offset_from_master_scaled)) > HOLDOVER_LOCK_NS
+     )
+    return;
 
-#ifdef CONFIG_MPC831X
-     if (abs(ptpClock->offset_from_master.nanoseconds) > 255)
-     {
-       /* set meter to max */
-       led_meter(255);
-     }
-     else
-     {
-       /* set meter based on nanoseconds between 0 and 255 absolute */
-       led_meter(abs(ptpClock->offset_from_master.nanoseconds));
-     }
-#endif
+  /* an interval with a gap in it is not a mean over the interval */
+  if (h->samples && now - h->last > HOLDOVER_INTERVAL * 1000000000LL / 2)
+    h->samples = 0;
+  if (!h->samples)
+  {
+    h->start = now;
+    h->sum   = 0;
+  }
+  h->last = now;
+  h->sum += freq;
+  h->samples++;
+
+  if (now - h->start < HOLDOVER_INTERVAL * 1000000000LL)
+    return;
+
+  h->t[h->next]    = h->start + (now - h->start) / 2;
+  h->freq[h->next] = h->sum / h->samples;
+  h->next          = (h->next + 1) % HOLDOVER_HISTORY;
+  if (h->count < HOLDOVER_HISTORY)
+    h->count++;
+  h->samples = 0;
+
+  DBGV("holdoverSample: interval %d, frequency %.3f ppb\n",
+       h->count,
+       h->freq[(h->next + HOLDOVER_HISTORY - 1) % HOLDOVER_HISTORY]
+      );
 
+  /* Saved once a minute, written outside the servo */
+  if (rtOpts->stateFile && h->next % STATE_SAVE_INTERVALS == 0)
+    servoQueueState(ptpClock, h->freq[(h->next + HOLDOVER_HISTORY - 1) % HOLDOVER_HISTORY]);
+}
+
+/**
+ * Function to enter holdover when the servo loses its master: fit a
+ * frequency and its trend to the history.  Must run before the servo
+ * variables are cleared, the last offset from master is the initial
+ * time error.
+ *
+ * @return Returns TRUE if holding over
+ */
+static Boolean holdoverStart(RunTimeOpts *rtOpts,   /**< run time options */
+                             PtpClock    *ptpClock  /**< PTP main data structure */
+                            )
+{
+  holdover_servo *h = &ptpClock->holdover;
+  double          n, x, mx, my, sxx, sxy, syy, var;
+  TimeNs          newest;
+  int             i;
+
+  if (h->active)
+    return TRUE;
+  h->samples = 0;
+  if (h->count < HOLDOVER_MIN_SAMPLES || rtOpts->noAdjust)
+    return FALSE;
+
+  /* least squares line through the history, time in seconds from the
+   * newest interval
+   */
+  newest = h->t[(h->next + HOLDOVER_HISTORY - 1) % HOLDOVER_HISTORY];
+  n  = h->count;
+  mx = my = 0;
+  for (i = 0; i < h->count; i++)
+  {
+    mx += (h->t[i] - newest) / 1e9;
+    my += h->freq[i];
   }
-  else
+  mx /= n;
+  my /= n;
+  sxx = sxy = syy = 0;
+  h->span = 0;
+  for (i = 0; i < h->count; i++)
   {
+    x    = (h->t[i] - newest) / 1e9;
+    sxx += (x - mx) * (x - mx);
+    sxy += (x - mx) * (h->freq[i] - my);
+    syy += (h->freq[i] - my) * (h->freq[i] - my);
+    if (-x > h->span)
+      h->span = -x;
+  }
+  h->span += HOLDOVER_INTERVAL;
 
-     // AKB: Previous timestamp is not valid, set filter Y to current value
-     ofm_filt->y         = ptpClock->offset_from_master.nanoseconds; 
-     ofm_filt->nsec_prev = ptpClock->offset_from_master.nanoseconds;
+  /* use the trend only if the history is long enough for it to stand
+   * out of the noise, extrapolating a noisy trend does more harm than
+   * holding the mean
+   */
+  h->trend       = 0;
+  h->sigma_trend = 0;
+  var            = syy / (n - 1);
+  if (h->count >= HOLDOVER_MIN_TREND && sxx > 0)
+  {
+    h->trend       = sxy / sxx;
+    var            = (syy - h->trend * sxy) / (n - 2);
+    h->sigma_trend = sqrt((var > 0 ? var : 0) / sxx);
+    if (fabs(h->trend) < 2 * h->sigma_trend)
+    {
+      h->trend = 0;
+      var      = syy / (n - 1);
+    }
   }
-  
-  DBGV("updateOffset: offset filter y:%d\n", ofm_filt->y);
+  h->sigma   = var > 0 ? sqrt(var) : 0;
+  h->since   = holdoverNow(ptpClock);
+  h->freq0   = my + h->trend * ((h->since - newest) / 1e9 - mx);
+  h->phase   = fabs(ptpClock->offset_from_master_scaled / 65536.0);
+  h->residue = 0;
+  h->active  = TRUE;
+
+  NOTIFY("holdover: started, frequency %.1f ppb, trend %.5f ppb/s, sigma %.2f ppb from %d intervals\n",
+         h->freq0,
+         h->trend,
+         h->sigma,
+         h->count
+        );
+  return TRUE;
+}
+
+/**
+ * Function to apply the predicted frequency of holdover and update the
+ * time error bound.  The servo variables are set to the prediction so
+ * the servo restarts from it when a master is back.
+ */
+static void holdoverUpdate(RunTimeOpts *rtOpts,   /**< run time options */
+                           PtpClock    *ptpClock  /**< PTP main data structure */
+                          )
+{
+  holdover_servo *h = &ptpClock->holdover;
+  double          dt, bound;
+
+  dt = (holdoverNow(ptpClock) - h->since) / 1e9;
+
+  /* the trend is extrapolated no further than the history it came from */
+  h->adj = servoRound(h->freq0 + h->trend * (dt < h->span ? dt : h->span),
+                      &h->residue
+                     );
+  adjFreq(h->adj);
+
+  ptpClock->observed_drift        = ptpClock->baseAdjustValue - h->adj;
+  ptpClock->observed_drift_scaled = nsToScaled(ptpClock->observed_drift);
+
+  /* initial error, plus the frequency error of the fit integrated over
+   * holdover, plus the error of the trend integrated twice
+   */
+  bound    = h->phase + h->sigma * dt + h->sigma_trend * dt * dt / 2;
+  h->bound = bound < 0x7fffffff ? (Integer32)bound : 0x7fffffff;
+
+  DBG("holdoverUpdate: %.0f s, frequency %d ppb, bound %d ns\n",
+      dt,
+      h->adj,
+      h->bound
+     );
+}
+
+/** Function to leave holdover on the first Sync from a master */
+static void holdoverStop(PtpClock *ptpClock)
+{
+  holdover_servo *h = &ptpClock->holdover;
+
+  h->active = FALSE;
+  NOTIFY("holdover: ended after %lld s, offset from master %lld ns, bound %d ns\n",
+         (holdoverNow(ptpClock) - h->since) / 1000000000LL,
+         scaledToNs(ptpClock->offset_from_master_scaled),
+         h->bound
+        );
 }
 
-void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
+/**
+ * Function to run the clock servo on the current offset from master,
+ * stepping the clock for offsets of a second or more and otherwise
+ * adjusting its frequency with the selected servo
+ */
+static void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
   Integer32    adj=0;
   TimeInternal timeTmpA;  // AKB: Added values for adjusting calc based on time to get time
@@ -486,10 +1609,10 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
            // Store t1 and t2 times as current delta, next time we'll subtract
            //
            copyTime(&ptpClock->t1_sync_delta_time,
-                    &ptpClock->t1_sync_tx_time
+                    &ptpClock->last_sync.t1
                    );
            copyTime(&ptpClock->t2_sync_delta_time,
-                    &ptpClock->t2_sync_rx_time
+                    &ptpClock->last_sync.t2
                    );
            NOTIFY("updateClock: Storing current T1 and T2 values for later calc\n");
            DBG("updateClock: Storing T1: %10ds %11dns\n",
@@ -507,20 +1630,20 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
         // values.  Now we calculate the deltas
 
            DBG("updateClock: Current T1: %10ds %11dns\n",
-               ptpClock->t1_sync_tx_time.seconds,
-               ptpClock->t1_sync_tx_time.nanoseconds
+               ptpClock->last_sync.t1.seconds,
+               ptpClock->last_sync.t1.nanoseconds
               );
            DBG("updateClock: Current T2: %10ds %11dns\n",
-               ptpClock->t2_sync_rx_time.seconds,
-               ptpClock->t2_sync_rx_time.nanoseconds
+               ptpClock->last_sync.t2.seconds,
+               ptpClock->last_sync.t2.nanoseconds
               );
 
         subTime(&ptpClock->t1_sync_delta_time,
-                &ptpClock->t1_sync_tx_time,
+                &ptpClock->last_sync.t1,
                 &ptpClock->t1_sync_delta_time
                ); 
         subTime(&ptpClock->t2_sync_delta_time,
-                &ptpClock->t2_sync_rx_time,
+                &ptpClock->last_sync.t2,
                 &ptpClock->t2_sync_delta_time
                );
 
@@ -593,58 +1716,65 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
             ptpClock->observed_drift
            );
 
-        getTime(&timeTmpA, ptpClock->current_utc_offset);   // Get current time #1
+        // Step the clock by the offset from master.  Let the kernel apply
+        // the offset atomically if it can, otherwise estimate the time
+        // taken to get/set the clock and set it to an absolute time
 
-        getTime(&timeTmpB, ptpClock->current_utc_offset);   // Get current time #2
+        if (!stepTime(&ptpClock->offset_from_master))
+        {
+          getTime(&timeTmpA, ptpClock->current_utc_offset);   // Get current time #1
 
-        subTime(&timeTmpC,    // Calculate time   #3, time elapsed between calls
-                &timeTmpB,
-                &timeTmpA
-               );
+          getTime(&timeTmpB, ptpClock->current_utc_offset);   // Get current time #2
 
-        getTime(&timeTmpD, ptpClock->current_utc_offset);   // Get current time #4
+          subTime(&timeTmpC,    // Calculate time   #3, time elapsed between calls
+                  &timeTmpB,
+                  &timeTmpA
+                 );
 
-        subTime(&timeTmpE,    // Subtract calculated offset from master
-                &timeTmpD,
-                &ptpClock->offset_from_master
-               );
+          getTime(&timeTmpD, ptpClock->current_utc_offset);   // Get current time #4
 
-        addTime(&timeTmpF,    // Add calculated time to get timer value
-                &timeTmpE,
-                &timeTmpC
-               );
+          subTime(&timeTmpE,    // Subtract calculated offset from master
+                  &timeTmpD,
+                  &ptpClock->offset_from_master
+                 );
 
-        setTime(&timeTmpF, ptpClock->current_utc_offset);   // Set new PTP time
+          addTime(&timeTmpF,    // Add calculated time to get timer value
+                  &timeTmpE,
+                  &timeTmpC
+                 );
 
-        DBGV(" get  Time A           :   %10ds %11dns\n",
-             timeTmpA.seconds,
-             timeTmpA.nanoseconds
-            );
-        DBGV(" get  Time B           :   %10ds %11dns\n",
-             timeTmpB.seconds,
-             timeTmpB.nanoseconds
-            );
-        DBGV(" calc Time C (B-A)     :   %10ds %11dns\n",
-             timeTmpC.seconds,
-             timeTmpC.nanoseconds
-            );
-        DBGV(" get  Time D           :   %10ds %11dns\n",
-             timeTmpD.seconds,
-             timeTmpD.nanoseconds
-            );
-        DBGV(" offset from master    :   %10ds %11dns\n",
-             ptpClock->offset_from_master.seconds,
-             ptpClock->offset_from_master.nanoseconds
-            );
-        DBGV(" calc Time E (D+offset):   %10ds %11dns\n",
-             timeTmpE.seconds,
-             timeTmpE.nanoseconds
-            );
-        DBGV(" calc Time F (E+C)     :   %10ds %11dns\n",
-             timeTmpF.seconds,
-             timeTmpF.nanoseconds
-            );
-        DBGV("updateClock: set time to Time F\n");
+          setTime(&timeTmpF, ptpClock->current_utc_offset);   // Set new PTP time
+
+          DBGV(" get  Time A           :   %10ds %11dns\n",
+               timeTmpA.seconds,
+               timeTmpA.nanoseconds
+              );
+          DBGV(" get  Time B           :   %10ds %11dns\n",
+               timeTmpB.seconds,
+               timeTmpB.nanoseconds
+              );
+          DBGV(" calc Time C (B-A)     :   %10ds %11dns\n",
+               timeTmpC.seconds,
+               timeTmpC.nanoseconds
+              );
+          DBGV(" get  Time D           :   %10ds %11dns\n",
+               timeTmpD.seconds,
+               timeTmpD.nanoseconds
+              );
+          DBGV(" offset from master    :   %10ds %11dns\n",
+               ptpClock->offset_from_master.seconds,
+               ptpClock->offset_from_master.nanoseconds
+              );
+          DBGV(" calc Time E (D+offset):   %10ds %11dns\n",
+               timeTmpE.seconds,
+               timeTmpE.nanoseconds
+              );
+          DBGV(" calc Time F (E+C)     :   %10ds %11dns\n",
+               timeTmpF.seconds,
+               timeTmpF.nanoseconds
+              );
+          DBGV("updateClock: set time to Time F\n");
+        }
 
         // Initialize clock variables based on run time options (rtOpts)
 
@@ -656,7 +1786,8 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 
         // Set initial observed drift to this calculated value
 
-        ptpClock->observed_drift = adj;
+        ptpClock->observed_drift        = adj;
+        ptpClock->observed_drift_scaled = nsToScaled(adj);
 
         DBG( "updateClock: after initClock:\n");
         DBGV("  master-to-slave delay:   %10ds %11dns\n",
@@ -693,63 +1824,16 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
   }
   else
   {
-    /* Offset from master is less than one second.  Use the the PI controller
-     * to adjust the time 
+    /* Offset from master is less than one second.  Use the selected
+     * servo to adjust the time
      */
-
-    DBGV("updateClock: using PI controller to update clock\n");
-
-    /* no negative or zero attenuation */
-    if(rtOpts->ap < 1)
-     rtOpts->ap = 1;
-    if(rtOpts->ai < 1)
-      rtOpts->ai = 1;
-
-    DBGV("  previous observed drift: %10d\n",
-         ptpClock->observed_drift
-        );
-    DBGV("  run time opts P:         %10d\n",
-         rtOpts->ap
-        );
-    DBGV("  run time opts I:         %10d\n",
-         rtOpts->ai
-        );
-    
-    DBGV("  current observed drift:  %d\n",
-         ptpClock->observed_drift
-        );
-
-
-    DBGV("  current offset           %dns\n",
-         rtOpts->ai
-        );
-
-    /* the accumulator for the I component */
-    ptpClock->observed_drift += ptpClock->offset_from_master.nanoseconds/rtOpts->ai;
-    
-    DBGV("  new observed drift (I):  %d\n",
-         ptpClock->observed_drift
-        );
-
-    /* clamp the accumulator to ADJ_FREQ_MAX for sanity */
-    if(     ptpClock->observed_drift > ADJ_FREQ_MAX)
-      ptpClock->observed_drift =  ADJ_FREQ_MAX;
-    else if(ptpClock->observed_drift < -ADJ_FREQ_MAX)
-      ptpClock->observed_drift = -ADJ_FREQ_MAX;
-
-    DBGV("  clamped drift:           %d\n",
-         ptpClock->observed_drift
-        );
-    
-    adj = ptpClock->offset_from_master.nanoseconds/rtOpts->ap + ptpClock->observed_drift;
-
-    DBGV("  calculated adjust:       %d\n",
-         adj
-        );
-    
-    DBGV("  base adjust:             %d\n",
-         ptpClock->baseAdjustValue
-        );
+    servoSupervise(rtOpts, ptpClock);
+    if (rtOpts->servo == SERVO_LINREG)
+      adj = linregServo(rtOpts, ptpClock);
+    else if (rtOpts->servo == SERVO_KALMAN)
+      adj = kalmanServo(rtOpts, ptpClock);
+    else
+      adj = piServo(rtOpts, ptpClock);
 
     /* apply controller output as a clock tick rate adjustment */
     if(!rtOpts->noAdjust)
@@ -759,6 +1843,7 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
           );
 
       adjFreq(ptpClock->baseAdjustValue - adj);
+      holdoverSample(rtOpts, ptpClock, ptpClock->baseAdjustValue - adj);
       if (rtOpts->rememberAdjustValue == TRUE)
       {
          if (   ptpClock->offset_from_master.nanoseconds <= 100
@@ -800,4 +1885,175 @@ void updateClock(RunTimeOpts *rtOpts, PtpClock *ptpClock)
       );
 }
 
+/**
+ * Function to test if a port other than the one that took the
+ * measurement is SLAVE and disciplining the clock
+ */
+static Boolean servoOtherSlave(Measurement *m, PtpClock *port)
+{
+  UInteger16 slave = __atomic_load_n(&ptpClockFirstPort(port)->slave_port,
+                                     __ATOMIC_RELAXED
+                                    );
+
+  return slave && slave != m->port_id_field;
+}
+
+/**
+ * Function to run one measurement through the filters of its port and
+ * the servo.  servo is the data set of the servo thread with port
+ * threads, otherwise the port itself.
+ */
+static void servoMeasure(Measurement *m,       /**< Measurement queued by the port */
+                         RunTimeOpts *rtOpts,  /**< run time options */
+                         PtpClock    *port,    /**< Port that took the measurement */
+                         PtpClock    *servo    /**< Servo data set */
+                        )
+{
+  DBGV("servoMeasure: port %d, type %d, sequence %u\n",
+       m->port_id_field,
+       m->type,
+       m->sequence_id
+      );
+
+  switch(m->type)
+  {
+  case MEASURE_RESET:
+    /* another port of a boundary clock disciplines the clock: clear
+     * this port only, and end the holdover this port may have started
+     */
+    if (servoOtherSlave(m, port))
+    {
+      if (servo->holdover.active)
+        holdoverStop(servo);
+      initClockVars(rtOpts, port);
+      break;
+    }
+
+    /* a slave losing its master holds over, a master coming back
+     * restarts the servo from the holdover frequency
+     */
+    holdoverStart(rtOpts, servo);
+    initClockVars(rtOpts, port);
+    if (servo != port)
+      initClockVars(rtOpts, servo);
+    levelClock(rtOpts, servo);
+    if (servo->holdover.active)
+    {
+      servoSetState(rtOpts, servo, SERVO_HOLDOVER);
+      holdoverUpdate(rtOpts, servo);
+    }
+    break;
+
+  case MEASURE_HOLDOVER:
+    if (servo->holdover.active && servoOtherSlave(m, port))
+    {
+      /* another port took over the clock since holdover started */
+      holdoverStop(servo);
+    }
+    else if (servo->holdover.active)
+    {
+      servo->port_state         = m->port_state;
+      servo->current_utc_offset = m->current_utc_offset;
+      holdoverUpdate(rtOpts, servo);
+      if (rtOpts->displayStats)
+        displayStats(rtOpts, servo);
+    }
+    break;
+
+  case MEASURE_CLEAR:
+    initClockVars(rtOpts, port);
+    break;
+
+  case MEASURE_CURRENT:
+    clearTime(&port->offset_from_master);
+    clearTime(&port->one_way_delay);
+    port->offset_from_master_scaled = 0;
+    port->one_way_delay_scaled      = 0;
+    break;
+
+  case MEASURE_STATS:
+    if (servo != port)
+    {
+      servo->port_state         = m->port_state;
+      servo->current_utc_offset = m->current_utc_offset;
+    }
+    displayStats(rtOpts, servo);
+    break;
+
+  case MEASURE_DELAY:
+    updateDelay(m, &port->owd_filt, rtOpts, port);
+    break;
+
+  case MEASURE_PDELAY:
+    updatePathDelay(m, &port->owd_filt, rtOpts, port);
+    clearTime(&servo->t1_sync_delta_time);
+    clearTime(&servo->t2_sync_delta_time);
+    break;
+
+  case MEASURE_SYNC:
+    if (rtOpts->stateFile && !servo->warm_start.checked)
+      servoWarmStart(m, rtOpts, port, servo);
+
+    updateOffset(m, &port->ofm_filt, rtOpts, port);
+    if (servo->holdover.active)
+    {
+      servo->offset_from_master_scaled = port->offset_from_master_scaled;
+      holdoverStop(servo);
+      servoSetState(rtOpts, servo, SERVO_ACQUIRING);
+    }
+    port->last_sync = *m;
+
+    if (servo != port)
+    {
+      servo->port_state                = m->port_state;
+      servo->current_utc_offset        = m->current_utc_offset;
+      servo->observed_v1_variance      = port->observed_v1_variance;
+      servo->offset_from_master_scaled = port->offset_from_master_scaled;
+      servo->one_way_delay_scaled      = port->one_way_delay_scaled;
+      servo->owd_filt                  = port->owd_filt;
+      servo->last_sync                 = *m;
+      copyTime(&servo->offset_from_master,    &port->offset_from_master);
+      copyTime(&servo->master_to_slave_delay, &port->master_to_slave_delay);
+      copyTime(&servo->slave_to_master_delay, &port->slave_to_master_delay);
+      copyTime(&servo->one_way_delay,         &port->one_way_delay);
+    }
+    updateClock(rtOpts, servo);
+
+    port->observed_drift = servo->observed_drift;
+    break;
+
+  default:
+    DBG("servoMeasure: unknown measurement type %d\n", m->type);
+    break;
+  }
+
+  /* V1 Sync and parent data set messages of the port report the drift */
+  __atomic_store_n(&port->published_drift, port->observed_drift, __ATOMIC_RELAXED);
+}
+
+/**
+ * Function to drain the measurement queue of a port, the consumer side
+ * of servoPost()
+ */
+void servoDrain(RunTimeOpts *rtOpts,  /**< run time options */
+                PtpClock    *port,    /**< Port whose queue to drain */
+                PtpClock    *servo    /**< Servo data set (the port itself without port threads) */
+               )
+{
+  MeasureQueue *queue = &port->measure_queue;
+  UInteger32    tail  = queue->tail;
+
+  for (;;)
+  {
+    if (tail == queue->head_cache)
+    {
+      queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+      if (tail == queue->head_cache)
+        break;
+    }
+    servoMeasure(&queue->slot[tail & (MEASURE_QUEUE_SIZE - 1)], rtOpts, port, servo);
+    __atomic_store_n(&queue->tail, ++tail, __ATOMIC_RELEASE);
+  }
+}
+
 // eof servo.c
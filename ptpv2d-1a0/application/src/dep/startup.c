@@ -67,6 +67,7 @@
 #endif
 
 PtpClock *ptpClock;
+UInteger16 ptpClockPorts;      // Number of port structures allocated at ptpClock
 
 int      output_fd;            // AKB: Added file descriptor so output file closed on exit
 
@@ -115,7 +116,7 @@ void freePtpdMemory ()
 
   currentPtpdClockData = ptpClock;
 
-  for (i=0; i<MAX_PTP_PORTS; i++)
+  for (i=0; i<ptpClockPorts; i++)
   {
      if (currentPtpdClockData->foreign)
      {
@@ -129,7 +130,13 @@ void freePtpdMemory ()
 
 void ptpdShutdown()
 {
-  netShutdown(&ptpClock->netPath);
+  int i;
+
+  for (i=0; i<ptpClockPorts; i++)
+  {
+    netShutdown(&ptpClock[i].netPath);
+  }
+  clockShutdown();
   freePtpdMemory();
   all_leds(FALSE);
 #ifdef __WINDOWS__
@@ -138,6 +145,185 @@ void ptpdShutdown()
 #endif
 }
 
+/** Function to split the -b argument into one interface name per
+ * port.  The first name also goes to ifaceName, which the single
+ * port code paths use.
+ *
+ * @return Returns 1 if OK, 0 for an empty or too long name
+ */
+static int parseInterfaceList(char *list, RunTimeOpts *rtOpts)
+{
+  UInteger16 ports;
+  size_t     length;
+  char      *s;
+
+  for (ports = 1, s = list; (s = strchr(s, ',')); s++)
+    ports++;
+
+  free(rtOpts->portIfaceName);
+  rtOpts->portIfaceName = calloc(ports, IFACE_NAME_LENGTH);
+  if (!rtOpts->portIfaceName)
+  {
+    PERROR("parseInterfaceList: failed to allocate %d interface names", ports);
+    return 0;
+  }
+
+  for (rtOpts->numberPorts = 0; rtOpts->numberPorts < ports; rtOpts->numberPorts++)
+  {
+    length = strcspn(list, ",");
+    if (length == 0 || length >= IFACE_NAME_LENGTH)
+    {
+      PERROR("parseInterfaceList: bad interface name in \"%s\"\n", list);
+      return 0;
+    }
+    memcpy(rtOpts->portIfaceName[rtOpts->numberPorts], list, length);
+    list += length + 1;
+  }
+
+  memset( rtOpts->ifaceName, 0, IFACE_NAME_LENGTH);
+  strncpy(rtOpts->ifaceName, rtOpts->portIfaceName[0], IFACE_NAME_LENGTH);
+  return 1;
+}
+
+/** Function to parse the -S argument, the servo name with an optional
+ * linear regression window size
+ *
+ * @return Returns 1 if OK, 0 for an unknown servo or bad window size
+ */
+static int parseServo(char *arg, RunTimeOpts *rtOpts)
+{
+  long  window;
+  char *s;
+
+  if (!strncmp(arg, "pi", 2) && (arg[2] == '\0'))
+  {
+    rtOpts->servo = SERVO_PI;
+    return 1;
+  }
+  if (!strncmp(arg, "lr", 2) && (arg[2] == '\0' || arg[2] == ','))
+  {
+    rtOpts->servo = SERVO_LINREG;
+    if (arg[2] == ',')
+    {
+      window = strtol(arg + 3, &s, 0);
+      if (s == arg + 3 || *s != '\0' || window < LINREG_MIN_SAMPLES || window > LINREG_WINDOW_MAX)
+      {
+        PERROR("parseServo: window must be %d to %d samples\n",
+               LINREG_MIN_SAMPLES,
+               LINREG_WINDOW_MAX
+              );
+        return 0;
+      }
+      rtOpts->servoWindow = window;
+    }
+    return 1;
+  }
+  if (!strcmp(arg, "kalman"))
+  {
+    rtOpts->servo = SERVO_KALMAN;
+    return 1;
+  }
+  PERROR("parseServo: unknown servo \"%s\"\n", arg);
+  return 0;
+}
+
+/** Function to parse the -W argument, the number of exchanges in the
+ * one way delay window optionally followed by the outlier threshold
+ * in median absolute deviations
+ *
+ * @return Returns 1 if OK, 0 for a bad window size or threshold
+ */
+static int parseDelayWindow(char *arg, RunTimeOpts *rtOpts)
+{
+  long  window;
+  long  mads;
+  char *s;
+
+  window = strtol(arg, &s, 0);
+  if (s == arg || (*s != ',' && *s != '\0') || window < 1 || window > DELAY_WINDOW_MAX)
+  {
+    PERROR("parseDelayWindow: window must be 1 to %d exchanges\n", DELAY_WINDOW_MAX);
+    return 0;
+  }
+  rtOpts->delayWindow = window;
+
+  if (*s == ',')
+  {
+    arg  = s + 1;
+    mads = strtol(arg, &s, 0);
+    if (s == arg || *s != '\0' || mads < 0 || mads > 1000)
+    {
+      PERROR("parseDelayWindow: bad outlier threshold \"%s\"\n", arg);
+      return 0;
+    }
+    rtOpts->delayRejectMads = mads;
+  }
+  return 1;
+}
+
+/** Function to parse a -y or -Y message interval, log2 seconds from
+ * PTP_LOG_TICK (the timer tick) to PTP_LOG_INTERVAL_MAX
+ *
+ * @return Returns 1 if OK, 0 for an interval out of range
+ */
+static int parseLogInterval(char *arg, Integer8 *interval)
+{
+  long  log;
+  char *s;
+
+  log = strtol(arg, &s, 0);
+  if (s == arg || *s != '\0' || log < PTP_LOG_TICK || log > PTP_LOG_INTERVAL_MAX)
+  {
+    PERROR("parseLogInterval: interval must be 2^%d to 2^%d sec\n",
+           PTP_LOG_TICK,
+           PTP_LOG_INTERVAL_MAX
+          );
+    return 0;
+  }
+  *interval = (Integer8)log;
+  return 1;
+}
+
+#ifdef linux
+/** Function to parse the -T argument, the CPU of each port thread
+ * followed by the CPU of the servo thread
+ *
+ * @return Returns 1 if OK, 0 for a bad CPU number
+ */
+static int parseThreadCpus(char *list, RunTimeOpts *rtOpts)
+{
+  UInteger16 cpus;
+  long       cpu;
+  char      *s;
+
+  for (cpus = 1, s = list; (s = strchr(s, ',')); s++)
+    cpus++;
+
+  free(rtOpts->threadCpu);
+  rtOpts->threadCpu = calloc(cpus, sizeof(Integer16));
+  if (!rtOpts->threadCpu)
+  {
+    PERROR("parseThreadCpus: failed to allocate %d CPU numbers", cpus);
+    return 0;
+  }
+
+  for (rtOpts->numberThreadCpus = 0; rtOpts->numberThreadCpus < cpus; rtOpts->numberThreadCpus++)
+  {
+    cpu = strtol(list, &s, 0);
+    if (s == list || (*s != ',' && *s != '\0') || cpu < -1 || cpu >= CPU_SETSIZE)
+    {
+      PERROR("parseThreadCpus: bad CPU number in \"%s\"\n", list);
+      return 0;
+    }
+    rtOpts->threadCpu[rtOpts->numberThreadCpus] = cpu;
+    list = s + 1;
+  }
+
+  rtOpts->portThreads = TRUE;
+  return 1;
+}
+#endif
+
 /** Function to pass command line arguments passed
  * to ptp2d at startup time, make sure all options
  * are valid and if so, setup system ptpv2d run
@@ -163,7 +349,7 @@ int parseCommandLineArguments (int           argc,
                              // sets this variable to 1)
   
   /* parse command line arguments */
-  while( (c = getopt(argc, argv, "?cf:dDxta:w:b:u:l:o:e:hy:Y:m:gps:i:v:n:k:rz:28FPH:A:R")) != -1 )
+  while( (c = getopt(argc, argv, "?cf:dDxta:w:b:u:l:o:e:hy:Y:m:gps:i:v:n:k:rz:28FPH:A:RC:T:S:W:j:G")) != -1 )
   {
     switch(c) {
     case '?':
@@ -181,15 +367,38 @@ int parseCommandLineArguments (int           argc,
 "\n"
 "-x                do not reset the clock if off by more than one second\n"
 "-t                do not adjust the system clock\n"
-"-a NUMBER,NUMBER  specify clock servo P and I attenuations\n"
+"-C NAME           discipline clock NAME: system (default), realtime\n"
+"                  (POSIX CLOCK_REALTIME) or a PTP hardware clock (/dev/ptpN),\n"
+"                  which needs hardware time stamps on the interface\n"
+"-a NUMBER,NUMBER  specify clock servo P and I attenuations once locked;\n"
+"                  while acquiring 2 (P) and 4 (I) times smaller, while\n"
+"                  unlocked 4 and 16 times smaller\n"
+"-G                keep the -a attenuations in every lock state\n"
+"-S NAME[,NUMBER]  clock servo: pi (default), lr, a least squares fit of\n"
+"                  frequency and phase over the last NUMBER Syncs (default 16),\n"
+"                  or kalman, a phase and frequency Kalman filter\n"
 "-w NUMBER         specify one way delay filter stiffness\n"
+"-W NUMBER[,NUMBER] one way delay is the minimum of the last NUMBER\n"
+"                  exchanges (1 to 64), samples more than NUMBER median\n"
+"                  absolute deviations (default 4, 0 for none) from the\n"
+"                  median are rejected (once the window holds 4\n"
+"                  samples, or all of a smaller one)\n"
+"-j FILE           save the servo state to FILE every minute and warm\n"
+"                  start from it if it is recent and the master is the same\n"
+"                  (absolute path, the daemon changes directory to /)\n"
 #ifdef CONFIG_MPC831X
 "-H                specify hardware clock period in nanoseconds\n"
 "-A                specify base value for clock frequency adjustment\n"
 "-R                remember adjust value for slave to master transition\n"
 #endif
 "\n"
-"-b NAME           bind PTP to network interface NAME\n"
+"-b NAME[,NAME...] bind PTP to network interface NAME, a list runs\n"
+"                  a boundary clock with one port per interface\n"
+#ifdef linux
+"-T CPU[,CPU...]   run each port and the servo in a thread of its own,\n"
+"                  pinned to the listed CPUs (ports first, then servo,\n"
+"                  -1 for no pinning)\n"
+#endif
 "-u ADDRESS        also send uni-cast to ADDRESS\n"
 "-2                run in PTP version 2 mode instead of version 1\n"
 "-8                run in IEEE 802.1AS PTP Layer 2 mode instead of IP/UDP\n"
@@ -201,8 +410,8 @@ int parseCommandLineArguments (int           argc,
 "-e NUMBER         specify epoch NUMBER\n"
 "-h                specify half epoch\n"
 "\n"
-"-y NUMBER         specify sync interval in 2^NUMBER sec\n"
-"-Y NUMBER         specify announce interval in 2^NUMBER sec\n"
+"-y NUMBER         specify sync interval in 2^NUMBER sec (-7 to 6)\n"
+"-Y NUMBER         specify announce interval in 2^NUMBER sec (-7 to 6)\n"
 "-m NUMBER         specify max number of foreign master records\n"
 "\n"
 "-g                run as slave only\n"
@@ -282,18 +491,66 @@ int parseCommandLineArguments (int           argc,
         rtOpts->ai = (Integer16)strtol(optarg+1, 0, 0);
       break;
       
+    case 'G':
+      // fixed servo gains
+      rtOpts->fixedGains = TRUE;
+      break;
+
+    case 'S':
+      // clock servo and linear regression window
+      if (!parseServo(optarg, rtOpts))
+      {
+        *ret = 1;
+        return 0;
+      }
+      break;
+      
     case 'w':
       // one way delay filter stiffness (s in rtOpts)
       rtOpts->s = (Integer16)strtol(optarg, &optarg, 0);
       break;
+
+    case 'j':
+      // servo state file for warm restarts
+      rtOpts->stateFile = optarg;
+      break;
+
+    case 'W':
+      // windowed one way delay filter and outlier threshold
+      if (!parseDelayWindow(optarg, rtOpts))
+      {
+        *ret = 1;
+        return 0;
+      }
+      break;
       
     case 'b':
-      // User specified bind to a specific interface
-      // Clear ifaceName and copy user specified name to it
-      memset( rtOpts->ifaceName, 0,      IFACE_NAME_LENGTH);
-      strncpy(rtOpts->ifaceName, optarg, IFACE_NAME_LENGTH);
+      // User specified bind to a specific interface, or a comma
+      // separated list of interfaces for a multiple port boundary clock
+      if (!parseInterfaceList(optarg, rtOpts))
+      {
+        *ret = 1;
+        return 0;
+      }
       break;
       
+    case 'C':
+      // Clear clockName and copy user specified clock to it
+      memset( rtOpts->clockName, 0,      CLOCK_NAME_LENGTH);
+      strncpy(rtOpts->clockName, optarg, CLOCK_NAME_LENGTH - 1);
+      break;
+
+#ifdef linux
+    case 'T':
+      // User specified port threads, with the CPU of each thread
+      if (!parseThreadCpus(optarg, rtOpts))
+      {
+        *ret = 1;
+        return 0;
+      }
+      break;
+#endif
+
     case 'u':
       // User specified unicast IP adddress 
       strncpy(rtOpts->unicastAddress, optarg, NET_ADDRESS_LENGTH);
@@ -323,16 +580,24 @@ int parseCommandLineArguments (int           argc,
       
     case 'y':
       // Sync interval in 2^NUMBER seconds (message per # seconds)
-      rtOpts->syncInterval = (Integer8)strtol(optarg, 0, 0);
+      if (!parseLogInterval(optarg, &rtOpts->syncInterval))
+      {
+        *ret = 1;
+        return 0;
+      }
       DBGV("startup: syncInterval = %d\n",
            rtOpts->syncInterval
           );
       break;
       
     case 'Y':
-      // Sync interval in 2^NUMBER seconds (message per # seconds)
-      rtOpts->announceInterval = (Integer8)strtol(optarg, 0, 0);
-      DBGV("startup: syncInterval = %d\n",
+      // Announce interval in 2^NUMBER seconds (message per # seconds)
+      if (!parseLogInterval(optarg, &rtOpts->announceInterval))
+      {
+        *ret = 1;
+        return 0;
+      }
+      DBGV("startup: announceInterval = %d\n",
            rtOpts->announceInterval
           );
       break;
@@ -462,12 +727,15 @@ int allocatePtpdMemory (Integer16 *ret, RunTimeOpts *rtOpts)
   PtpClock * currentPtpdClockData;
   DBG("allocatePtpdMemory:\n");
 
-   // Allocate memory for ptpClock structure(s)
+   // Allocate memory for ptpClock structure(s), cache line aligned
+   // for the measure queue indices (see MeasureQueue)
   
-  ptpClock = (PtpClock*)calloc(MAX_PTP_PORTS, sizeof(PtpClock));
-
-  if(!ptpClock)
+  errno = posix_memalign((void**)&ptpClock, CACHE_LINE_SIZE,
+                         rtOpts->numberPorts * sizeof(PtpClock)
+                        );
+  if(errno)
   {
+    ptpClock = NULL;
     PERROR("allocatePtpdMemory: failed to allocate memory for protocol engine data");
     if (output_fd != 0)
     {
@@ -476,13 +744,15 @@ int allocatePtpdMemory (Integer16 *ret, RunTimeOpts *rtOpts)
     *ret = 2;
     return 0;
   }
+  memset(ptpClock, 0, rtOpts->numberPorts * sizeof(PtpClock));
     DBG(" allocated %d bytes for protocol engine data\n",
-        (int)sizeof(PtpClock)
+        (int)(rtOpts->numberPorts*sizeof(PtpClock))
        );
 
+  ptpClockPorts        = rtOpts->numberPorts;
   currentPtpdClockData = ptpClock;
 
-  for (i=0; i<MAX_PTP_PORTS; i++)
+  for (i=0; i<ptpClockPorts; i++)
   {
     // Allocate space for foreign master record(s)
 
@@ -591,6 +861,19 @@ printf("ptpv2d: %ld seconds and %ld nanoseconds\n", (long int) ts.tv_sec, (long
   {
       return NULL;
   }
+
+  // Open the clock to discipline (system clock unless -C given)
+
+  if (!clockInit(rtOpts))
+  {
+      freePtpdMemory();
+      if (output_fd != 0)
+      {
+         close(output_fd);
+      }
+      *ret = 6;
+      return NULL;
+  }
   
   // If we are here in the code, then all the parsing above was OK
   // and we have allocated primary data structures in memory.
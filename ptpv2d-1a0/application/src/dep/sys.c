@@ -111,6 +111,33 @@ void displayStats(RunTimeOpts *rtOpts, PtpClock *ptpClock)
   }
 
   len += sprintf(sbuf + len, "%s", s);
+
+  if (ptpClock->port_state == PTP_SLAVE || ptpClock->holdover.active)
+  {
+    switch (ptpClock->supervisor.state)
+    {
+    case SERVO_UNLOCKED:   s = "unlk";  break;
+    case SERVO_ACQUIRING:  s = "acq ";  break;
+    case SERVO_LOCKED:     s = "lock";  break;
+    default:               s = "hold";  break;
+    }
+    len += sprintf(sbuf + len,
+                   ", %s%s",
+                   rtOpts->csvStats ? "" : "servo: ",
+                   s
+                  );
+  }
+
+  if (ptpClock->holdover.active)
+  {
+    len += sprintf(sbuf + len,
+                   ", %s%d, %s%d",
+                   rtOpts->csvStats ? "" : "hold: ",
+                   ptpClock->holdover.adj,
+                   rtOpts->csvStats ? "" : "bound: ",
+                   ptpClock->holdover.bound
+                  );
+  }
   
   if(ptpClock->port_state == PTP_SLAVE)
   {
@@ -137,6 +164,25 @@ void displayStats(RunTimeOpts *rtOpts, PtpClock *ptpClock)
                    ptpClock->observed_drift
                   );
 
+    if (rtOpts->servo != SERVO_PI)
+    {
+      len += sprintf(sbuf + len, 
+                     ", %s%d",
+                     rtOpts->csvStats ? "" : "jit: ",
+                     rtOpts->servo == SERVO_LINREG ? ptpClock->linreg.jitter
+                                                   : ptpClock->kalman.jitter
+                    );
+    }
+
+    if (rtOpts->delayWindow)
+    {
+      len += sprintf(sbuf + len, 
+                     ", %s%u",
+                     rtOpts->csvStats ? "" : "rej: ",
+                     ptpClock->owd_window.rejected
+                    );
+    }
+
 /* Variance not supported, comment statistic out
     len += sprintf(sbuf + len, 
                    ", %s%d",
@@ -160,17 +206,17 @@ void displayStats(RunTimeOpts *rtOpts, PtpClock *ptpClock)
     len += sprintf(sbuf + len,
                    ", %s%s%d.%09d",
                    rtOpts->csvStats ? "" : "sst: ",
-                   (ptpClock->t1_sync_tx_time.nanoseconds < 0) ? "-" : " ",
-                   ptpClock->t1_sync_tx_time.seconds,
-                   abs(ptpClock->t1_sync_tx_time.nanoseconds)
+                   (ptpClock->last_sync.t1.nanoseconds < 0) ? "-" : " ",
+                   ptpClock->last_sync.t1.seconds,
+                   abs(ptpClock->last_sync.t1.nanoseconds)
                   );
 
     len += sprintf(sbuf + len,
                    ", %s%s%d.%09d",
                    rtOpts->csvStats ? "" : "srt: ",
-                   (ptpClock->t2_sync_rx_time.nanoseconds < 0) ? "-" : " ",
-                   ptpClock->t2_sync_rx_time.seconds,
-                   abs(ptpClock->t2_sync_rx_time.nanoseconds)
+                   (ptpClock->last_sync.t2.nanoseconds < 0) ? "-" : " ",
+                   ptpClock->last_sync.t2.seconds,
+                   abs(ptpClock->last_sync.t2.nanoseconds)
                   );
 
     len += sprintf(sbuf + len,
@@ -312,6 +358,104 @@ void setSystemTimeFromPtp(Integer16 utc_offset)
 #endif
 }
 
+/* Run-time selected clock backend, see clockInit() */
+static UInteger8 sysClockBackend = CLOCK_BACKEND_SYSTEM;
+#ifdef linux
+static clockid_t sysClockId      = CLOCK_REALTIME;
+static int       sysClockFd      = -1;
+#endif
+
+/** 
+ * @brief Function to select the clock that getTime(), setTime() and
+ * adjFreq() read and discipline:
+ *
+ * - "system" (or empty): legacy gettimeofday/settimeofday/adjtimex
+ * - "realtime":          POSIX CLOCK_REALTIME via clock_gettime/clock_adjtime
+ * - "/dev/ptpN":         NIC PTP hardware clock (POSIX dynamic clock),
+ *                        which runs on the PTP (TAI) time scale
+ *
+ * @param[in]  rtOpts  Run time options (clockName)
+ * @returns TRUE if the clock could be opened, otherwise FALSE
+ */
+Boolean clockInit(RunTimeOpts *rtOpts)
+{
+#if defined(linux) && !defined(CONFIG_MPC831X)
+  struct timespec ts;
+
+  if (   rtOpts->clockName[0] == '\0'
+      || strcmp((char *)rtOpts->clockName, "system") == 0
+     )
+  {
+    sysClockBackend = CLOCK_BACKEND_SYSTEM;
+    return TRUE;
+  }
+
+  if (strcmp((char *)rtOpts->clockName, "realtime") == 0)
+  {
+    sysClockBackend = CLOCK_BACKEND_POSIX;
+    sysClockId      = CLOCK_REALTIME;
+  }
+  else
+  {
+    sysClockFd = open((char *)rtOpts->clockName, O_RDWR);
+    if (sysClockFd < 0)
+    {
+      PERROR("clockInit: failed to open clock %s", rtOpts->clockName);
+      return FALSE;
+    }
+    sysClockBackend = CLOCK_BACKEND_PHC;
+    sysClockId      = FD_TO_CLOCKID(sysClockFd);
+  }
+
+  if (clock_gettime(sysClockId, &ts) < 0)
+  {
+    PERROR("clockInit: %s is not a usable clock", rtOpts->clockName);
+    clockShutdown();
+    return FALSE;
+  }
+
+  NOTIFY("clockInit: using clock %s\n", rtOpts->clockName);
+  return TRUE;
+#else
+  if (   rtOpts->clockName[0] == '\0'
+      || strcmp((char *)rtOpts->clockName, "system") == 0
+     )
+  {
+    return TRUE;
+  }
+  PERROR("clockInit: clock %s not supported on this system", rtOpts->clockName);
+  return FALSE;
+#endif
+}
+
+/** 
+ * @brief Function to release the clock selected by clockInit()
+ * and fall back to the system clock
+ */
+void clockShutdown(void)
+{
+#ifdef linux
+  if (sysClockFd >= 0)
+  {
+    close(sysClockFd);
+    sysClockFd = -1;
+  }
+  sysClockId = CLOCK_REALTIME;
+#endif
+  sysClockBackend = CLOCK_BACKEND_SYSTEM;
+}
+
+/** 
+ * @brief Function to check if the selected clock is a PTP hardware
+ * clock, in which case receive time stamps should come from the NIC
+ *
+ * @returns TRUE if a PHC is selected
+ */
+Boolean clockIsPhc(void)
+{
+  return sysClockBackend == CLOCK_BACKEND_PHC;
+}
+
 /** 
  * @brief Function to get time from the system or specific
  * hardware PTP timer (based on system capabilities
@@ -374,11 +518,27 @@ void getTime(TimeInternal *time, Integer16 utc_offset)
 #else
   /* Not windows time, system time is in Linux format */
   struct timeval tv;
-  
-  gettimeofday(&tv, 0);
+#ifdef linux
+  struct timespec ts;
+
+  if (sysClockBackend != CLOCK_BACKEND_SYSTEM)
+  {
+    clock_gettime(sysClockId, &ts);
+
+    time->seconds     =  ts.tv_sec;
+    time->nanoseconds =  ts.tv_nsec;
 
-  time->seconds     =  tv.tv_sec;
-  time->nanoseconds =  tv.tv_usec*1000;
+    if (sysClockBackend == CLOCK_BACKEND_PHC)
+      return;  /* PHC already runs on PTP (TAI) time, no UTC offset */
+  }
+  else
+#endif
+  {
+    gettimeofday(&tv, 0);
+
+    time->seconds     =  tv.tv_sec;
+    time->nanoseconds =  tv.tv_usec*1000;
+  }
 #endif
 
   /* PTP uses TAI time (time without leap seconds
@@ -451,20 +611,81 @@ void setTime(TimeInternal *time, Integer16 utc_offset)
   // (leap seconds since January 1, 1970) and set
   // the time
   struct timeval tv;
-  
-  tv.tv_sec  = time->seconds;
-  tv.tv_usec = time->nanoseconds/1000;
+#ifdef linux
+  struct timespec ts;
 
-  /* PTP uses TAI, gettime of day is UTC, so adjust by subtracting 
-   * UTC offset from TAI to adjust for leap seconds
-   */
-  tv.tv_sec  -= utc_offset;
-  settimeofday(&tv, 0);
+  if (sysClockBackend != CLOCK_BACKEND_SYSTEM)
+  {
+    ts.tv_sec  = time->seconds;
+    ts.tv_nsec = time->nanoseconds;
+
+    /* PHC runs on PTP (TAI) time, CLOCK_REALTIME is UTC */
+    if (sysClockBackend != CLOCK_BACKEND_PHC)
+      ts.tv_sec -= utc_offset;
+
+    if (clock_settime(sysClockId, &ts) < 0)
+      PERROR("setTime: failed to set clock");
+  }
+  else
+#endif
+  {
+    tv.tv_sec  = time->seconds;
+    tv.tv_usec = time->nanoseconds/1000;
+
+    /* PTP uses TAI, gettime of day is UTC, so adjust by subtracting 
+     * UTC offset from TAI to adjust for leap seconds
+     */
+    tv.tv_sec  -= utc_offset;
+    settimeofday(&tv, 0);
+  }
 #endif  
 
   NOTIFY("setTime: resetting clock to UTC %ds %dns\n", time->seconds, time->nanoseconds);
 }
 
+/** 
+ * @brief Function to step the clock by subtracting an offset from it.
+ * The kernel applies the offset atomically (ADJ_SETOFFSET), so time
+ * spent between reading and setting the clock (including preemption)
+ * does not end up as a phase error after the step.
+ *
+ * @param[in]  offset  Pointer to TimeInternal offset from master to remove
+ * @returns TRUE if the clock was stepped, FALSE if not supported (caller
+ *          must fall back to getTime()/setTime())
+ */
+Boolean stepTime(TimeInternal *offset)
+{
+#if defined(linux) && defined(ADJ_SETOFFSET) && !defined(CONFIG_MPC831X)
+  struct timex t;
+
+  memset(&t, 0, sizeof(t));
+  t.modes        = ADJ_SETOFFSET | ADJ_NANO;
+  t.time.tv_sec  = -offset->seconds;
+  t.time.tv_usec = -offset->nanoseconds;   /* nanoseconds with ADJ_NANO */
+
+  /* Kernel wants a non-negative fraction of a second */
+  if (t.time.tv_usec < 0)
+  {
+    t.time.tv_sec  -= 1;
+    t.time.tv_usec += 1000000000;
+  }
+
+  if (clock_adjtime(sysClockId, &t) < 0)
+  {
+    DBG("stepTime: ADJ_SETOFFSET failed (%d), using set time\n", errno);
+    return FALSE;
+  }
+
+  NOTIFY("stepTime: stepped clock by %ds %dns\n",
+         -offset->seconds,
+         -offset->nanoseconds
+        );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
 /** 
  * @brief Function to map generic need for a 16 bit unsigned random integer to
  * appropriate system random function/library
@@ -503,6 +724,19 @@ Boolean adjFreq(Integer32 adj)
 #elif defined(__WINDOWS__)
   return(!( SetSystemTimeAdjustment((adj/100),FALSE)));
 #else
+#ifdef linux
+  if (sysClockBackend != CLOCK_BACKEND_SYSTEM)
+  {
+    /* timex freq is in ppm with 16 bit fraction ("scaled ppm"),
+     * adj is in ppb
+     */
+    memset(&t, 0, sizeof(t));
+    t.modes = ADJ_FREQUENCY;
+    t.freq  = (long)(((Integer64)adj << 16) / 1000);
+
+    return clock_adjtime(sysClockId, &t) >= 0;
+  }
+#endif
   t.modes = MOD_FREQUENCY;
   t.freq = adj*((1<<16)/1000);
 
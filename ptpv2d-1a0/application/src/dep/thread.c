@@ -0,0 +1,202 @@
+/* src/dep/thread.c */
+/* System dependent functions to run each PTP port and the clock
+ * servo in a thread of its own
+ */
+
+/**
+ * @file thread.c
+ *
+ * @brief Port threads and servo thread (-T option)
+ *
+ * Each port thread runs the protocol engine of one port, with its own
+ * epoll instance and timer heap, so a busy port cannot delay the receive
+ * and time stamp processing of another.  The measurement queue of each
+ * port (see servo.c) is drained by the single servo thread, so only the
+ * servo thread adjusts the clock.
+ *
+ * @par License
+ * This file is licensed under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include "../ptpd.h"
+
+static RunTimeOpts *threadRtOpts;
+static PtpClock    *threadPorts;
+static int          servoWakeFd[2] = { -1, -1 };  /**< Pipe waking the servo thread */
+
+/** Lock for the data the ports of a clock share (foreign master records
+ * read by the BMC of every port)
+ */
+static pthread_mutex_t clockMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Port threads signal the main thread when they stop */
+static pthread_mutex_t threadDoneMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  threadDoneCond  = PTHREAD_COND_INITIALIZER;
+static Boolean         threadDone      = FALSE;
+
+void clockLock(void)
+{
+  pthread_mutex_lock(&clockMutex);
+}
+
+void clockUnlock(void)
+{
+  pthread_mutex_unlock(&clockMutex);
+}
+
+/** Function to pin the calling thread to a CPU, -1 leaves it unpinned */
+static void threadPin(Integer16 cpu, const char *name)
+{
+  cpu_set_t cpus;
+
+  if (cpu < 0)
+    return;
+
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if ((errno = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0)
+  {
+    PERROR("threadPin: failed to pin %s thread to CPU %d", name, cpu);
+    return;
+  }
+  DBG("threadPin: %s thread on CPU %d\n", name, cpu);
+}
+
+/** Function to get the CPU configured for thread index i (ports first,
+ * then the servo thread)
+ */
+static Integer16 threadCpu(int i)
+{
+  if (i < threadRtOpts->numberThreadCpus)
+    return threadRtOpts->threadCpu[i];
+  return -1;
+}
+
+/** Function for a port thread to wake the servo thread after queueing
+ * a measurement
+ */
+void threadWakeServo(void)
+{
+  /* A full pipe means the servo thread is awake already */
+  if (write(servoWakeFd[1], "", 1) < 0 && errno != EAGAIN)
+  {
+    PERROR("threadWakeServo: failed to wake servo thread");
+  }
+}
+
+/** Servo thread, the only thread to adjust the clock */
+static void *servoThread(void *arg)
+{
+  PtpClock   *servo = arg;   /* Servo data set, not any port's */
+  char        wake[MEASURE_QUEUE_SIZE];
+  int         i;
+
+  threadPin(threadCpu(threadRtOpts->numberPorts), "servo");
+
+  for (;;)
+  {
+    if (read(servoWakeFd[0], wake, sizeof(wake)) < 0 && errno != EINTR)
+    {
+      PERROR("servoThread: failed to wait for measurements");
+      return NULL;
+    }
+
+    for (i = 0; i < threadRtOpts->numberPorts; i++)
+    {
+      servoDrain(threadRtOpts, &threadPorts[i], servo);
+    }
+  }
+}
+
+/** Port thread, runs the protocol engine of one port */
+static void *portThread(void *arg)
+{
+  PtpClock *ptpClock = arg;
+  char      name[16];
+
+  snprintf(name, sizeof(name), "port %d", ptpClock->port_id_field);
+  threadPin(threadCpu(ptpClock->port_id_field - 1), name);
+
+  protocol(threadRtOpts, ptpClock);
+
+  NOTIFY("portThread: port %d self shutdown, probably due to an error\n",
+         ptpClock->port_id_field
+        );
+  pthread_mutex_lock(&threadDoneMutex);
+  threadDone = TRUE;
+  pthread_cond_signal(&threadDoneCond);
+  pthread_mutex_unlock(&threadDoneMutex);
+  return NULL;
+}
+
+/**
+ * Main function for handling protocol with port threads.  Starts the
+ * servo thread and one thread per port and returns when a port thread
+ * stops.
+ */
+void threadProtocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
+                    PtpClock    *ptpClock /**< Pointer to array of ptpClock structures */
+                   )
+{
+  pthread_t        thread;
+  PtpClock        *servo;
+  struct timespec  wait;
+  int              i;
+
+  threadRtOpts = rtOpts;
+  threadPorts  = ptpClock;
+
+  /* PtpClock is cache line aligned (see MeasureQueue) */
+  errno = posix_memalign((void**)&servo, CACHE_LINE_SIZE, sizeof(PtpClock));
+  if (errno)
+  {
+    PERROR("threadProtocol: failed to allocate servo data");
+    return;
+  }
+  memset(servo, 0, sizeof(PtpClock));
+
+  if (   pipe(servoWakeFd) < 0
+      || fcntl(servoWakeFd[1], F_SETFL, O_NONBLOCK) < 0
+     )
+  {
+    PERROR("threadProtocol: failed to create servo wake pipe");
+    return;
+  }
+
+  if (pthread_create(&thread, NULL, servoThread, servo) != 0)
+  {
+    PERROR("threadProtocol: failed to start servo thread");
+    return;
+  }
+  pthread_detach(thread);
+
+  for (i = 0; i < rtOpts->numberPorts; i++)
+  {
+    if (pthread_create(&thread, NULL, portThread, &ptpClock[i]) != 0)
+    {
+      PERROR("threadProtocol: failed to start thread of port %d", i + 1);
+      return;
+    }
+    pthread_detach(thread);
+  }
+
+  /* The main thread writes the servo state file (-j), so the file
+   * system never holds up the servo thread
+   */
+  pthread_mutex_lock(&threadDoneMutex);
+  while (!threadDone)
+  {
+    clock_gettime(CLOCK_REALTIME, &wait);
+    wait.tv_sec++;
+    pthread_cond_timedwait(&threadDoneCond, &threadDoneMutex, &wait);
+
+    pthread_mutex_unlock(&threadDoneMutex);
+    servoWriteState(rtOpts, servo);
+    pthread_mutex_lock(&threadDoneMutex);
+  }
+  pthread_mutex_unlock(&threadDoneMutex);
+}
+
+// eof thread.c
@@ -62,171 +62,229 @@
 #include "../ptpd.h"
 
 /**
- * TIMER_INTERVAL is based on number of "TICKS" as set
- * by initTimer function where currently 1 Tick
- * maps to the seconds and microseconds value passed
- * when calling initTimer
+ * Timer intervals are based on number of "TICKS" as set
+ * by initTimer function where 1 Tick is 2^logTick
+ * seconds (2^PTP_LOG_TICK, so the fastest Sync rate is one
+ * tick and all slower ones are exact multiples of it).
+ *
+ * Running timers of all ports are kept in one binary min-heap
+ * keyed by their absolute CLOCK_MONOTONIC deadline (in nanoseconds).
+ * Starting or stopping a timer is O(log n), the next deadline is
+ * always at the top of the heap, and expiry processing only touches
+ * the timers that are actually due.  timerArm points a single timerfd
+ * (registered in the main event loop) at the top of the heap, so the
+ * daemon sleeps exactly until the next timer is due.  With port
+ * threads each thread has its own heap and timerfd.
  */
-#define TIMER_INTERVAL 1
 
 /* Timer global variables */
 
-#ifdef __WINDOWS__
-HANDLE TimerQueue;
-#endif
+/** Length of one timer tick in nanoseconds (set by initTimer) */
+static PTPD_THREAD_LOCAL Integer64 timerTickNs = 1000000000LL;
+
+/** Min-heap of running timers of all ports, ordered by deadline.
+ * Grown by TIMER_ARRAY_SIZE slots when a port starts more timers
+ * than fit, so it ends up sized for the configured number of ports
+ */
+static PTPD_THREAD_LOCAL IntervalTimer **timerHeap;
+
+/** Number of running timers in timerHeap */
+static PTPD_THREAD_LOCAL int timerHeapCount = 0;
+
+/** Number of slots allocated at timerHeap */
+static PTPD_THREAD_LOCAL int timerHeapSize = 0;
 
-/** Elaspsed time (allocated one integer per PTP port) */
-int elapsed[MAX_PTP_PORTS];
+#ifdef linux
+/** CLOCK_MONOTONIC timerfd registered in the main event loop */
+static PTPD_THREAD_LOCAL int timerFd = -1;
+
+/** Deadline the timerfd is currently armed for (0 if disarmed) */
+static PTPD_THREAD_LOCAL Integer64 timerArmedDeadline = 0;
+#endif
 
 #ifdef LIMIT_RUNTIME
 /* Variables to allow for limited run time (i.e. terminate the
  * system after a certain amount of time since the daemon
  * was started
  */
-int max_ticks=14400; /*14400 4 hours in seconds (60 *60 * 4) */ 
-int license_tick_counter = 0;
+Integer64 max_runtime_ns = 14400LL * 1000000000LL; /*14400 4 hours in seconds (60 *60 * 4) */ 
+Integer64 timerStartTime = 0;
 #endif
 
-/* catch_alarm:
- * Simple function to be called by the operating
- * system on a periodic basis, update the
- * private timer array table and return
+/** Function to store a timer at a heap position and update its
+ * back reference (heapSlot is position + 1, 0 means not queued)
  */
-#ifdef __WINDOWS__
-VOID CALLBACK catch_alarm(PVOID lpParameter, BOOLEAN TimerOrWaitFired)
-#else
-void catch_alarm(int sig)
-#endif
+static void timerHeapSet(int pos, IntervalTimer *timer)
+{
+  timerHeap[pos]  = timer;
+  timer->heapSlot = pos + 1;
+}
+
+/** Function to move a timer towards the top of the heap until its
+ * parent has an earlier or equal deadline
+ */
+static void timerHeapUp(int pos)
 {
-  int i;
+  IntervalTimer *timer = timerHeap[pos];
+  int parent;
 
-  for (i=0; i<MAX_PTP_PORTS; i++)
+  while (pos > 0)
   {
-    elapsed[i] += TIMER_INTERVAL;
+    parent = (pos - 1) / 2;
+    if (timerHeap[parent]->deadline <= timer->deadline)
+      break;
+    timerHeapSet(pos, timerHeap[parent]);
+    pos = parent;
   }
-  // NOTE: If you put in a debug print here, it will interleave with other messages
-  // from the normal execution task.  So if you need to put one in, put it
-  // in to verify it, but remove it once you verify timeout is occurring OK.
-#ifdef TEMPORARY_DEBUG_TIMER_TICK
-#ifdef PTPD_DBG
-  if (debugLevel >= 1) 
+  timerHeapSet(pos, timer);
+}
+
+/** Function to move a timer towards the bottom of the heap until
+ * both children have a later or equal deadline
+ */
+static void timerHeapDown(int pos)
+{
+  IntervalTimer *timer = timerHeap[pos];
+  int child;
+
+  for (;;)
   {
-    DBGV("\n(***tick %u***)\n",elapsed[0]);
-    fflush(NULL);
+    child = 2 * pos + 1;
+    if (child >= timerHeapCount)
+      break;
+    if (   child + 1 < timerHeapCount
+        && timerHeap[child + 1]->deadline < timerHeap[child]->deadline
+       )
+      child++;
+    if (timer->deadline <= timerHeap[child]->deadline)
+      break;
+    timerHeapSet(pos, timerHeap[child]);
+    pos = child;
   }
-#endif
-#endif
+  timerHeapSet(pos, timer);
+}
 
-  
-  /*  fprintf(stderr, "tick: %d, %d\n",max_ticks,license_tick_counter); */
+/** Function to restore heap order after a queued timer's
+ * deadline was changed
+ */
+static void timerHeapFix(int pos)
+{
+  if (pos > 0 && timerHeap[(pos - 1) / 2]->deadline > timerHeap[pos]->deadline)
+    timerHeapUp(pos);
+  else
+    timerHeapDown(pos);
+}
 
-#ifdef LIMIT_RUNTIME
- /* Check Limit run timer */
- if (++license_tick_counter > max_ticks)
- {
-    fprintf(stderr, "\nptpv2d: Evaluation license maximum run time reached, terminating!\n"); 
-    raise(SIGTERM); // Time up, send a terminate signal to the ptpv2d task
- }
- /* End run time limit timer*/
-#endif
+/** Function to remove a timer from the heap (no-op if not queued) */
+static void timerHeapRemove(IntervalTimer *timer)
+{
+  int pos = timer->heapSlot - 1;
+
+  if (pos < 0)
+    return;
 
+  timer->heapSlot = 0;
+  if (--timerHeapCount == pos)
+    return;                      // Was the last entry, nothing to reorder
+
+  timerHeapSet(pos, timerHeap[timerHeapCount]);
+  timerHeapFix(pos);
 }
 
-/** Function to initialize the global timer for ptpv2d
- * timer functions
+/** Function to get current monotonic time in nanoseconds.
+ * All timer deadlines use this clock so they are not
+ * disturbed when the PTP servo steps the system clock
  */
-void initTimer(Integer32  seconds,
-               UInteger32 microseconds
-              )
+Integer64 timerNow(void)
 {
 #ifdef __WINDOWS__
-  BOOL success;
+  return (Integer64)GetTickCount64() * 1000000LL;
 #else
-  struct itimerval itimer;
-  int i;  
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (Integer64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 #endif
+}
 
-  DBG("initTimer: %d seconds, %u microseconds\n",
-      seconds,
-      microseconds
-     );
-#ifdef __WINDOWS__
-    success = CreateTimerQueueTimer
-       (
-        &TimerQueue,            // Handle for timer
-        NULL,                   // NULL for default timer queue
-        catch_alarm,            // Callback function (NOTE: must be fast)
-        NULL,                   // Pointer to data for callback function
-        0,                      // Time (ms) before timer signaled for the first time
-        ( (seconds*1000)        // Interval time in milliseconds
-         +(microseconds/1000)
-        ),
-        WT_EXECUTEINIOTHREAD
-        //WT_EXECUTEINTIMERTHREAD // Run in timer thread (callback function must be quick
-       );
-    if (!success)
-        DBG("Failed to created windows timer\n");
-#else
-  //
-  // Not Windows code (e.g. Linux)
-  //
-  // Set Alarm clock signal to ignore
-  signal(SIGALRM, SIG_IGN);
-
-  //
-  // Clear elapsed time for all ports
-  //
-  for (i=0; i<MAX_PTP_PORTS; i++)
-  {
-      elapsed[i] = 0;
-  }
+/** Function to initialize the global timer for ptpv2d
+ * timer functions, with ticks of 2^logTick seconds
+ */
+Boolean initTimer(Integer8 logTick)
+{
+  timerTickNs = logTick < 0 ? 1000000000LL >> -logTick
+                            : 1000000000LL <<  logTick;
+
+  DBG("initTimer: %lld nanoseconds/tick\n", timerTickNs);
 
 #ifdef LIMIT_RUNTIME
-  // Adjust run time limit timer if timer less than one second per tick
-  if (seconds == 0)
+  if (timerStartTime == 0)
   {
-    max_ticks *= (1000000/microseconds);
+    timerStartTime = timerNow();
   }
 #endif
 
-  // Set interval timer values  
-  itimer.it_value.tv_sec  = itimer.it_interval.tv_sec  = seconds;
-  itimer.it_value.tv_usec = itimer.it_interval.tv_usec = microseconds;
-  
-  // Set Alarm clock signal to catch_alarm function above
-  signal(SIGALRM, catch_alarm);
-
-  // Set and start interval timer
-  setitimer(ITIMER_REAL,  // Use real time clock (do not use time of day)
-            &itimer,      // Pointer to new itimerval structure 
-            0             // Pointer to old structure (none in this case)
-           );  
+#ifdef linux
+  if (timerFd < 0)
+  {
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd < 0)
+    {
+      PERROR("initTimer: failed to create timerfd");
+      return FALSE;
+    }
+    if (!netRegisterTimer(timerFd))
+    {
+      PERROR("initTimer: failed to add timerfd to event loop");
+      close(timerFd);
+      timerFd = -1;
+      return FALSE;
+    }
+  }
+  timerArmedDeadline = 0;
 #endif
+  return TRUE;
 }
 
-void timerUpdate(IntervalTimer *itimer, int port_id)
+/** Function to process all timers whose deadline has passed.
+ * Each due timer is flagged as expired (picked up by timerExpired)
+ * and rescheduled one period later.
+ */
+void timerUpdate(void)
 {
-  int i, delta;
-  
-  i = port_id -1;
-  delta   = elapsed[i];
-  elapsed[i] = 0;
-  
-  if(delta <= 0)
-    return;
-  
-  for(i = 0; i < TIMER_ARRAY_SIZE; ++i)
+  IntervalTimer *timer;
+  Integer64 now, period;
+
+  now = timerNow();
+
+#ifdef LIMIT_RUNTIME
+ /* Check Limit run timer */
+ if (now - timerStartTime > max_runtime_ns)
+ {
+    fprintf(stderr, "\nptpv2d: Evaluation license maximum run time reached, terminating!\n"); 
+    raise(SIGTERM); // Time up, send a terminate signal to the ptpv2d task
+ }
+ /* End run time limit timer*/
+#endif
+
+  while (timerHeapCount > 0 && timerHeap[0]->deadline <= now)
   {
-    if(itimer[i].interval > 0 && (itimer[i].left -= delta) <= 0)
+    timer  = timerHeap[0];
+    period = timer->interval * timerTickNs;
+    timer->deadline += period;
+    if(timer->deadline <= now)
     {
-      itimer[i].left   = itimer[i].interval;
-      itimer[i].expire = TRUE;
-      DBGV("timerUpdate: timer index %u expired (interval=%d delta=%d)\n",
-           i,
-           itimer[i].interval,
-           delta
-          );
+      // Missed one or more whole periods, skip them rather than
+      // expiring again immediately, but stay on the period grid so
+      // a late wakeup does not shift every later Sync
+      timer->deadline += ((now - timer->deadline) / period + 1) * period;
     }
+    timer->expire = TRUE;
+    timerHeapDown(0);
+    DBGV("timerUpdate: timer %p expired (interval=%d)\n",
+         (void *)timer,
+         timer->interval
+        );
   }
 }
 
@@ -236,25 +294,58 @@ void timerStop(UInteger16 index, IntervalTimer *itimer)
     return;
   
   itimer[index].interval = 0;
+  timerHeapRemove(&itimer[index]);
   DBGV("timerStop: timer index %u stopped\n", index);
 }
 
-void timerStart(UInteger16 index, UInteger16 interval, IntervalTimer *itimer)
+void timerStart(UInteger16 index, UInteger32 interval, IntervalTimer *itimer)
 {
+  IntervalTimer  *timer;
+  IntervalTimer **heap;
+
   if(index >= TIMER_ARRAY_SIZE)
     return;
+
+  timer = &itimer[index];
+  if(interval == 0)
+  {
+    timerStop(index, itimer);    // Zero interval means stopped
+    return;
+  }
+
+  timer->expire   = FALSE;
+  timer->interval = interval;
+  timer->deadline = timerNow() + interval * timerTickNs;
+
+  if(timer->heapSlot > 0)
+  {
+    timerHeapFix(timer->heapSlot - 1);   // Restart, already queued
+  }
+  else
+  {
+    if(timerHeapCount == timerHeapSize)
+    {
+      heap = realloc(timerHeap, (timerHeapSize + TIMER_ARRAY_SIZE) * sizeof(IntervalTimer *));
+      if(!heap)
+      {
+        PERROR("timerStart: failed to grow timer heap, index %d not started", index);
+        timer->interval = 0;
+        return;
+      }
+      timerHeap      = heap;
+      timerHeapSize += TIMER_ARRAY_SIZE;
+    }
+    timerHeapSet(timerHeapCount, timer);
+    timerHeapUp(timerHeapCount++);
+  }
   
-  itimer[index].expire   = FALSE;
-  itimer[index].left     = interval;
-  itimer[index].interval = itimer[index].left;
-  
-  DBGV("timerStart: set timer index %d to %d\n", index, interval);
+  DBGV("timerStart: set timer index %d to %u\n", index, interval);
 }
 
 Boolean timerExpired(UInteger16 index, IntervalTimer *itimer, int port_id)
 {
   DBGV("timerExpired: Checking index %d\n", index);
-  timerUpdate(itimer, port_id);
+  timerUpdate();
   
   if(index >= TIMER_ARRAY_SIZE)
     return FALSE;                // ERROR:index out of range, return false
@@ -267,4 +358,65 @@ Boolean timerExpired(UInteger16 index, IntervalTimer *itimer, int port_id)
   return TRUE;                   // Return TRUE
 }
 
+/** Function to get the earliest deadline of all running timers
+ * (top of the heap), or 0 if no timer is running
+ */
+Integer64 timerNextDeadline(void)
+{
+  return timerHeapCount > 0 ? timerHeap[0]->deadline : 0;
+}
+
+/** Function to arm the event loop timer for the earliest
+ * running timer deadline of all PTP ports.  Called by the
+ * main loop just before it waits for socket activity.
+ * Deadlines that have already passed are latched as expired
+ * first, so the timer is always armed for a future time.
+ */
+void timerArm(void)
+{
+  Integer64 next;
+#ifdef linux
+  struct itimerspec its;
+#endif
+
+  timerUpdate();
+  next = timerNextDeadline();
+
+#ifdef linux
+  if (timerFd < 0 || next == timerArmedDeadline)
+    return;                      // Already armed for this deadline
+
+  memset(&its, 0, sizeof(its));  // All zero disarms the timer
+  its.it_value.tv_sec  = next / 1000000000LL;
+  its.it_value.tv_nsec = next % 1000000000LL;
+  if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+  {
+    PERROR("timerArm: failed to arm timerfd");
+    timerArmedDeadline = 0;
+    return;
+  }
+  timerArmedDeadline = next;
+#endif
+}
+
+/** Function to get the time left until the earliest timer
+ * deadline, for event loops that cannot wait on the timerfd.
+ * Returns FALSE if no timer is running
+ */
+Boolean timerWaitTime(TimeInternal *wait)
+{
+  Integer64 next, left;
+
+  next = timerNextDeadline();
+  if (next == 0)
+    return FALSE;
+
+  left = next - timerNow();
+  if (left < 0)
+    left = 0;
+  wait->seconds     = left / 1000000000LL;
+  wait->nanoseconds = left % 1000000000LL;
+  return TRUE;
+}
+
 // eof timer.c
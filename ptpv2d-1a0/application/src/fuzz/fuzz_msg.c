@@ -0,0 +1,275 @@
+/* src/fuzz/fuzz_msg.c */
+/* Fuzz target for the received message parsers of msg.c */
+
+/**
+ * @file fuzz_msg.c
+ *
+ * Runs msgPeek() over an arbitrary buffer and, if it accepts the buffer,
+ * the parsers handleMessage() would run for that version and message
+ * type: the msgUnpack* routine and the msgView accessors.  The buffer is
+ * a heap copy sized exactly to the input, so a sanitizer build reports
+ * any read past the received length.  V1 management messages get the
+ * zero filled PACKET_SIZE buffer handleManagement() gives them.
+ *
+ * Built with -DFUZZ_LIBFUZZER (make fuzz) this is a libFuzzer target.
+ * Otherwise main() replays the files and directories on the command
+ * line, each followed by a number of random mutations (make check runs
+ * it over fuzz/corpus).
+ *
+ * @par Usage
+ * fuzz_msg [-m mutations] file|directory...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "../ptpd.h"
+
+int debugLevel = 0;
+
+/* msg.c reads and sets the clock for some management messages, which
+ * are not parsed on receive
+ */
+void getTime(TimeInternal *time, Integer16 utc_offset) { memset(time, 0, sizeof(*time)); }
+void setTime(TimeInternal *time, Integer16 utc_offset) { }
+
+/** Everything the parsers write, so the results can't be optimized away */
+static union {
+  MsgHeader               header;
+  MsgSync                 sync;
+  MsgFollowUp             follow;
+  MsgDelayResp            resp;
+  MsgManagement           manage;
+  V2MsgHeader             v2header;
+  V2MsgSync               v2sync;
+  V2MsgFollowUp           v2follow;
+  V2MsgDelayResp          v2resp;
+  V2MsgPDelayResp         v2presp;
+  V2MsgPDelayRespFollowUp v2pfollow;
+  MsgAnnounce             announce;
+} out;
+
+static volatile UInteger32 sink;
+
+/** Run the V1 parsers on an accepted message */
+static void parseV1(UInteger8 *buf, Integer32 length)
+{
+  UInteger8 pad[PACKET_SIZE];
+
+  msgUnpackHeader(buf, &out.header);
+  switch (out.header.control)
+  {
+  case PTP_SYNC_MESSAGE:
+  case PTP_DELAY_REQ_MESSAGE:  msgUnpackSync(buf, &out.sync);         break;
+  case PTP_FOLLOWUP_MESSAGE:   msgUnpackFollowUp(buf, &out.follow);   break;
+  case PTP_DELAY_RESP_MESSAGE: msgUnpackDelayResp(buf, &out.resp);    break;
+  case PTP_MANAGEMENT_MESSAGE:
+    /* As handleManagement(): zero the tail past the received length */
+    memcpy(pad, buf, length);
+    memset(pad + length, 0, PACKET_SIZE - length);
+    msgUnpackManagement(pad, &out.manage);
+    msgUnpackManagementPayload(pad, &out.manage);
+    break;
+  }
+}
+
+/** Run the V2 parsers on an accepted message */
+static void parseV2(UInteger8 *buf, Integer32 length)
+{
+  MsgView              view;
+  V2TimeRepresentation timestamp;
+  static const Octet   identity[8];
+
+  msgViewInit(&view, buf, length);
+  sink += msgViewV2TransportSpecific(&view)
+        + msgViewV2SequenceId(&view)
+        + msgViewV2SourcePortNumber(&view)
+        + msgViewV2Flags0(&view)
+        + (UInteger32)msgViewV2Correction(&view)
+        + msgViewPortIdentityIs(&view, V2_SOURCE_PORT_ID_OFFSET, identity, 1);
+
+  switch (msgViewV2MessageType(&view))
+  {
+  case V2_SYNC_MESSAGE:
+  case V2_FOLLOWUP_MESSAGE:
+    if (msgViewV2Timestamp(&view, V2_TIMESTAMP_OFFSET, &timestamp))
+      sink += timestamp.nanoseconds;
+    break;
+
+  case V2_DELAY_RESP_MESSAGE:
+    if (msgViewV2Timestamp(&view, V2_TIMESTAMP_OFFSET, &timestamp))
+      sink += timestamp.nanoseconds;
+    sink += msgViewPortIdentityIs(&view, V2_REQUESTING_PORT_ID_OFFSET, identity, 1);
+    break;
+
+  case V2_ANNOUNCE_MESSAGE:
+    msgUnpackV2Header(buf, &out.v2header);
+    msgUnpackAnnounce(buf, &out.announce);
+    break;
+
+  case V2_DELAY_REQ_MESSAGE:
+  case V2_PDELAY_REQ_MESSAGE:
+    msgUnpackV2Header(buf, &out.v2header);
+    msgUnpackV2Sync(buf, &out.v2sync);
+    break;
+
+  case V2_PDELAY_RESP_MESSAGE:
+    msgUnpackV2Header(buf, &out.v2header);
+    msgUnpackV2PDelayResp(buf, &out.v2presp);
+    break;
+
+  case V2_PDELAY_RESP_FOLLOWUP_MESSAGE:
+    msgUnpackV2Header(buf, &out.v2header);
+    msgUnpackV2PDelayRespFollowUp(buf, &out.v2pfollow);
+    break;
+
+  default:
+    msgUnpackV2Header(buf, &out.v2header);
+    break;
+  }
+}
+
+/** Function to run one input through msgPeek() and the parsers */
+static void fuzzOne(const UInteger8 *data, size_t size)
+{
+  UInteger8 *buf;
+
+  if (size > PACKET_SIZE)
+    size = PACKET_SIZE;                  // netRecv*() truncates to this
+  buf = malloc(size ? size : 1);
+  if (!buf)
+    abort();
+  memcpy(buf, data, size);
+
+  if (msgPeek(buf, size))
+  {
+    switch (msgGetPtpVersion(buf))
+    {
+    case 1: parseV1(buf, size); break;
+    case 2: parseV2(buf, size); break;
+    }
+  }
+  free(buf);
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzzOne(data, size);
+  return 0;
+}
+
+#else
+
+static long inputs;
+
+/** Function to run a seed and its random mutations */
+static void fuzzSeed(const UInteger8 *seed, size_t size, long mutations)
+{
+  UInteger8 buf[PACKET_SIZE];
+  size_t    length;
+  long      round;
+  int       edits;
+
+  fuzzOne(seed, size);
+  inputs++;
+  for (round = 0; round < mutations; round++)
+  {
+    memcpy(buf, seed, size);
+    length = size;
+    for (edits = 1 + rand() % 4; edits > 0; edits--)
+    {
+      switch (rand() % 4)
+      {
+      case 0:                              // truncate
+        length = rand() % (length + 1);
+        break;
+      case 1:                              // extend with random bytes
+        while (length < PACKET_SIZE && rand() % 8)
+          buf[length++] = rand();
+        break;
+      default:                             // overwrite one byte
+        if (length)
+          buf[rand() % length] = rand();
+        break;
+      }
+    }
+    fuzzOne(buf, length);
+    inputs++;
+  }
+}
+
+/** Function to replay one seed file, returns FALSE if it can't be read */
+static Boolean replayFile(const char *path, long mutations)
+{
+  UInteger8 seed[PACKET_SIZE];
+  size_t    size;
+  FILE     *file;
+
+  file = fopen(path, "rb");
+  if (!file)
+  {
+    perror(path);
+    return FALSE;
+  }
+  size = fread(seed, 1, sizeof(seed), file);
+  fclose(file);
+  fuzzSeed(seed, size, mutations);
+  return TRUE;
+}
+
+/** Function to replay a seed file or every file in a directory */
+static Boolean replay(const char *path, long mutations)
+{
+  struct dirent **names;
+  char            name[1024];
+  int             count, i;
+  Boolean         ok = TRUE;
+
+  count = scandir(path, &names, NULL, alphasort);
+  if (count < 0)
+    return replayFile(path, mutations);
+
+  for (i = 0; i < count; i++)
+  {
+    if (names[i]->d_name[0] != '.')
+    {
+      snprintf(name, sizeof(name), "%s/%s", path, names[i]->d_name);
+      ok = replayFile(name, mutations) && ok;
+    }
+    free(names[i]);
+  }
+  free(names);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  long    mutations = 0;
+  Boolean ok = TRUE;
+  int     i = 1;
+
+  if (argc > 2 && strcmp(argv[1], "-m") == 0)
+  {
+    mutations = atol(argv[2]);
+    i = 3;
+  }
+  if (i >= argc)
+  {
+    fprintf(stderr, "usage: %s [-m mutations] file|directory...\n", argv[0]);
+    return 2;
+  }
+
+  srand(1);
+  for (; i < argc; i++)
+    ok = replay(argv[i], mutations) && ok;
+
+  printf("fuzz_msg: %ld inputs parsed\n", inputs);
+  return ok ? 0 : 1;
+}
+
+#endif /* FUZZ_LIBFUZZER */
+
+// eof fuzz_msg.c
@@ -49,6 +49,8 @@ void probe(RunTimeOpts *rtOpts, PtpClock *ptpClock)
 {
   UInteger16 i;
   UInteger16 length;
+  Integer32 wait;
+  ssize_t received;
   TimeInternal interval, now, finish, timestamp;
   
   /* check */
@@ -115,11 +117,16 @@ void probe(RunTimeOpts *rtOpts, PtpClock *ptpClock)
       break;
   }
   
+  /* wait a Sync interval for replies, but at least a second */
+  wait = PTP_SYNC_INTERVAL_TIMEOUT(ptpClock->sync_interval) / PTP_TICKS(1);
+  if(wait < 1)
+    wait = 1;
+
   getTime(&finish, ptpClock->current_utc_offset);
-  finish.seconds += PTP_SYNC_INTERVAL_TIMEOUT(ptpClock->sync_interval);
+  finish.seconds += wait;
   for(;;)
   {
-    interval.seconds     = PTP_SYNC_INTERVAL_TIMEOUT(ptpClock->sync_interval);
+    interval.seconds     = wait;
     interval.nanoseconds = 0;
     netSelect(&interval, &ptpClock->netPath);
     
@@ -128,11 +135,15 @@ void probe(RunTimeOpts *rtOpts, PtpClock *ptpClock)
                  &ptpClock->netPath
                 );
     
-    if(netRecvGeneral(ptpClock->msgIbuf, 
-                      &ptpClock->netPath
-                     )
-      )
+    received = netRecvGeneral(ptpClock->msgIbuf, 
+                              &ptpClock->netPath
+                             );
+    if(received > 0 && msgPeek(ptpClock->msgIbuf, received))
     {
+      /* The receive buffer is not cleared, zero the tail the
+       * management payload parsers may read
+       */
+      memset(ptpClock->msgIbuf + received, 0, PACKET_SIZE - received);
       msgUnpackHeader(ptpClock->msgIbuf, &ptpClock->msgTmpHeader);
       
       if(ptpClock->msgTmpHeader.control == PTP_MANAGEMENT_MESSAGE)
@@ -84,9 +84,10 @@ void doState  (RunTimeOpts*,PtpClock*);
 void toState  (UInteger8,RunTimeOpts*,PtpClock*);
 
 void handle   (RunTimeOpts*,PtpClock*);
+void handleMessage(ssize_t,TimeInternal*,RunTimeOpts*,PtpClock*);
 
 void handleSync(MsgHeader*,    // Pointer to V1 unpacked message header
-                V2MsgHeader*,  // Pointer to V2 unpakced message header
+                MsgView*,      // View of the raw message for V2 field access
                 Octet*,        // Pointer to start of raw PTP message
                 ssize_t,       // Length of PTP message
                 TimeInternal*, // Reception time (internal format) of Sync message
@@ -96,9 +97,10 @@ void handleSync(MsgHeader*,    // Pointer to V1 unpacked message header
                );
 
 void handleFollowUp(MsgHeader*,
-                    V2MsgHeader*,
+                    MsgView*,
                     Octet*,
                     ssize_t,
+                    TimeInternal*,
                     Boolean,
                     RunTimeOpts*,
                     PtpClock*
@@ -115,9 +117,10 @@ void handleDelayReq(MsgHeader*,
                    );
 
 void handleDelayResp(MsgHeader*,
-                     V2MsgHeader*,
+                     MsgView*,
                      Octet*,
                      ssize_t,
+                     TimeInternal*,
                      Boolean,
                      RunTimeOpts*,
                      PtpClock*
@@ -163,6 +166,7 @@ void handlePDelayResp(V2MsgHeader  *v2_header,
 void handlePDelayRespFollowUp(V2MsgHeader  *v2_header,
                               Octet        *msgIbuf,
                               ssize_t       length,
+                              TimeInternal *time,
                               Boolean       isFromSelf,
                               RunTimeOpts  *rtOpts,
                               PtpClock     *ptpClock
@@ -194,7 +198,9 @@ void checkTxCompletions(RunTimeOpts*,PtpClock*);
 #endif
 /** 
  * Main function for handling protocol when running with multiple ports.
- * NOTE: Support of multiple ports is still a work in progress.
+ * Each port of the boundary clock runs its own state machine, the BMC
+ * of every port compares the best masters seen on all ports, so only
+ * one port is SLAVE and runs the servo for the shared clock.
  */
 void multiPortProtocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
                        PtpClock    *ptpClock /**< Pointer to array of ptpClock structures */
@@ -211,7 +217,7 @@ void multiPortProtocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
 #endif
 
   currentPtpClockData = ptpClock;
-  for (i=0; i<MAX_PTP_PORTS; i++)
+  for (i=0; i<rtOpts->numberPorts; i++)
   {
      DBGV("multiPortProtocol: initializing port %d\n", (i+1));
      toState(PTP_INITIALIZING, rtOpts, currentPtpClockData);
@@ -228,7 +234,7 @@ void multiPortProtocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
     currentPtpClockData = ptpClock;
     clearTime(&event_wait_time);
 
-    for (i=0; i<MAX_PTP_PORTS; i++)
+    for (i=0; i<rtOpts->numberPorts; i++)
     {
       if(currentPtpClockData->port_state != PTP_INITIALIZING)
       {
@@ -267,8 +273,25 @@ void multiPortProtocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
 
       currentPtpClockData++;
     }
-    // Scan for work on each port complete, wait for message or timeout
-    // via call to netSelectAll
+
+    // Run the measurements queued by the received messages through
+    // the servo and write any servo state it saved (-j), unless the
+    // servo has a thread of its own
+
+    if (!rtOpts->portThreads)
+    {
+      for (i=0; i<rtOpts->numberPorts; i++)
+      {
+        servoDrain(rtOpts, &ptpClock[i], &ptpClock[i]);
+        servoWriteState(rtOpts, &ptpClock[i]);
+      }
+    }
+
+    // Scan for work on each port complete, arm the event loop timer
+    // for the earliest timer deadline of all ports, then wait for
+    // message or timeout via call to netSelectAll
+
+    timerArm();
 
     if (event_wait_time.nanoseconds == 0)
     {
@@ -353,8 +376,21 @@ void protocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
       DBGV("protocol: message_activity was FALSE\n");
     }
 
-    // Scan for work on each port complete, wait for message or timeout
-    // via call to netSelectAll
+    // Run the measurements queued by the received messages through
+    // the servo and write any servo state it saved (-j), unless the
+    // servo has a thread of its own
+
+    if (!rtOpts->portThreads)
+    {
+      servoDrain(rtOpts, ptpClock, ptpClock);
+      servoWriteState(rtOpts, ptpClock);
+    }
+
+    // Scan for work on each port complete, arm the event loop timer
+    // for the earliest timer deadline, then wait for message or timeout
+    // via call to netSelect
+
+    timerArm();
 
     if (ptpClock->tx_complete_poll_timeout.nanoseconds == 0)
     {
@@ -382,6 +418,44 @@ void protocol(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
   }
 }
 
+/**
+ * Function to test if some port of the clock owning ptpClock is
+ * SLAVE or UNCALIBRATED, i.e. its servo is disciplining the clock
+ */
+static Boolean clockHasSlavePort(PtpClock *ptpClock)
+{
+  PtpClock *port = ptpClockFirstPort(ptpClock);
+  int       i;
+
+  for (i=0; i<ptpClock->number_ports; i++, port++)
+  {
+    if (   port != ptpClock
+        && (port->port_state == PTP_SLAVE || port->port_state == PTP_UNCALIBRATED)
+       )
+    {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * Function to clear the clock's slave port if it is this port, so the
+ * servo no longer treats this port as the one disciplining the clock
+ */
+static void clockReleaseSlave(PtpClock *ptpClock)
+{
+  UInteger16 port_id = ptpClock->port_id_field;
+
+  __atomic_compare_exchange_n(&ptpClockFirstPort(ptpClock)->slave_port,
+                              &port_id,
+                              0,
+                              FALSE,
+                              __ATOMIC_RELAXED,
+                              __ATOMIC_RELAXED
+                             );
+}
+
 /** 
  * Function to do initialization of PTP software 
  *
@@ -392,8 +466,6 @@ Boolean doInit(
                PtpClock *    ptpClock /**< Pointer to PTP clock structure */
               )
 {
-  unsigned int microseconds;
-
   DBG("doInit: manufacturerIdentity: %s\n", MANUFACTURER_ID);
 
   /* Setup pointers to payload area of input and output buffers */
@@ -425,27 +497,18 @@ Boolean doInit(
 
   initData(rtOpts, ptpClock);      // Initialize Data
 
-  if (ptpClock->port_id_field == 1)  // AKB: Only init common timer on call from 1st port init
+  // AKB: Only init common timer on call from 1st port init, port threads
+  // each have their own timer
+  // The tick is the shortest message interval (PTP_LOG_TICK), so the
+  // Sync, Announce, receipt and holdover timers all count exactly
+  // whatever the configured intervals are
+  if (ptpClock->port_id_field == 1 || rtOpts->portThreads)
   {
-    if (rtOpts->syncInterval < 0)
-    {
-       // syncInterval < 0, calc microseconds (-1:500,000, -2:250,000, etc.)
-       microseconds = (1000000/(1<<(abs(rtOpts->syncInterval))));
-       DBGV("doInit: sync_interval = %d, initTimer %uusecs/tick\n",
-            rtOpts->syncInterval,
-            microseconds
-           );
-       initTimer(
-                 0,            // 0 seconds
-                 microseconds  // u-secs based on sync interval
-                );
-    }
-    else
+    if (!initTimer(PTP_LOG_TICK))
     {
-       DBGV("doInit: sync_interval = %d, initTimer 1 second/tick\n",
-            rtOpts->syncInterval
-           );
-       initTimer(1,0);        // Initialize Timer ticks to 1 per second
+      PERROR("doInit: failed to initialize timer");
+      toState(PTP_FAULTY, rtOpts, ptpClock);
+      return FALSE;
     }
   }
 
@@ -475,14 +538,23 @@ Boolean doInit(
   }
 #endif
 
-  initClock(rtOpts, ptpClock);     // Initialize Clock
+  if (clockHasSlavePort(ptpClock))
+  {
+    // Another port of this boundary clock is disciplining the clock,
+    // only reset this port's servo variables
+    initClockPort(rtOpts, ptpClock);
+  }
+  else
+  {
+    initClock(rtOpts, ptpClock);   // Initialize Clock
+  }
 
 #ifdef CONFIG_MPC831X
   // Set HW clock start time from Operating system clock
   setPtpTimeFromSystem(rtOpts->currentUtcOffset); 
 #endif
 
-  m1(ptpClock);
+  m1(rtOpts, ptpClock);
 
   if (rtOpts->ptpv2)
   {
@@ -501,7 +573,7 @@ Boolean doInit(
 
   DBG("doInit: ptpClock Data:\n");  
 
-  DBG(" sync message interval...: %d\n", PTP_SYNC_INTERVAL_TIMEOUT(ptpClock->sync_interval));
+  DBG(" sync message interval...: 2^%d sec\n", ptpClock->sync_interval);
   DBG(" clock identifier........: %s\n", ptpClock->clock_identifier);
   DBG(" 256*log2(clock variance): %d\n", ptpClock->clock_v1_variance);
   DBG(" clock stratum...........: %d\n", ptpClock->clock_stratum);
@@ -571,6 +643,7 @@ void doState(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
       // (BMC) algorithm, and check if state needs to change.
 
       DBGV("doState: Record Update TRUE, invoking BMC algorithm\n");
+      clockLock();
       ptpClock->record_update = FALSE;  // Clear record update boolean
 
       // Based on run time options, run either version 1 or version 2 BMC algorithm
@@ -591,6 +664,7 @@ void doState(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
                       ptpClock
                      );
       }
+      clockUnlock();
       if(state != ptpClock->port_state) // If Suggested state is new, change state
       {
         DBG("doState: After BMC check, State change from %d to %d\n",
@@ -611,6 +685,20 @@ void doState(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
     break;
   }
 
+  // Holdover after losing the master, update the predicted frequency
+
+  if(timerExpired(HOLDOVER_TIMER, ptpClock->itimer, ptpClock->port_id_field))
+  {
+    DBGV("doState: event HOLDOVER_TIMEOUT_EXPIRES\n");
+    servoHoldover(rtOpts, ptpClock);
+    if (clockHasSlavePort(ptpClock))
+    {
+      // Another port took over the clock, the servo ends holdover
+      timerStop(HOLDOVER_TIMER,
+                ptpClock->itimer);
+    }
+  }
+
   // Main State machine processing:
   
   switch(ptpClock->port_state)
@@ -647,8 +735,10 @@ void doState(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
     if(timerExpired(SYNC_RECEIPT_TIMER, ptpClock->itimer, ptpClock->port_id_field))
     {
       DBG("doState: event SYNC_RECEIPT_TIMEOUT_EXPIRES\n");
+      clockLock();
       ptpClock->number_foreign_records = 0;
       ptpClock->foreign_record_i       = 0;
+      clockUnlock();
       if(!rtOpts->slaveOnly && ptpClock->clock_stratum != 255)
       {
         //
@@ -656,8 +746,14 @@ void doState(RunTimeOpts *rtOpts,  /**< Global Run Time Options */
         // Sync Receipt has expired so no longer receiving
         // sync messages, switch to MASTER state
         //
-        m1(ptpClock);
+        m1(rtOpts, ptpClock);
         toState(PTP_MASTER, rtOpts, ptpClock);
+        if (ptpClock->number_ports > 1)
+        {
+          // Other ports may still hear a master, let the BMC pick
+          // this port's parent data set from them
+          ptpClock->record_update = TRUE;
+        }
       }
       else 
       {
@@ -744,8 +840,22 @@ void toState(UInteger8     state,   /**< State to transition to */
   case PTP_SLAVE:
     //
     // Leaving slave state to some other state, initialize the clock
+    // (the servo holds over) and start the holdover update timer.
+    // If another port of this boundary clock already took over as
+    // slave, only reset this port's servo variables.
     //
-    initClock(rtOpts, ptpClock);
+    clockReleaseSlave(ptpClock);
+    if (clockHasSlavePort(ptpClock))
+    {
+      initClockPort(rtOpts, ptpClock);
+    }
+    else
+    {
+      initClock(rtOpts, ptpClock);
+      timerStart(HOLDOVER_TIMER,
+                 PTP_TICKS(HOLDOVER_INTERVAL),
+                 ptpClock->itimer);
+    }
     break;
     
   default:
@@ -910,7 +1020,13 @@ void toState(UInteger8     state,   /**< State to transition to */
 #endif
 
     
+    __atomic_store_n(&ptpClockFirstPort(ptpClock)->slave_port,
+                     ptpClock->port_id_field,
+                     __ATOMIC_RELAXED
+                    );
     initClock(rtOpts, ptpClock);
+    timerStop(HOLDOVER_TIMER,
+              ptpClock->itimer);
     
     /* R is chosen to allow a few syncs before we first get a one-way delay estimate */
     /* this is to allow the offset filter to fill for an accurate initial clock reset */
@@ -940,11 +1056,11 @@ void toState(UInteger8     state,   /**< State to transition to */
 
   //
   // Test if display statisitics option is TRUE.
-  // If true, display statisitics after this state change
+  // If true, have the servo display statisitics after this state change
   //
   if(rtOpts->displayStats)
   {
-    displayStats(rtOpts, ptpClock);
+    servoStats(rtOpts, ptpClock);
   }
 }
 
@@ -958,202 +1074,213 @@ void handle(RunTimeOpts * rtOpts,  /**< Pointer to run time options */
 {
   int            ret;
   ssize_t        length;
-  Boolean        isFromSelf;
   TimeInternal   time = { 0, 0 };
   unsigned short etherType;
-  TimeInternal   handle_timeout;
-  UInteger16     current_sequence;
+  UInteger8      ready;
+  NetRxRing *    ring;
+  NetRxSlot *    slot;
+  int            i;
 
   DBGV("handle:\n");
 
   //
-  // First check if there is already message activity
+  // Readiness of the receive sockets was already collected by
+  // netSelect()/netSelectAll() in the main loop, so there is no
+  // need to poll the sockets again here.  Only read the socket that
+  // was reported ready.  The ready flag is consumed by the read, if
+  // more messages are queued the socket is reported ready again on
+  // the next pass of the main loop.
   //
-  if(!ptpClock->message_activity)
+  ready = ptpClock->netPath.readySockets;
+
+  if(!ready)
   {
+    DBGV("handle: nothing to process, returning\n");
+    return;
+  }
+
+  if(ready & NET_TX_STAMP_READY)
+  {
+    //
+    // Transmit time stamps on the event socket error queue.  Each one
+    // comes with the sent message, which is dispatched as a message
+    // from self so the usual transmit complete handling runs with the
+    // time the message actually left.  Handled before received messages
+    // so a response is never processed ahead of its request's stamp.
     //
-    // No messge acitivity, call netSelect to poll the socket
-    // for any messages.  In this case, we specify a
-    // null timeout, so if nothing is available to process
-    // the call to select() within netSelect will
-    // wait until a message is received, or the timeout
-    // thread is scheduled and that will also then shortly
-    // later cause the select() function to return (i.e.
-    // wake up).
-    // pending
+    ptpClock->netPath.readySockets &= ~NET_TX_STAMP_READY;
+    ptpClock->msgIbuf = &(ptpClock->inputBuffer[16]);
 
-    // AKB: New multiport code support, set timeout to zero as we
-    // now wait for events in the main loop.  All we want to 
-    // do here is to check if anything to process and
-    // return immediately.
+    for(i = 0; i < NET_RX_BATCH; i++)
+    {
+      length = netRecvTxStamp(ptpClock->msgIbuf, &time, &ptpClock->netPath);
+      if(length <= 0)
+      {
+        break;
+      }
+      ptpClock->msgIsTxStamp = TRUE;
+      handleMessage(length, &time, rtOpts, ptpClock);
+      ptpClock->msgIsTxStamp = FALSE;
 
-    clearTime(&handle_timeout);
+      if(   ptpClock->port_state == PTP_FAULTY
+         || ptpClock->port_state == PTP_INITIALIZING
+        )
+      {
+        return;
+      }
+    }
+    if(length < 0)
+    {
+      PERROR("handle: failed to read the event socket error queue");
+      toState(PTP_FAULTY, rtOpts, ptpClock);
+      return;
+    }
 
-    ret = netSelect(&handle_timeout, &ptpClock->netPath);
+    ready &= ~NET_TX_STAMP_READY;
+    if(!ready)
+    {
+      return;
+    }
+  }
 
-/* AKB: Commented out old code
+  if(ready & (NET_EVENT_SOCK_READY | NET_GENERAL_SOCK_READY))
+  {
+    //
+    // Event or general messages to process.  Drain up to a
+    // batch of messages from the socket into the receive ring
+    // with one call and dispatch all of them.
+    //
+    ring = &ptpClock->rxRing;
 
- ifdef CONFIG_MPC831X
-    if (ptpClock->tx_complete_poll_timeout.nanoseconds > 0)
+    if(ready & NET_EVENT_SOCK_READY)
     {
-        DBGV("handle: Calling netSelect tx packet complete poll timeout\n");
-        ret = netSelect(&ptpClock->tx_complete_poll_timeout,
-                       &ptpClock->netPath
-                      );
+      DBGV("handle: message to process, checking Event Socket\n");
+      ptpClock->netPath.readySockets &= ~NET_EVENT_SOCK_READY;
+      ret = netRecvEventBatch(ring, &ptpClock->netPath);
     }
     else
     {
-        DBGV("handle: Calling netSelect with NULL timeout\n");
-        ret = netSelect(0,
-                        &ptpClock->netPath
-                       );
+      DBGV("handle: message to process, checking General Socket\n");
+      ptpClock->netPath.readySockets &= ~NET_GENERAL_SOCK_READY;
+      ret = netRecvGeneralBatch(ring, &ptpClock->netPath);
     }
- else
-    DBGV("handle: Calling netSelect with NULL timeout\n");
-    ret = netSelect(0, &ptpClock->netPath);
- endif
-
-*/
 
     if(ret < 0)
     {
       //
-      // If return code is negative, then there
-      // was a socket failure, change state
-      // to faulty and return
+      // Got negative number on batch receive, 
+      // socket failed, change to FAULTY state
       //
-      PERROR("handle: failed to poll sockets");
+      PERROR("handle: failed to receive on the %s socket",
+             (ready & NET_EVENT_SOCK_READY) ? "event" : "general"
+            );
       toState(PTP_FAULTY, rtOpts, ptpClock);
       return;
     }
+
     //
-    // If Poll of socket returns zero, then there
-    // are no messages to handle, so return
+    // Dispatch the batch.  Handlers use ptpClock->msgIbuf, so point
+    // it at each ring buffer in turn and restore it afterwards.
     //
-    else
+    for(ring->next = 0; ring->next < ring->count; ring->next++)
     {
-      if(!ret)
+      slot = &ring->slot[ring->next];
+      if(!slot->length)
       {
-        DBGV("handle: nothing to process, returning\n");
-        return;
+        continue;
+      }
+
+      ptpClock->msgIbuf = &slot->buffer[16];
+      handleMessage(slot->length, &slot->time, rtOpts, ptpClock);
+
+      if(   ptpClock->port_state == PTP_FAULTY
+         || ptpClock->port_state == PTP_INITIALIZING
+        )
+      {
+        // Port is being reset, drop rest of the batch
+        DBG("handle: port reset, dropping %d batched messages\n",
+            ring->count - ring->next - 1
+           );
+        break;
       }
-      DBGV("handle: TRUE return from netSelect\n");
     }
-    //
-    // If poll of socket is a positive number, then
-    // there is a message to process, continue.
-    //
+    ptpClock->msgIbuf = &(ptpClock->inputBuffer[16]);
+    ring->count       = 0;
+    return;
   }
-  
-  DBGV("handle: message to process, checking Event Socket\n");
-  
+
   //
-  // Check if event message needs to be processed
+  // Only the 802.1AS raw socket is ready
   //
+  DBGV("handle: message to process, checking Raw Socket\n");
+  ptpClock->netPath.readySockets &= ~NET_RAW_SOCK_READY;
 
-  length = netRecvEvent(ptpClock->msgIbuf,
-                        &time,
-                        &ptpClock->netPath
-                       );
+  length = netRecvRaw(&(ptpClock->inputBuffer[2]), // Pointer offset for MAC header
+                      &ptpClock->netPath
+                     );
   if(length < 0)
   {
-    //
-    // Got negative number on call to netRecvEvent, 
-    // socket failed, change to FAULTY state
-    //
-    PERROR("handle: failed to receive on the event socket");
-    toState(PTP_FAULTY, rtOpts, ptpClock);
-    return;
+     PERROR("handle: failed to receive on the raw socket");
+     toState(PTP_FAULTY, rtOpts, ptpClock);
+     return;
   }
-  else 
+  // Raw Socket returned a Frame, do a quick Sanity Check
+  // on the MAC header
+  //
+  if (length < 14)
   {
-    if(!length)
-    {
-      //
-      // If we are here, then netRecvEvent returned zero
-      // Check for general event using netRecvGeneral
-      //
-      DBGV("handle: message to process, checking General Socket\n");
-      length = netRecvGeneral(ptpClock->msgIbuf, &ptpClock->netPath);
-      if(length < 0)
-      {
-        PERROR("handle: failed to receive on the general socket");
-        toState(PTP_FAULTY, rtOpts, ptpClock);
-        return;
-      }
-      else
-      {
-        if(!length)
-        {
-          //
-          // If we are here, then both the UDP Event and General
-          // socket reads returned 0.
-          // Check if 802.1AS is enabled and if so, check that
-          // socket has some data to process
-          if (rtOpts->ptp8021AS)
-          {
-            // 802.1AS enabled, check if anything available from the 
-            // raw socket
-            DBGV("handle: message to process, checking Raw Socket\n");
-            length = netRecvRaw(&(ptpClock->inputBuffer[2]), // Pointer offset for MAC header
-                                &ptpClock->netPath
-                               );
-            if(length < 0)
-            {
-               PERROR("handle: failed to receive on the raw socket");
-               toState(PTP_FAULTY, rtOpts, ptpClock);
-               return;
-            }
-            // Raw Socket returned a Frame, do a quick Sanity Check
-            // on the MAC header
-            //
-            if (length < 14)
-            {
-               // Frame to small, ignore
-               DBGV("handle: raw socket tiny frame, length %d\n",
-                    length
-                   );
-               return;
-            }
-            etherType = flip16(*((unsigned short *)&ptpClock->inputBuffer[14]));
-            if (etherType != 0x88F7)
-            {
-               // Frame invalid Ethertype (not 802.1AS PTP), ignore
-               DBGV("handle: raw socket unexpected Ethertype 0x%4.4x\n",
-                    etherType
-                   );
-               return;
-            }
-            //
-            // MAC header check OK, subtract the MAC header length
-            // to adjust.  msgIbuf is already set to point to the
-            // PTP message payload.
-            length -= 14;               
-          }
-          else
-          {
-             // No 802.1AS and no frames to process, return
-             return;
-          }
-        }
-      }
-    }
+     // Frame to small, ignore
+     DBGV("handle: raw socket tiny frame, length %d\n",
+          length
+         );
+     return;
   }
-  
-  ptpClock->message_activity = TRUE;
-  
-  if(!msgPeek(ptpClock->msgIbuf, length))
+  etherType = flip16(*((unsigned short *)&ptpClock->inputBuffer[14]));
+  if (etherType != 0x88F7)
   {
-    return;
+     // Frame invalid Ethertype (not 802.1AS PTP), ignore
+     DBGV("handle: raw socket unexpected Ethertype 0x%4.4x\n",
+          etherType
+         );
+     return;
   }
+  //
+  // MAC header check OK, subtract the MAC header length
+  // to adjust.  msgIbuf is already set to point to the
+  // PTP message payload.
+  length -= 14;               
+
+  handleMessage(length, &time, rtOpts, ptpClock);
+}
+
+/** 
+ * Function to parse and dispatch one received PTP version 1 or
+ * version 2 message located at ptpClock->msgIbuf
+ */
+void handleMessage(ssize_t       length,   /**< PTP message length */
+                   TimeInternal *rxTime,   /**< Time PTP message was received */
+                   RunTimeOpts * rtOpts,   /**< Pointer to run time options */
+                   PtpClock *    ptpClock  /**< Pointer to PTP clock structure */
+                  )
+{
+  Boolean        isFromSelf;
+  TimeInternal   time;
+  UInteger16     current_sequence;
+
+  copyTime(&time, rxTime);
+
+  ptpClock->message_activity = TRUE;
   
-  if(length < HEADER_LENGTH)
+  /* Drop anything too short for its parsers, the bytes past length
+   * are left over from earlier messages
+   */
+  if(!msgPeek(ptpClock->msgIbuf, length))
   {
-    PERROR("handle: message shorter than header length\n");
-    toState(PTP_FAULTY, rtOpts, ptpClock);
     return;
   }
 
+  msgViewInit(&ptpClock->msgView, ptpClock->msgIbuf, length);
+
   /* Get PTP Version of current message */
   ptpClock->current_msg_version = msgGetPtpVersion(ptpClock->msgIbuf);
   DBGV("handle: msgGetPtpVersion: %d\n",
@@ -1242,27 +1369,37 @@ void handle(RunTimeOpts * rtOpts,  /**< Pointer to run time options */
     DBGV("handle: Processing PTP version 2 message\n");
     DBGV("handle: Unpacking received message header\n"); 
 
-    /* Unpack common version 2 PTP header fields: */
-    msgUnpackV2Header(ptpClock->msgIbuf, &ptpClock->v2MsgTmpHeader);
+    /* Sync, Follow Up and Delay Response read their few fields straight
+     * from the message view; the header is only unpacked for the rest
+     */
+    ptpClock->v2_msg_type           = msgViewV2MessageType(&ptpClock->msgView);
+    ptpClock->rx_transport_specific = msgViewV2TransportSpecific(&ptpClock->msgView);
 
-    ptpClock->v2_msg_type           
-        = ptpClock->v2MsgTmpHeader.transportSpecificAndMessageType & 0x0F;
-    ptpClock->rx_transport_specific 
-        = ptpClock->v2MsgTmpHeader.transportSpecificAndMessageType >> 4;
+    switch(ptpClock->v2_msg_type)
+    {
+      case V2_SYNC_MESSAGE:
+      case V2_FOLLOWUP_MESSAGE:
+      case V2_DELAY_RESP_MESSAGE:
+        break;
+
+      default:
+        msgUnpackV2Header(ptpClock->msgIbuf, &ptpClock->v2MsgTmpHeader);
+        break;
+    }
   
+    current_sequence = msgViewV2SequenceId(&ptpClock->msgView);
+
     DBGV("handle: event Receipt of Message\n");
     DBGV("handle:   messageType.......... %u\n", ptpClock->v2_msg_type);
     DBGV("handle:   transportSpecific.... %u\n", ptpClock->rx_transport_specific);
-    DBGV("handle:   sequenceId........... %4.4x\n", ptpClock->v2MsgTmpHeader.sequenceId);
+    DBGV("handle:   sequenceId........... %4.4x\n", current_sequence);
 
 
-    isFromSelf =  (ptpClock->v2MsgTmpHeader.sourcePortId.portNumber 
-                  == ptpClock->port_id_field)
-               && !memcmp(ptpClock->v2MsgTmpHeader.sourcePortId.clockIdentity, 
-                          ptpClock->port_clock_identity, 
-                          8
-                         );
-    current_sequence = ptpClock->v2MsgTmpHeader.sequenceId;
+    isFromSelf = msgViewPortIdentityIs(&ptpClock->msgView,
+                                       V2_SOURCE_PORT_ID_OFFSET,
+                                       ptpClock->port_clock_identity,
+                                       ptpClock->port_id_field
+                                      );
 
   }
 
@@ -1275,6 +1412,21 @@ void handle(RunTimeOpts * rtOpts,  /**< Pointer to run time options */
 
   DBGV("handle: isFrom self is %s\n", isFromSelf?"TRUE":"FALSE");
 
+  /* With transmit time stamps from the error queue, the multicast
+   * loopback copies of our own event messages (V2 types 0 to 3, V1
+   * types mapped to them above) would report each one twice.  Only
+   * the copy from the error queue is handled.
+   */
+  if (   isFromSelf
+      && ptpClock->netPath.txStamps
+      && !ptpClock->msgIsTxStamp
+      && ptpClock->v2_msg_type <= V2_PDELAY_RESP_MESSAGE
+     )
+  {
+    DBGV("handle: dropped loopback of own event message\n");
+    return;
+  }
+
 #ifdef CONFIG_MPC831X
   /* AKB: Updated code for timestamp, changed for updated Freescale Ethernet
    * driver code and also to put everything in one place for easier future
@@ -1381,7 +1533,7 @@ TimeInternal debug_delta_time = {0,0};
          length
         );
     handleSync(&ptpClock->msgTmpHeader,
-               &ptpClock->v2MsgTmpHeader, 
+               &ptpClock->msgView,
                ptpClock->msgIbuf, 
                length, 
                &time, 
@@ -1396,9 +1548,10 @@ TimeInternal debug_delta_time = {0,0};
          length
         );
     handleFollowUp(&ptpClock->msgTmpHeader, 
-                   &ptpClock->v2MsgTmpHeader, 
+                   &ptpClock->msgView,
                     ptpClock->msgIbuf, 
                     length, 
+                   &time,
                     isFromSelf,
                     rtOpts, 
                     ptpClock
@@ -1433,9 +1586,10 @@ TimeInternal debug_delta_time = {0,0};
          length
         );
     handleDelayResp(&ptpClock->msgTmpHeader,
-                    &ptpClock->v2MsgTmpHeader,
+                    &ptpClock->msgView,
                     ptpClock->msgIbuf,
                     length,
+                   &time,
                     isFromSelf,
                     rtOpts,
                     ptpClock
@@ -1512,6 +1666,7 @@ TimeInternal debug_delta_time = {0,0};
     handlePDelayRespFollowUp(&ptpClock->v2MsgTmpHeader,
                               ptpClock->msgIbuf,
                               length,
+                             &time,
                               isFromSelf,
                               rtOpts,
                               ptpClock
@@ -1929,7 +2084,7 @@ short temp_debug_issue_delay_counter=0;
  * Sync message 
  */
 void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message header */
-                V2MsgHeader  *v2_header, /**< Pointer to PTP version 2 message header */
+                MsgView      *view,      /**< View of the raw message for PTP version 2 fields */
                 Octet        *msgIbuf,   /**< Pointer to PTP raw message data */
                 ssize_t       length,    /**< PTP message length */
                 TimeInternal *time,      /**< Time PTP message was received */
@@ -1939,7 +2094,7 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
                )
 {
   MsgSync      *sync;
-  V2MsgSync    *v2sync;
+  V2TimeRepresentation v2OriginTimestamp;
   TimeInternal  originTimestamp;
   Boolean       sync_source_ok;
   UInteger16    sequence_delta;
@@ -2021,17 +2176,14 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
             ptpClock->parent_clock_identity[7]
           );
 
-     sequence_delta =   v2_header->sequenceId 
+     sequence_delta =   msgViewV2SequenceId(view)
                       - ptpClock->parent_last_sync_sequence_number;
 
-     sync_source_ok =
-       (  v2_header->sourcePortId.portNumber                      // Check source port equal
-                 == ptpClock->parent_port_id
-       && !memcmp(v2_header->sourcePortId.clockIdentity,          // Check clock identity equal
-                  ptpClock->parent_clock_identity,
-                  8
-                 )
-       );
+     sync_source_ok = msgViewPortIdentityIs(view,                 // Check source port identity
+                                            V2_SOURCE_PORT_ID_OFFSET,
+                                            ptpClock->parent_clock_identity,
+                                            ptpClock->parent_port_id
+                                           );
     }
     if (sync_source_ok)
     {
@@ -2072,8 +2224,8 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
 
       if (ptpClock->current_msg_version == 1)
       {
-        clearTime(&ptpClock->sync_correction);
-        clearTime(&ptpClock->followup_correction);
+        ptpClock->sync_correction = 0;
+        ptpClock->followup_correction = 0;
         /* addForeign() takes care of msgUnpackSync() */
         ptpClock->record_update = TRUE;
         sync = addForeign(ptpClock->msgIbuf, 
@@ -2091,20 +2243,15 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
       }
       else
       {
-        v2sync = &ptpClock->msgTmp.v2sync;
-        msgUnpackV2Sync(msgIbuf, v2sync);
-
        /* Store Version 2 sequence number 
         * (for Version 1, this is done when s1 is called)
         */
 
-       ptpClock->parent_last_sync_sequence_number = v2_header->sequenceId;
+       ptpClock->parent_last_sync_sequence_number = msgViewV2SequenceId(view);
 
-       /* Get correction field, change to Internal time */
+       /* Get correction field (scaled nanoseconds) */
  
-        v2CorrectionToInternalTime(&ptpClock->sync_correction,
-                                    v2_header->correctionField
-                                  );
+        ptpClock->sync_correction = msgViewV2Correction(view);
       
       }
       
@@ -2122,7 +2269,7 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
       }
       else
       {
-        ptpClock->waitingForFollow = (v2_header->flags[0] & V2_TWO_STEP_FLAG
+        ptpClock->waitingForFollow = (msgViewV2Flags0(view) & V2_TWO_STEP_FLAG
                                      ) == V2_TWO_STEP_FLAG;
       }
       
@@ -2136,18 +2283,19 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
         }
         else
         {
+          /* One-step sync: origin timestamp is only needed here */
+          msgViewV2Timestamp(view, V2_TIMESTAMP_OFFSET, &v2OriginTimestamp);
           v2ToInternalTime(&originTimestamp, 
-                           &v2sync->originTimestamp
+                           &v2OriginTimestamp
                           );
 
         }
-        updateOffset(&originTimestamp, 
-                     &ptpClock->t2_sync_rx_time,
-                     &ptpClock->ofm_filt,
-                     rtOpts,
-                     ptpClock);
-
-        updateClock(rtOpts, ptpClock);
+        servoSync(&originTimestamp, 
+                  &ptpClock->t2_sync_rx_time,
+                  ptpClock->current_msg_version == 1 ? header->sequenceId
+                                                     : msgViewV2SequenceId(view),
+                  rtOpts,
+                  ptpClock);
       }
       else
       {
@@ -2243,7 +2391,7 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
       if (isFromSelf)
       {
         /* Is from self, check if this is the sequence currently in process */
-        current_sequence = (v2_header->sequenceId == ptpClock->last_sync_tx_sequence_number);
+        current_sequence = (msgViewV2SequenceId(view) == ptpClock->last_sync_tx_sequence_number);
       }
     }
 
@@ -2281,7 +2429,7 @@ void handleSync(MsgHeader    *header,    /**< Pointer to PTP version 1 message h
 }
 /** Function to handle PTP version 1 or version 2 Follow Up message */
 void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 message header */
-                    V2MsgHeader  *v2_header, /**< Pointer to PTP version 2 message header */
+                    MsgView      *view,      /**< View of the raw message for PTP version 2 fields */
                     Octet        *msgIbuf,   /**< Pointer to PTP raw message data */
                     ssize_t       length,    /**< PTP message length */
                     TimeInternal *time,      /**< Time PTP message was received */
@@ -2291,7 +2439,7 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
                    )
 {
   MsgFollowUp   *follow;
-  V2MsgFollowUp *v2follow;
+  V2TimeRepresentation v2PreciseOriginTimestamp;
   TimeInternal   preciseOriginTimestamp;
   Boolean        followup_expected;
   
@@ -2342,11 +2490,7 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
 
       /* Version 2 Follow up messsage */
 
-      DBGV("handleFollowUp: Version 2 message, calling unpack function\n");
-    
-      v2follow = &ptpClock->msgTmp.v2follow;
-
-      msgUnpackV2FollowUp(ptpClock->msgIbuf, v2follow);
+      DBGV("handleFollowUp: Version 2 message\n");
 
       DBGV("handleFollowUp: looking for id %02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx\n",
            ptpClock->parent_clock_identity[0],
@@ -2359,36 +2503,25 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
            ptpClock->parent_clock_identity[7]
           );
 
-      DBGV("handleFollowUp: message id     %02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx\n",
-           v2_header->sourcePortId.clockIdentity[0],
-           v2_header->sourcePortId.clockIdentity[1],
-           v2_header->sourcePortId.clockIdentity[2],
-           v2_header->sourcePortId.clockIdentity[3],
-           v2_header->sourcePortId.clockIdentity[4],
-           v2_header->sourcePortId.clockIdentity[5],
-           v2_header->sourcePortId.clockIdentity[6],
-           v2_header->sourcePortId.clockIdentity[7]
-          );
-
       DBGV("handleFollowUp: expecting port %4.4x, is %4.4x\n",
            ptpClock->parent_port_id,
-           v2_header->sourcePortId.portNumber
+           msgViewV2SourcePortNumber(view)
           );
 
       DBGV("handleFollowUp: expecting sequence %4.4x, is %4.4x\n",
            ptpClock->parent_last_sync_sequence_number,
-           v2_header->sequenceId
+           msgViewV2SequenceId(view)
           );
 
 
       followup_expected 
         = (    ptpClock->waitingForFollow
-           && (v2_header->sequenceId       == ptpClock->parent_last_sync_sequence_number)
-           && (v2_header->sourcePortId.portNumber == ptpClock->parent_port_id)
-           && !memcmp(v2_header->sourcePortId.clockIdentity,
-                      ptpClock->parent_clock_identity,
-                      8
-                     )
+           && (msgViewV2SequenceId(view) == ptpClock->parent_last_sync_sequence_number)
+           && msgViewPortIdentityIs(view,
+                                    V2_SOURCE_PORT_ID_OFFSET,
+                                    ptpClock->parent_clock_identity,
+                                    ptpClock->parent_port_id
+                                   )
           );
     }
 
@@ -2424,8 +2557,9 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
          * update the clock.
          */
       
+        msgViewV2Timestamp(view, V2_TIMESTAMP_OFFSET, &v2PreciseOriginTimestamp);
         v2ToInternalTime(&preciseOriginTimestamp, 
-                         &v2follow->preciseOriginTimestamp
+                         &v2PreciseOriginTimestamp
                         );
         /* AKB: Copy precise Origin Timestamp from Follow up message to 
          * Sync Send time for statistics purposes
@@ -2434,22 +2568,18 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
                  &preciseOriginTimestamp      // Source
                 );
 
-       /* Get correction field, change to Internal time */
+       /* Get correction field (scaled nanoseconds) */
  
-        v2CorrectionToInternalTime(&ptpClock->followup_correction,
-                                    v2_header->correctionField
-                                  );
+        ptpClock->followup_correction = msgViewV2Correction(view);
 
 
       }
-      updateOffset(&preciseOriginTimestamp,    /* SYNC send time from Master Follow up */
-                   &ptpClock->t2_sync_rx_time, /* Previously stored SYNC rx time */
-                   &ptpClock->ofm_filt,        /* Filtered Offset from Master */
-                    rtOpts,                    /* Pointer to Run time options structure */
-                    ptpClock                   /* Pointer to PTP data structure */
-                  );
-
-      updateClock(rtOpts, ptpClock);
+      servoSync(&preciseOriginTimestamp,    /* SYNC send time from Master Follow up */
+                &ptpClock->t2_sync_rx_time, /* Previously stored SYNC rx time */
+                ptpClock->parent_last_sync_sequence_number,
+                rtOpts,                     /* Pointer to Run time options structure */
+                ptpClock                    /* Pointer to PTP data structure */
+               );
     }
     else
     {
@@ -2458,7 +2588,8 @@ void handleFollowUp(MsgHeader    *header,    /**< Pointer to PTP version 1 messa
           ptpClock->waitingForFollow?"TRUE":"FALSE"
          );
       DBG(" header    Sequence:   %u\n",
-          v2_header->sequenceId
+          ptpClock->current_msg_version == 1 ? header->sequenceId
+                                             : msgViewV2SequenceId(view)
          );
       DBG(" last sync Sequence:   %u\n",
           ptpClock->parent_last_sync_sequence_number
@@ -2511,10 +2642,7 @@ void handleDelayReqTxComplete(TimeInternal * time,    /**< Time Delay request or
       */      
      if(ptpClock->t3_pdelay_resp_tx_time.seconds)// Time from responder's PDELAY RESP FOLLOWUP
      {
-       updatePathDelay(&ptpClock->owd_filt,
-                        rtOpts,
-                        ptpClock
-                      );
+       servoPathDelay(rtOpts, ptpClock);
 
        /* Delay Req/Resp handshake complete, clear flag */
        ptpClock->sentDelayReq = FALSE;
@@ -2547,16 +2675,15 @@ void handleDelayReqTxComplete(TimeInternal * time,    /**< Time Delay request or
       
     if(ptpClock->t4_delay_req_rx_time.seconds)
     {
-      updateDelay(&ptpClock->t3_delay_req_tx_time, 
-                  &ptpClock->t4_delay_req_rx_time,
-                  &ptpClock->owd_filt,
-                   rtOpts,
-                   ptpClock
-                 );
+      servoDelay(&ptpClock->t3_delay_req_tx_time, 
+                 &ptpClock->t4_delay_req_rx_time,
+                 rtOpts,
+                 ptpClock
+                );
      
       clearTime(&ptpClock->t3_delay_req_tx_time);
       clearTime(&ptpClock->t4_delay_req_rx_time);
-      clearTime(&ptpClock->delay_resp_correction);
+      ptpClock->delay_resp_correction = 0;
 
       /* Delay Req/Resp handshake complete, clear flag */
       ptpClock->sentDelayReq = FALSE;
@@ -2645,7 +2772,7 @@ void handleDelayReq(
 /** Function to handle PTP version 1 and version 2 delay response message */
 void handleDelayResp(
     MsgHeader    *header,    /**< Pointer to PTP version 1 message header */
-    V2MsgHeader  *v2_header, /**< Pointer to PTP version 2 message header */
+    MsgView      *view,      /**< View of the raw message for PTP version 2 fields */
     Octet        *msgIbuf,   /**< Pointer to PTP raw message data */
     ssize_t       length,    /**< PTP message length */
     TimeInternal *time,      /**< Time PTP message was received */
@@ -2655,7 +2782,7 @@ void handleDelayResp(
    )
 {
   MsgDelayResp   *resp;
-  V2MsgDelayResp *v2resp;
+  V2TimeRepresentation v2ReceiveTimestamp;
   Boolean         delay_response_ok;
 
   DBGV("handleDelayResp: message length: %d\n",length);
@@ -2695,20 +2822,18 @@ void handleDelayResp(
     else
     {
      DBGV("handleDelayResp: version 2 delay response received\n");
-     v2resp = &ptpClock->msgTmp.v2resp;
-     msgUnpackV2DelayResp(ptpClock->msgIbuf, v2resp);
      delay_response_ok =
-       (   v2_header->sequenceId == ptpClock->sentDelayReqSequenceId
-        && v2resp->requestingPortId.portNumber == ptpClock->port_id_field
-        && !memcmp(v2resp->requestingPortId.clockIdentity,
-                   ptpClock->port_clock_identity,
-                   8
-                  )
-        && v2_header->sourcePortId.portNumber == ptpClock->parent_port_id
-        && !memcmp(v2_header->sourcePortId.clockIdentity,
-                   ptpClock->parent_clock_identity,
-                   8
-                  ) 
+       (   msgViewV2SequenceId(view) == ptpClock->sentDelayReqSequenceId
+        && msgViewPortIdentityIs(view,
+                                 V2_REQUESTING_PORT_ID_OFFSET,
+                                 ptpClock->port_clock_identity,
+                                 ptpClock->port_id_field
+                                )
+        && msgViewPortIdentityIs(view,
+                                 V2_SOURCE_PORT_ID_OFFSET,
+                                 ptpClock->parent_clock_identity,
+                                 ptpClock->parent_port_id
+                                )
       );
     }
     if (delay_response_ok)
@@ -2720,33 +2845,31 @@ void handleDelayResp(
                         &resp->delayReceiptTimestamp,
                         &ptpClock->halfEpoch
                        );
-         clearTime(&ptpClock->delay_resp_correction);
+         ptpClock->delay_resp_correction = 0;
       }
       else
       {
+         msgViewV2Timestamp(view, V2_TIMESTAMP_OFFSET, &v2ReceiveTimestamp);
          v2ToInternalTime(&ptpClock->t4_delay_req_rx_time,
-                          &v2resp->receiveTimestamp
+                          &v2ReceiveTimestamp
                          );
-       /* Get correction field, change to Internal time */
+       /* Get correction field (scaled nanoseconds) */
  
-        v2CorrectionToInternalTime(&ptpClock->delay_resp_correction,
-                                    v2_header->correctionField
-                                  );
+        ptpClock->delay_resp_correction = msgViewV2Correction(view);
 
       }
       
       if(ptpClock->t3_delay_req_tx_time.seconds)
       {
-        updateDelay(&ptpClock->t3_delay_req_tx_time,
-                    &ptpClock->t4_delay_req_rx_time,
-                    &ptpClock->owd_filt,
-                    rtOpts,
-                    ptpClock
-                   );
+        servoDelay(&ptpClock->t3_delay_req_tx_time,
+                   &ptpClock->t4_delay_req_rx_time,
+                   rtOpts,
+                   ptpClock
+                  );
         
         clearTime(&ptpClock->t3_delay_req_tx_time);
         clearTime(&ptpClock->t4_delay_req_rx_time);
-        clearTime(&ptpClock->delay_resp_correction);
+        ptpClock->delay_resp_correction = 0;
 
         /* Delay Req/Resp handshake complete, clear flag */
         ptpClock->sentDelayReq = FALSE;
@@ -2818,10 +2941,7 @@ void handlePDelayReq(
       
       if(ptpClock->t4_pdelay_resp_rx_time.seconds)
       {
-        updatePathDelay(&ptpClock->owd_filt,
-                         rtOpts,
-                         ptpClock
-                       );
+        servoPathDelay(rtOpts, ptpClock);
 
         /* PDelay Request, Response and optional Response Follow up Complete, clear flag */
         ptpClock->sentDelayReq = FALSE;
@@ -2989,11 +3109,9 @@ void handlePDelayResp(
                        &v2presp->requestReceiptTimestamp
                       );
 
-      /* Get correction field, change to Internal time */
+      /* Get correction field (scaled nanoseconds) */
 
-      v2CorrectionToInternalTime(&ptpClock->pdelay_resp_correction,
-                                  v2_header->correctionField
-                                );
+      ptpClock->pdelay_resp_correction = v2_header->correctionField;
 
       if(!ptpClock->waitingForPDelayRespFollow)
       {
@@ -3008,10 +3126,7 @@ void handlePDelayResp(
         if(ptpClock->t1_pdelay_req_tx_time.seconds)
         {
 
-          updatePathDelay(&ptpClock->owd_filt,
-                           rtOpts,
-                           ptpClock
-                         );
+          servoPathDelay(rtOpts, ptpClock);
 
           /* PDelay Req/Resp handshake complete, clear flag */
           ptpClock->sentDelayReq = FALSE;  // Note: Used for both Delay and Pdelay Request protocol
@@ -3120,11 +3235,9 @@ void handlePDelayRespFollowUp(
                        &v2pfollow->responseOriginTimestamp
                       );
 
-      /* Get correction field, change to Internal time */
+      /* Get correction field (scaled nanoseconds) */
 
-      v2CorrectionToInternalTime(&ptpClock->pdelay_followup_correction,
-                                  v2_header->correctionField
-                                );
+      ptpClock->pdelay_followup_correction = v2_header->correctionField;
       
       if(ptpClock->waitingForPDelayRespFollow)
       {
@@ -3134,10 +3247,7 @@ void handlePDelayRespFollowUp(
         if(ptpClock->t1_pdelay_req_tx_time.seconds)
         {
 
-          updatePathDelay(&ptpClock->owd_filt,
-                           rtOpts,
-                           ptpClock
-                         );
+          servoPathDelay(rtOpts, ptpClock);
 
           /* PDelay Req/Resp handshake complete, clear flag */
         }
@@ -3177,6 +3287,12 @@ void handleManagement(
   if(ptpClock->port_state == PTP_INITIALIZING)
     return;
   
+  /* Management payloads are key dependent, zero the stale tail of the
+   * receive buffer so a short message reads as zero fields
+   */
+  if(length < PACKET_SIZE)
+    memset(msgIbuf + length, 0, PACKET_SIZE - length);
+
   manage = &ptpClock->msgTmp.manage;
   msgUnpackManagement(ptpClock->msgIbuf, manage);
   
@@ -3822,9 +3938,21 @@ MsgAnnounce * addV2Foreign(Octet       *buf,        /**< Buffer to raw data */
 {
   int i, j;
   Boolean found = FALSE;
+  PtpClock *port;
   
   DBGV("addV2Foreign: add or update record\n");
   
+  clockLock();  /* BMC of other ports reads the foreign records */
+
+  /* An updated foreign master record can change the best master of the
+   * whole clock, so the BMC reruns on every port
+   */
+  port = ptpClockFirstPort(ptpClock);
+  for (i = 0; i < ptpClock->number_ports; i++)
+  {
+    port[i].record_update = TRUE;
+  }
+
   j = ptpClock->foreign_record_best;  /* Get index of current best master */
 
   /* Scan foreign master database */
@@ -3919,6 +4047,7 @@ MsgAnnounce * addV2Foreign(Octet       *buf,        /**< Buffer to raw data */
                                  &ptpClock->foreign[j].sync
                                    );  
   
+  clockUnlock();
   return &ptpClock->foreign[j].announce;  /* Return pointer to unpacked Announce message */
 }
 
@@ -3932,9 +4061,21 @@ MsgSync * addForeign(Octet *buf, MsgHeader *header, PtpClock *ptpClock)
 {
   int i, j;
   Boolean found = FALSE;
+  PtpClock *port;
   
   DBGV("addForeign: add or update record\n");
   
+  clockLock();  /* BMC of other ports reads the foreign records */
+
+  /* An updated foreign master record can change the best master of the
+   * whole clock, so the BMC reruns on every port
+   */
+  port = ptpClockFirstPort(ptpClock);
+  for (i = 0; i < ptpClock->number_ports; i++)
+  {
+    port[i].record_update = TRUE;
+  }
+
   j = ptpClock->foreign_record_best;  /* Get index of current best master */
 
   for(i = 0; i < ptpClock->number_foreign_records; ++i)
@@ -4016,6 +4157,7 @@ MsgSync * addForeign(Octet *buf, MsgHeader *header, PtpClock *ptpClock)
   msgUnpackHeader(buf, &ptpClock->foreign[j].header);  /* Store PTP Header in foreign record */
   msgUnpackSync(  buf, &ptpClock->foreign[j].sync);    /* Store Sync message data in record  */
   
+  clockUnlock();
   return &ptpClock->foreign[j].sync;  /* Return pointer to unpacked Sync message */
 }
 
@@ -82,10 +82,76 @@ Integer64 getNanoseconds(TimeInternal *time);
 
 Boolean isNonZeroTime(TimeInternal *time);
 
+/* 64 bit nanosecond time (TimeNs) helpers, inline as they are used
+ * several times per received message by the servo
+ */
+#define NSEC_PER_SEC  1000000000LL
+
+/** Convert internal time (seconds, nanoseconds) to nanoseconds */
+static inline TimeNs timeToNs(const TimeInternal *time)
+{
+  return (TimeNs)time->seconds * NSEC_PER_SEC + time->nanoseconds;
+}
+
+/** Convert nanoseconds to internal time, both fields get the sign of ns */
+static inline void nsToTime(TimeInternal *time, TimeNs ns)
+{
+  time->seconds     = (Integer32)(ns / NSEC_PER_SEC);
+  time->nanoseconds = (Integer32)(ns % NSEC_PER_SEC);
+}
+
+/** Convert a V2 message time stamp (48 bit seconds, nanoseconds with
+ *  ptpv2d sign flag in the top bit) to nanoseconds
+ */
+static inline TimeNs v2TimeToNs(const V2TimeRepresentation *external)
+{
+  TimeNs ns = (TimeNs)(((UInteger64)external->epoch_number << 32) | external->seconds)
+              * NSEC_PER_SEC
+            + (external->nanoseconds & 0x7FFFFFFF);
+
+  return (external->nanoseconds & 0x80000000) ? -ns : ns;
+}
+
+/** Convert nanoseconds to a V2 message time stamp (see v2TimeToNs) */
+static inline void nsToV2Time(V2TimeRepresentation *external, TimeNs ns)
+{
+  UInteger32 sign = 0;
+  UInteger64 seconds;
+
+  if (ns < 0)
+  {
+    ns   = -ns;
+    sign = 0x80000000;
+  }
+  seconds                = (UInteger64)(ns / NSEC_PER_SEC);
+  external->epoch_number = (UInteger16)(seconds >> 32);
+  external->seconds      = (UInteger32)seconds;
+  external->nanoseconds  = (Integer32)((ns % NSEC_PER_SEC) | sign);
+}
+
+/** Convert scaled nanoseconds (nanoseconds * 2^16, the V2 correctionField
+ *  format) to nanoseconds, truncating the sub-nanosecond part towards zero
+ */
+static inline TimeNs scaledToNs(TimeScaled scaled)
+{
+  return scaled / 65536;
+}
+
+/** Convert nanoseconds to scaled nanoseconds (nanoseconds * 2^16) */
+static inline TimeScaled nsToScaled(TimeNs ns)
+{
+  return ns * 65536;
+}
+
+
+/** Port 1 of the clock owning ptpClock.  The ports of a boundary clock
+ * are one array ordered by port number (see allocatePtpdMemory)
+ */
+#define ptpClockFirstPort(ptpClock) ((ptpClock) - ((ptpClock)->port_id_field - 1))
 
 /* bmc.c */
 UInteger8 bmc(ForeignMasterRecord*,RunTimeOpts*,PtpClock*);
-void m1(PtpClock*);
+void m1(RunTimeOpts*,PtpClock*);
 void s1(MsgHeader*,MsgSync*,PtpClock*);
 void initData(RunTimeOpts*,PtpClock*);
 
@@ -101,9 +101,20 @@ int main(int argc, char **argv)
   rtOpts.s                           = DEFAULT_DELAY_S;
   rtOpts.ap                          = DEFAULT_AP;
   rtOpts.ai                          = DEFAULT_AI;
+  rtOpts.fixedGains                  = FALSE;  // Gains follow the lock state unless -G is given
+  rtOpts.servo                       = SERVO_PI;
+  rtOpts.servoWindow                 = LINREG_WINDOW_DEFAULT;
+  rtOpts.delayWindow                 = 0;      // Low pass filter unless -W is given
+  rtOpts.delayRejectMads             = DELAY_REJECT_MADS;
+  rtOpts.stateFile                   = NULL;   // No warm start unless -j is given
   rtOpts.max_foreign_records         = DEFAULT_MAX_FOREIGN_RECORDS;
   rtOpts.currentUtcOffset            = DEFAULT_UTC_OFFSET;
   rtOpts.ptp8021AS                   = FALSE;  // AKB: Added for 802.1AS (PTP over Ethernet)
+  rtOpts.numberPorts                 = 1;      // One port unless -b lists more interfaces
+  rtOpts.portIfaceName               = NULL;
+  rtOpts.portThreads                 = FALSE;  // Run all ports in one thread unless -T
+  rtOpts.threadCpu                   = NULL;
+  rtOpts.numberThreadCpus            = 0;
 
 #ifdef PTPD_DBG
   debugLevel = 0; /* Set all debug printing off unless requested by user */
@@ -141,7 +152,13 @@ int main(int argc, char **argv)
   }
   else
   {
-    if (rtOpts.ifaceName[0] == '\0')
+    if (rtOpts.portThreads)
+    {
+       /* run each port and the servo in a thread of its own */
+       threadProtocol(&rtOpts, ptpClock);
+       NOTIFY("main: self shutdown, probably due to an error\n");
+    }
+    else if (rtOpts.numberPorts > 1 || rtOpts.ifaceName[0] == '\0')
     {
        /* do the multiple port protocol engine, if not bound to a single port */
        multiPortProtocol(&rtOpts, ptpClock);
@@ -0,0 +1,298 @@
+/* src/test/servo_trace.c */
+/* Replay of a recorded Sync trace through the PI and Kalman servos */
+
+/**
+ * @file servo_trace.c
+ *
+ * Feeds the Sync time stamps of a recorded trace (test/sync_trace.txt,
+ * taken from a free running slave) through servoSync() and servoDrain()
+ * with the PI servo and with the Kalman servo, closing the loop on a
+ * simulated slave clock.  The trace supplies the time stamp and network
+ * noise; the clock it was recorded on was not steered, so the offset of
+ * the slave clock is modelled: a fixed frequency error with a slow
+ * wander, plus the frequency adjustments the servo makes.  The mean
+ * master to slave delay of the trace is taken as the path delay.
+ *
+ * The trace is replayed TRACE_PASSES times and the RMS time error of the
+ * simulated clock over the second half is the steady state result of
+ * each servo.  Exits with 1 if the Kalman servo's is not below the PI
+ * servo's.
+ *
+ * A two port boundary clock is then handed over from port 1 to port 2;
+ * the test fails if port 1 adjusts the clock or holds over once port 2
+ * is slave.
+ *
+ * @par Usage
+ * servo_trace [trace file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../ptpd.h"
+
+int debugLevel = 0;
+
+#define TRACE_FILE      "test/sync_trace.txt"
+#define TRACE_MAX       4096      // Most Syncs read from the trace
+#define TRACE_PASSES    4         // Times the trace is replayed
+#define OSC_PPB         5000.0    // Frequency error of the slave clock (ppb)
+#define OSC_WANDER_PPB  2.0       // Amplitude of its wander (ppb)
+#define OSC_PERIOD      100.0     // Period of the wander (s)
+
+static TimeNs    traceT1[TRACE_MAX];
+static TimeNs    traceT2[TRACE_MAX];
+static int       traceLength;
+
+static TimeNs    simNow;          // Slave clock at the current Sync
+static Integer32 simFreq;         // Last value passed to adjFreq() (ppb)
+static int       adjFreqCalls;    // adjFreq() calls counted by handover()
+
+/* The servo's view of the clock, all of it simulated */
+Boolean adjFreq(Integer32 adj)
+{
+  if(adj > ADJ_FREQ_MAX)
+    adj = ADJ_FREQ_MAX;
+  else if(adj < -ADJ_FREQ_MAX)
+    adj = -ADJ_FREQ_MAX;
+  simFreq = adj;
+  adjFreqCalls++;
+  return TRUE;
+}
+void getTime(TimeInternal *time, Integer16 utc_offset) { nsToTime(time, simNow); }
+void setTime(TimeInternal *time, Integer16 utc_offset) { }
+Boolean stepTime(TimeInternal *offset) { return TRUE; }
+void displayStats(RunTimeOpts *rtOpts, PtpClock *ptpClock) { }
+void threadWakeServo(void) { }
+
+/** Function to read the trace, returns FALSE if there is none */
+static Boolean readTrace(const char *path)
+{
+  char      line[128];
+  long long s1, n1, s2, n2;
+  FILE     *file;
+
+  file = fopen(path, "r");
+  if (!file)
+  {
+    perror(path);
+    return FALSE;
+  }
+  while (traceLength < TRACE_MAX && fgets(line, sizeof(line), file))
+  {
+    if (sscanf(line, "%lld.%lld %lld.%lld", &s1, &n1, &s2, &n2) != 4)
+      continue;                            // comment
+    traceT1[traceLength] = s1 * 1000000000LL + n1;
+    traceT2[traceLength] = s2 * 1000000000LL + n2;
+    traceLength++;
+  }
+  fclose(file);
+  return traceLength > 1;
+}
+
+/** Function to allocate zeroed port data sets, aligned as startup.c does */
+static PtpClock *allocPorts(int count)
+{
+  void *ports;
+
+  if (posix_memalign(&ports, CACHE_LINE_SIZE, count * sizeof(PtpClock)))
+    abort();
+  memset(ports, 0, count * sizeof(PtpClock));
+  return ports;
+}
+
+/** Function to set the run time options of a slave with one servo */
+static void initOpts(RunTimeOpts *rtOpts, UInteger8 servo)
+{
+  memset(rtOpts, 0, sizeof(*rtOpts));
+  rtOpts->ap               = DEFAULT_AP;
+  rtOpts->ai               = DEFAULT_AI;
+  rtOpts->s                = DEFAULT_DELAY_S;
+  rtOpts->servo            = servo;
+  rtOpts->servoWindow      = LINREG_WINDOW_DEFAULT;
+  rtOpts->delayRejectMads  = DELAY_REJECT_MADS;
+}
+
+/** Function to replay the trace passes times into a slave port, returns
+ * the RMS time error of the simulated clock over the passes from from on
+ */
+static double replayPasses(RunTimeOpts *rtOpts, /**< run time options */
+                           PtpClock    *clock,  /**< Slave port, its own servo */
+                           int          passes, /**< Times the trace is replayed */
+                           int          from    /**< First pass of the RMS */
+                          )
+{
+  TimeInternal t1, t2;
+  TimeNs       span, t, last = 0;
+  double       delay = 0, error = 0, dt, osc, sum = 0;
+  long         samples = 0;
+  UInteger16   sequence = 0;
+  int          pass, i;
+
+  simFreq = 0;
+
+  for (i = 0; i < traceLength; i++)
+    delay += (double)(traceT2[i] - traceT1[i]) / traceLength;
+  span = traceT1[traceLength - 1] - traceT1[0]
+       + (traceT1[traceLength - 1] - traceT1[0]) / (traceLength - 1);
+
+  for (pass = 0; pass < passes; pass++)
+  {
+    for (i = 0; i < traceLength; i++)
+    {
+      /* the slave clock runs at its own frequency plus the adjustment
+       * since the previous Sync
+       */
+      t  = traceT1[i] + pass * span;
+      dt = last ? (t - last) / 1e9 : 0;
+      osc = OSC_PPB + OSC_WANDER_PPB * sin(2 * M_PI * (t - traceT1[0]) / 1e9 / OSC_PERIOD);
+      error += (osc + simFreq) * dt;
+      last   = t;
+
+      simNow = t + (TimeNs)error;
+      nsToTime(&t1, t);
+      nsToTime(&t2, t + (traceT2[i] - traceT1[i]) - (TimeNs)delay + (TimeNs)error);
+      servoSync(&t1, &t2, sequence++, rtOpts, clock);
+      servoDrain(rtOpts, clock, clock);
+
+      if (pass >= from)
+      {
+        sum += error * error;
+        samples++;
+      }
+    }
+  }
+  return samples ? sqrt(sum / samples) : 0;
+}
+
+/** Function to replay the trace through one servo, returns the steady
+ * state RMS time error of the simulated clock (ns)
+ */
+static double replay(UInteger8 servo)
+{
+  RunTimeOpts  rtOpts;
+  PtpClock    *clock;
+  double       rms;
+
+  initOpts(&rtOpts, servo);
+  clock = allocPorts(1);
+  clock->port_id_field = 1;
+  clock->number_ports  = 1;
+  clock->slave_port    = 1;
+  clock->port_state    = PTP_SLAVE;
+
+  initClock(&rtOpts, clock);
+  servoDrain(&rtOpts, clock, clock);
+  rms = replayPasses(&rtOpts, clock, TRACE_PASSES, TRACE_PASSES / 2);
+
+  free(clock);
+  return rms;
+}
+
+/** Function to hand a two port boundary clock over from port 1 to
+ * port 2, each port with its own servo as without -T, and count the
+ * adjFreq() calls port 1 makes once port 2 is slave.  Port 1 either
+ * leaves SLAVE first, holding over until its next holdover update, or
+ * its reset arrives after port 2 took over.
+ *
+ * @return Returns the adjFreq() calls, plus one if port 1 still holds
+ * over, or -1 if port 1 never held over
+ */
+static int handover(Boolean leaveFirst)
+{
+  RunTimeOpts  rtOpts;
+  PtpClock    *ports;
+  int          calls = 0, i;
+
+  initOpts(&rtOpts, SERVO_PI);
+  ports = allocPorts(2);
+  for (i = 0; i < 2; i++)
+  {
+    ports[i].port_id_field = i + 1;
+    ports[i].number_ports  = 2;
+    ports[i].port_state    = PTP_MASTER;
+  }
+
+  /* port 1 disciplines the clock long enough for a holdover history */
+  ports[0].slave_port = 1;
+  ports[0].port_state = PTP_SLAVE;
+  initClock(&rtOpts, &ports[0]);
+  servoDrain(&rtOpts, &ports[0], &ports[0]);
+  replayPasses(&rtOpts, &ports[0], 1, 1);
+
+  /* as toState() on port 1 leaving SLAVE and port 2 entering it */
+  if (leaveFirst)
+  {
+    ports[0].slave_port = 0;
+    ports[0].port_state = PTP_MASTER;
+    initClock(&rtOpts, &ports[0]);
+    servoDrain(&rtOpts, &ports[0], &ports[0]);
+    if (!ports[0].holdover.active)
+    {
+      free(ports);
+      return -1;
+    }
+  }
+  ports[0].slave_port = 2;
+  ports[1].port_state = PTP_SLAVE;
+  initClock(&rtOpts, &ports[1]);
+  servoDrain(&rtOpts, &ports[1], &ports[1]);
+
+  adjFreqCalls = 0;
+  if (!leaveFirst)
+  {
+    ports[0].port_state = PTP_MASTER;
+    initClock(&rtOpts, &ports[0]);
+    servoDrain(&rtOpts, &ports[0], &ports[0]);
+  }
+  for (i = 0; i < 4; i++)
+  {
+    simNow += HOLDOVER_INTERVAL * 1000000000LL;
+    servoHoldover(&rtOpts, &ports[0]);
+    servoDrain(&rtOpts, &ports[0], &ports[0]);
+  }
+  calls = adjFreqCalls + ports[0].holdover.active;
+
+  free(ports);
+  return calls;
+}
+
+int main(int argc, char **argv)
+{
+  double pi, kalman;
+  int    leaving, late;
+
+  if (!readTrace(argc > 1 ? argv[1] : TRACE_FILE))
+    return 2;
+
+  pi     = replay(SERVO_PI);
+  kalman = replay(SERVO_KALMAN);
+  printf("servo_trace: %d Syncs x %d, steady state RMS time error: PI %.1f ns, Kalman %.1f ns\n",
+         traceLength,
+         TRACE_PASSES,
+         pi,
+         kalman
+        );
+  if (!(kalman < pi))
+  {
+    fprintf(stderr, "servo_trace: Kalman servo not below the PI servo\n");
+    return 1;
+  }
+
+  leaving = handover(TRUE);
+  late    = handover(FALSE);
+  printf("servo_trace: boundary clock handover, adjFreq() calls from the old slave port: %d, %d\n",
+         leaving,
+         late
+        );
+  if (leaving != 0 || late != 0)
+  {
+    fprintf(stderr, "servo_trace: %s\n",
+            leaving < 0 ? "port 1 did not hold over" : "old slave port still adjusts the clock");
+    return 1;
+  }
+  return 0;
+}
+
+// eof servo_trace.c
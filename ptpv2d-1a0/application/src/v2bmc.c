@@ -257,11 +257,11 @@ void v2copyD0(V2MsgHeader *header,
          ptpClock->port_clock_identity,
          8
         );
-  announce->grandmasterPriority1        = ptpClock->grandmaster_priority1;
-  announce->grandmasterPriority2        = ptpClock->grandmaster_priority2;
+  announce->grandmasterPriority1        = ptpClock->priority1;
+  announce->grandmasterPriority2        = ptpClock->priority2;
 
   memcpy(&announce->grandmasterClockQuality,
-         &ptpClock->grandmaster_clock_quality,
+         &ptpClock->clock_quality,
           sizeof(announce->grandmasterClockQuality)
         );
 
@@ -291,7 +291,7 @@ Integer8 v2bmcDataSetComparison(V2MsgHeader *headerA,  /**< Pointer to Version 2
                                 MsgAnnounce *announceB,/**< Pointer to Version 2 PTP announce data for Clock B */
                                 PtpClock    *ptpClockA,/**< Pointer to data set information for Clock A */
                                 PtpClock    *ptpClockB /**< Pointer to data set information for Clock B 
-                                                        *   NOTE: For future full multi port support
+                                                        *   (port that received B)
                                                         */
                                )
 {
@@ -477,21 +477,29 @@ int memcmp_result;
   }
 }
 
-/** Function to test for Best Master between two announce messages */
-UInteger8 v2bmcStateDecision(V2MsgHeader *header,   /**< Pointer to PTP header info */
-                             MsgAnnounce *announce, /**< Pointer to Announce message data */
-                             RunTimeOpts *rtOpts,   /**< Pointer to Run time options */
-                             PtpClock    *ptpClock  /**< Pointer to main PTP data structure */
+/** Function to decide the recommended state of a port from E rbest,
+ * the best announce received on this port, and E best, the best
+ * announce received on any port of the clock.  See IEEE 1588 version 2
+ * figure 26.  With a single port E rbest and E best are the same.
+ */
+UInteger8 v2bmcStateDecision(V2MsgHeader *header,       /**< E rbest PTP header, NULL if none */
+                             MsgAnnounce *announce,     /**< E rbest announce data, NULL if none */
+                             V2MsgHeader *bestHeader,   /**< E best PTP header */
+                             MsgAnnounce *bestAnnounce, /**< E best announce data */
+                             PtpClock    *bestPort,     /**< Port that received E best */
+                             RunTimeOpts *rtOpts,       /**< Pointer to Run time options */
+                             PtpClock    *ptpClock      /**< Pointer to main PTP data structure */
                             )
 {
   /* Test if run time option is set for Slave only, 
-   * if so, run v2_s1 and return SLAVE state
+   * if so, run v2_s1 and return SLAVE state on the port with E best,
+   * other ports of a slave only clock stay PASSIVE
    */
 
   if(rtOpts->slaveOnly)
   {
-    v2_s1(header, announce, ptpClock);
-    return PTP_SLAVE;
+    v2_s1(bestHeader, bestAnnounce, ptpClock);
+    return bestPort == ptpClock ? PTP_SLAVE : PTP_PASSIVE;
   }
   
   v2copyD0(&ptpClock->v2MsgTmpHeader, &ptpClock->msgTmp.announce, ptpClock);
@@ -499,7 +507,8 @@ UInteger8 v2bmcStateDecision(V2MsgHeader *header,   /**< Pointer to PTP header i
   if(ptpClock->msgTmp.announce.grandmasterClockQuality.clockClass < 128)
   {
     /* Grandmaster clock class < 128 */
-    if(   v2bmcDataSetComparison(&ptpClock->v2MsgTmpHeader,    // A: D0 RX PTP header
+    if(   !header
+       || v2bmcDataSetComparison(&ptpClock->v2MsgTmpHeader,    // A: D0 RX PTP header
                                  &ptpClock->msgTmp.announce,   // A: D0 announce data
                                   header,                      // B: Best PTP header
                                   announce,                    // B: Best announce data
@@ -509,7 +518,7 @@ UInteger8 v2bmcStateDecision(V2MsgHeader *header,   /**< Pointer to PTP header i
       )
     {
       /* D0 better than current recommended best master clock */
-      m1(ptpClock);
+      m1(rtOpts, ptpClock);
       return PTP_MASTER;
     }
     /* D0 not better than recommended best master clock */
@@ -518,31 +527,86 @@ UInteger8 v2bmcStateDecision(V2MsgHeader *header,   /**< Pointer to PTP header i
   }
 
   /* D0 is class 128 or higher */
-  /* Compare D0 versus recommended best master clock */
-  else if(v2bmcDataSetComparison(&ptpClock->v2MsgTmpHeader,     // A: D0 PTP header
-                                 &ptpClock->msgTmp.announce,    // A: D0 announce data
-                                 header,                        // B: Best PTP header
-                                 announce,                      // B: Best PTP header
-                                 ptpClock,
-                                 ptpClock
-                                ) > 0
-         )
+  /* Compare D0 versus best master clock of all ports */
+  if(v2bmcDataSetComparison(&ptpClock->v2MsgTmpHeader,     // A: D0 PTP header
+                            &ptpClock->msgTmp.announce,    // A: D0 announce data
+                            bestHeader,                    // B: Best PTP header
+                            bestAnnounce,                  // B: Best PTP header
+                            ptpClock,
+                            bestPort
+                           ) > 0
+    )
   {
     /* D0 is better then recommended best master clock 
      * return MASTER 
      */
-    m1(ptpClock);
+    m1(rtOpts, ptpClock);
     return PTP_MASTER;
   }
-  else
+
+  /* Every port of the clock takes its parent and time properties
+   * data sets from E best
+   */
+  v2_s1(bestHeader, bestAnnounce, ptpClock);
+
+  if(bestPort == ptpClock)
   {
-    /* AKB: multi port not fully supported, so check for if best master clock on "port R"
-     * and E "best" better by topology than E "rbest" is not implemented at this time.
-     * Instead, we go straith to SLAVE state.
-     */
-    v2_s1(header, announce, ptpClock);
+    /* E best was received on this port */
     return PTP_SLAVE;
   }
+
+  if(   header
+     && v2bmcDataSetComparison(bestHeader,
+                               bestAnnounce,
+                               header,
+                               announce,
+                               bestPort,
+                               ptpClock
+                              ) == 9
+    )
+  {
+    /* E best better by topology than E rbest, the master of
+     * E rbest is also reachable through the slave port
+     */
+    return PTP_PASSIVE;
+  }
+
+  /* Other port is SLAVE, this port is MASTER for its link (m3) */
+  return PTP_MASTER;
+}
+
+/** Function to find E rbest, the best foreign master record of a port
+ *
+ * @return Returns index of the best record, -1 if the port has none
+ */
+static Integer16 v2bmcPortBest(PtpClock *ptpClock)
+{
+  ForeignMasterRecord *foreign = ptpClock->foreign;
+  Integer16            i, best;
+
+  if(!ptpClock->number_foreign_records)
+    return -1;
+
+  for(i = 1, best = 0; i < ptpClock->number_foreign_records; ++i)
+  {
+    /* Check current loop indx record versus current "best" record */
+    if(v2bmcDataSetComparison(&foreign[i].v2_header,
+                              &foreign[i].announce,
+                              &foreign[best].v2_header,
+                              &foreign[best].announce,
+                              ptpClock,
+                              ptpClock
+                             ) > 0
+      )
+    {
+      /* Current loop index is better than previous "best", set new "best" */
+      best = i;
+    }
+    DBGV("v2bmc: comparison loop i=%d, best=%d\n",i,best);
+  }
+
+  DBGV("v2bmc: port %d best record %d\n", ptpClock->port_id_field, best);
+  return best;
 }
 
 /** 
@@ -550,8 +614,8 @@ UInteger8 v2bmcStateDecision(V2MsgHeader *header,   /**< Pointer to PTP header i
  * Best Master Clock algorithm processing
  *
  *@par
- * This function scans all the foreign master records and
- * based on current main data for the PTP code,
+ * This function scans all the foreign master records of every
+ * port of the clock and based on current main data for the PTP code,
  * current run time options and current data in 
  * the foreign master records determines if 
  * the PTP state machine should stay the same
@@ -571,11 +635,59 @@ UInteger8 v2bmc(ForeignMasterRecord *foreign,
                 PtpClock            *ptpClock
                )
 {
-  Integer16 i, best;
+  PtpClock  *port, *bestPort;
+  Integer16  i, best, portBest, bestIndex;
+
+  /* Store index to best foreign master of this port */
+
+  best = v2bmcPortBest(ptpClock);
+  if(best >= 0)
+    ptpClock->foreign_record_best = best;
+
+  /* Find E best over all ports of the clock, ports that are not
+   * running the protocol do not count
+   */
+  bestPort  = NULL;
+  bestIndex = -1;
+  port      = ptpClockFirstPort(ptpClock);
+  for(i = 0; i < ptpClock->number_ports; i++, port++)
+  {
+    if(port == ptpClock)
+    {
+      portBest = best;
+    }
+    else if(   port->port_state == PTP_INITIALIZING
+            || port->port_state == PTP_FAULTY
+            || port->port_state == PTP_DISABLED
+           )
+    {
+      continue;
+    }
+    else
+    {
+      portBest = v2bmcPortBest(port);
+    }
+
+    if(   portBest >= 0
+       && (   !bestPort
+           || v2bmcDataSetComparison(&port->foreign[portBest].v2_header,
+                                     &port->foreign[portBest].announce,
+                                     &bestPort->foreign[bestIndex].v2_header,
+                                     &bestPort->foreign[bestIndex].announce,
+                                     port,
+                                     bestPort
+                                    ) > 0
+          )
+      )
+    {
+      bestPort  = port;
+      bestIndex = portBest;
+    }
+  }
 
   /* Check if any foreign masters */
   
-  if(!ptpClock->number_foreign_records)
+  if(!bestPort)
   {
     DBGV("v2bmc: number_foreign_records is zero, state: %u\n",
          ptpClock->port_state
@@ -584,44 +696,24 @@ UInteger8 v2bmc(ForeignMasterRecord *foreign,
     if(ptpClock->port_state == PTP_MASTER)
     {
       DBGV("v2bmc: calling m1\n"); 
-      m1(ptpClock);
+      m1(rtOpts, ptpClock);
     }
     return ptpClock->port_state;  /* no change */
   }
   
-  DBGV("v2bmc: number_foreign_records is non zero, state: %u\n",
+  DBGV("v2bmc: best record %d of port %d, state: %u\n",
+       bestIndex,
+       bestPort->port_id_field,
        ptpClock->port_state
       );
-  /* There is at least one foreign master.  Scan through foreign master database and compare
-   * to look for best master to use 
-   */
-  for(i = 1, best = 0; i < ptpClock->number_foreign_records; ++i)
-  {
-    /* Check current loop indx record versus current "best" record */
-    if(v2bmcDataSetComparison(&foreign[i].v2_header,
-                              &foreign[i].announce,
-                              &foreign[best].v2_header,
-                              &foreign[best].announce,
-                              ptpClock,
-                              ptpClock
-                             ) > 0
-      )
-    {
-      /* Current loop index is better than previous "best", set new "best" */
-      best = i;
-    }
-    DBGV("v2bmc: comparison loop i=%d, best=%d\n",i,best);
-  }
-
-  /* Best record found, store index to best foreign master */
-  
-  DBGV("v2bmc: best record %d\n", best);
-  ptpClock->foreign_record_best = best;
 
   /* Now that best is found, determine recommended state */
   
-  return v2bmcStateDecision(&foreign[best].v2_header,
-                            &foreign[best].announce,
+  return v2bmcStateDecision(best >= 0 ? &foreign[best].v2_header : NULL,
+                            best >= 0 ? &foreign[best].announce  : NULL,
+                            &bestPort->foreign[bestIndex].v2_header,
+                            &bestPort->foreign[bestIndex].announce,
+                            bestPort,
                             rtOpts,
                             ptpClock
                            );